@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/beat_detection.dir/root/repo/beat_detection.c.o"
+  "CMakeFiles/beat_detection.dir/root/repo/beat_detection.c.o.d"
+  "libbeat_detection.a"
+  "libbeat_detection.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/beat_detection.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
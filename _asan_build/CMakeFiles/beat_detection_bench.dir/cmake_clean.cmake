@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/beat_detection_bench.dir/bench/beat_detection_bench.c.o"
+  "CMakeFiles/beat_detection_bench.dir/bench/beat_detection_bench.c.o.d"
+  "beat_detection_bench"
+  "beat_detection_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/beat_detection_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/beat_detection_bench_fixed.dir/bench/beat_detection_bench.c.o"
+  "CMakeFiles/beat_detection_bench_fixed.dir/bench/beat_detection_bench.c.o.d"
+  "beat_detection_bench_fixed"
+  "beat_detection_bench_fixed.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/beat_detection_bench_fixed.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
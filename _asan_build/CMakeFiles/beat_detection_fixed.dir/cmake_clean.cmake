@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/beat_detection_fixed.dir/root/repo/beat_detection.c.o"
+  "CMakeFiles/beat_detection_fixed.dir/root/repo/beat_detection.c.o.d"
+  "libbeat_detection_fixed.a"
+  "libbeat_detection_fixed.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/beat_detection_fixed.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,21 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/host_test/replay/beat_detection_replay.c" "CMakeFiles/beat_detection_replay.dir/replay/beat_detection_replay.c.o" "gcc" "CMakeFiles/beat_detection_replay.dir/replay/beat_detection_replay.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_asan_build/CMakeFiles/beat_detection.dir/DependInfo.cmake"
+  "/root/repo/_asan_build/CMakeFiles/beat_detection_shim.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/beat_detection_replay.dir/replay/beat_detection_replay.c.o"
+  "CMakeFiles/beat_detection_replay.dir/replay/beat_detection_replay.c.o.d"
+  "beat_detection_replay"
+  "beat_detection_replay.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/beat_detection_replay.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
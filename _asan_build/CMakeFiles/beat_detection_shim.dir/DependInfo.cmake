@@ -0,0 +1,21 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/host_test/shim/dsp_shim.c" "CMakeFiles/beat_detection_shim.dir/shim/dsp_shim.c.o" "gcc" "CMakeFiles/beat_detection_shim.dir/shim/dsp_shim.c.o.d"
+  "/root/repo/host_test/shim/esp_shim.c" "CMakeFiles/beat_detection_shim.dir/shim/esp_shim.c.o" "gcc" "CMakeFiles/beat_detection_shim.dir/shim/esp_shim.c.o.d"
+  "/root/repo/host_test/shim/freertos_shim.c" "CMakeFiles/beat_detection_shim.dir/shim/freertos_shim.c.o" "gcc" "CMakeFiles/beat_detection_shim.dir/shim/freertos_shim.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
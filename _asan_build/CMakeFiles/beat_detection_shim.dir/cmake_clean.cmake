@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/beat_detection_shim.dir/shim/dsp_shim.c.o"
+  "CMakeFiles/beat_detection_shim.dir/shim/dsp_shim.c.o.d"
+  "CMakeFiles/beat_detection_shim.dir/shim/esp_shim.c.o"
+  "CMakeFiles/beat_detection_shim.dir/shim/esp_shim.c.o.d"
+  "CMakeFiles/beat_detection_shim.dir/shim/freertos_shim.c.o"
+  "CMakeFiles/beat_detection_shim.dir/shim/freertos_shim.c.o.d"
+  "libbeat_detection_shim.a"
+  "libbeat_detection_shim.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/beat_detection_shim.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
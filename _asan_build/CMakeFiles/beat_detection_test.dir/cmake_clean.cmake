@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/beat_detection_test.dir/test/beat_detection_test.c.o"
+  "CMakeFiles/beat_detection_test.dir/test/beat_detection_test.c.o.d"
+  "beat_detection_test"
+  "beat_detection_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/beat_detection_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,8 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/host_test
+# Build directory: /root/repo/_asan_build
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(beat_detection_test "/root/repo/_asan_build/beat_detection_test")
+set_tests_properties(beat_detection_test PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/host_test/CMakeLists.txt;53;add_test;/root/repo/host_test/CMakeLists.txt;0;")
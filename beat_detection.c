@@ -1,333 +1,3302 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "esp_cpu.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_dsp.h"
 #include "beat_detection_config.h"
 #include "beat_detection.h"
 
 static const char *TAG = "BEAT_DETECTION";
 
+/**
+ * Audio handed from the writer to the task, stamped with the stream position at the end of its
+ * first analysis frame. Ring slots have no release callback; lent buffers are returned through
+ * theirs once the task is done with them.
+ */
+typedef struct {
+    const uint8_t *data;
+    size_t bytes_size;
+    uint64_t sample_index;
+    beat_detection_release_callback_t release_cb;
+    void *release_ctx;
+} beat_detection_queue_item_t;
+
+/*
+ * The FFTs take the twiddle table as an argument instead of using the global table of
+ * dsps_fft2r_init_fc32() / dsps_fft2r_init_sc16(), so every handle runs on tables sized
+ * to its own fft_size and no handle can tear down another one's tables.
+ */
+#if (dsps_fft2r_fc32_aes3_enabled == 1)
+#define beat_detection_fft2r_fc32(data, N, w)   dsps_fft2r_fc32_aes3_(data, N, w)
+#elif (dsps_fft2r_fc32_ae32_enabled == 1)
+#define beat_detection_fft2r_fc32(data, N, w)   dsps_fft2r_fc32_ae32_(data, N, w)
+#else
+#define beat_detection_fft2r_fc32(data, N, w)   dsps_fft2r_fc32_ansi_(data, N, w)
+#endif
+
+#if (dsps_fft2r_sc16_aes3_enabled == 1)
+#define beat_detection_fft2r_sc16(data, N, w)   dsps_fft2r_sc16_aes3_(data, N, w)
+#elif (dsps_fft2r_sc16_ae32_enabled == 1)
+#define beat_detection_fft2r_sc16(data, N, w)   dsps_fft2r_sc16_ae32_(data, N, w)
+#else
+#define beat_detection_fft2r_sc16(data, N, w)   dsps_fft2r_sc16_ansi_(data, N, w)
+#endif
+
+typedef enum {
+    BEAT_DETECTION_TABLE_TWIDDLE_FC32 = 0,  // Bit-reversed radix-2 twiddles, also valid for every smaller FFT
+    BEAT_DETECTION_TABLE_TWIDDLE_SC16,      // Same in Q15
+    BEAT_DETECTION_TABLE_HANN_F32,          // Hann window
+    BEAT_DETECTION_TABLE_HANN_Q15,          // Hann window in Q15
+    BEAT_DETECTION_TABLE_RFFT_SPLIT,        // cos / sin(2 * pi * k / size) for the real FFT split
+    BEAT_DETECTION_TABLE_DECIMATOR,         // Low-pass of a decimator by size / BEAT_DETECTION_DECIMATOR_TAPS_PER_PHASE
+} beat_detection_table_kind_t;
+
+// Taps per output sample of the decimator: the transition band is about 5.5 / 16 of the output rate
+#define BEAT_DETECTION_DECIMATOR_TAPS_PER_PHASE     (16)
+#define BEAT_DETECTION_MAX_DECIMATION               (16)
+// Buffers of the feature triple buffer: the one readers copy, the one being written and one spare
+#define BEAT_DETECTION_FEATURE_SLOTS                (3)
+// Quiet frames the silence gate still analyzes before it closes; the smoothing keeps a tenth of the
+// previous frame, so after these the held spectrum is the noise floor with no trace of the last onset
+#define BEAT_DETECTION_GATE_HOLD_FRAMES             (4)
+// Bins past which the Goertzel engine is slower than the real FFT; on the host it breaks even at
+// 12 to 16 bins for 256 to 1024 points, the target should be measured with the bench
+#define BEAT_DETECTION_GOERTZEL_MAX_BINS            (12)
+
+/**
+ * Read-only table shared by all handles with the same fft_size, built once and reference counted
+ */
+typedef struct beat_detection_table {
+    struct beat_detection_table     *next;
+    beat_detection_table_kind_t     kind;
+    int                             size;
+    uint32_t                        ref_count;
+    void                            *data;
+} beat_detection_table_t;
+
+/**
+ * Bump allocator over a caller workspace. Every block starts on BEAT_DETECTION_WORKSPACE_ALIGN,
+ * which is what the esp-dsp FFT kernels need
+ */
+typedef struct {
+    uint8_t                         *base;
+    size_t                          size;
+    size_t                          used;
+} beat_detection_arena_t;
+
+#define BEAT_DETECTION_ARENA_ROUND(bytes)   (((bytes) + BEAT_DETECTION_WORKSPACE_ALIGN - 1) & ~(size_t)(BEAT_DETECTION_WORKSPACE_ALIGN - 1))
+
+static portMUX_TYPE s_table_lock = portMUX_INITIALIZER_UNLOCKED;
+static beat_detection_table_t *s_table_list = NULL;
+
+#if CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+// The FFT size and channel count are compile-time constants, so the kernels below have constant
+// trip counts and no channel branch, and the analysis buffers live inside the handle
+#define BEAT_DETECTION_FFT_SIZE(handle)         (CONFIG_BEAT_DETECTION_FIXED_FFT_SIZE)
+#define BEAT_DETECTION_CHANNEL(handle)          (CONFIG_BEAT_DETECTION_FIXED_CHANNEL)
+#define BEAT_DETECTION_UNROLL                   _Pragma("GCC unroll 8")
+#else
+#define BEAT_DETECTION_FFT_SIZE(handle)         ((handle)->audio.fft_size)
+#define BEAT_DETECTION_CHANNEL(handle)          ((handle)->audio.channel)
+#define BEAT_DETECTION_UNROLL
+#endif
+
+#if CONFIG_BEAT_DETECTION_INSTANCE_POOL_SIZE > 0
+static beat_detection_t s_instance_pool[CONFIG_BEAT_DETECTION_INSTANCE_POOL_SIZE];
+static bool s_instance_used[CONFIG_BEAT_DETECTION_INSTANCE_POOL_SIZE];
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-static inline uint16_t beat_detection_hz_to_bin(uint16_t hz, beat_detection_handle_t handle)
-{
-    float bin_hz = (float)handle->audio.sample_rate / (float)handle->audio.fft_size;
-    int bin = (int)roundf(hz / bin_hz);
-    if (bin < 1) {
-        return 1;
+static size_t beat_detection_table_bytes(beat_detection_table_kind_t kind, int size)
+{
+    switch (kind) {
+    case BEAT_DETECTION_TABLE_TWIDDLE_SC16:
+    case BEAT_DETECTION_TABLE_HANN_Q15:
+        return size * sizeof(int16_t);
+    default:
+        return size * sizeof(float);
+    }
+}
+
+static void beat_detection_table_build(beat_detection_table_kind_t kind, int size, void *data)
+{
+    switch (kind) {
+    case BEAT_DETECTION_TABLE_TWIDDLE_FC32:
+        dsps_gen_w_r2_fc32((float *)data, size);
+        dsps_bit_rev_fc32_ansi((float *)data, size >> 1);
+        break;
+    case BEAT_DETECTION_TABLE_TWIDDLE_SC16:
+        dsps_gen_w_r2_sc16((int16_t *)data, size);
+        dsps_bit_rev_sc16_ansi((int16_t *)data, size >> 1);
+        break;
+    case BEAT_DETECTION_TABLE_HANN_F32:
+        dsps_wind_hann_f32((float *)data, size);
+        break;
+    case BEAT_DETECTION_TABLE_HANN_Q15:
+        for (int i = 0; i < size; i++) {
+            float w = 0.5f * (1.0f - cosf(2.0f * (float)M_PI * (float)i / (float)(size - 1)));
+            ((int16_t *)data)[i] = (int16_t)lrintf(w * 32767.0f);
+        }
+        break;
+    case BEAT_DETECTION_TABLE_RFFT_SPLIT:
+        for (int k = 0; k < size / 2; k++) {
+            float phase = 2.0f * (float)M_PI * (float)k / (float)size;
+            ((float *)data)[2 * k] = cosf(phase);
+            ((float *)data)[2 * k + 1] = sinf(phase);
+        }
+        break;
+    case BEAT_DETECTION_TABLE_DECIMATOR: {
+        // Blackman-windowed sinc with its cutoff at 0.45 of the output rate, unity gain at DC
+        int factor = size / BEAT_DETECTION_DECIMATOR_TAPS_PER_PHASE;
+        float cutoff = 0.45f / (float)factor;
+        float center = 0.5f * (float)(size - 1);
+        float sum = 0.0f;
+        for (int k = 0; k < size; k++) {
+            float t = (float)k - center;
+            float sinc = (t == 0.0f) ? 1.0f : sinf(2.0f * (float)M_PI * cutoff * t) / (2.0f * (float)M_PI * cutoff * t);
+            float phase = 2.0f * (float)M_PI * (float)k / (float)(size - 1);
+            float window = 0.42f - 0.5f * cosf(phase) + 0.08f * cosf(2.0f * phase);
+            ((float *)data)[k] = sinc * window;
+            sum += sinc * window;
+        }
+        for (int k = 0; k < size; k++) {
+            ((float *)data)[k] /= sum;
+        }
+        break;
+    }
+    }
+}
+
+static beat_detection_table_t *beat_detection_table_find(beat_detection_table_kind_t kind, int size)
+{
+    for (beat_detection_table_t *table = s_table_list; table != NULL; table = table->next) {
+        if (table->kind == kind && table->size == size) {
+            return table;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Get a reference to a shared table, building it on first use. Tables are built outside the
+ * lock; if another handle registered the same table meanwhile, the new copy is discarded.
+ */
+static void *beat_detection_table_acquire(beat_detection_table_kind_t kind, int size, uint32_t caps)
+{
+    taskENTER_CRITICAL(&s_table_lock);
+    beat_detection_table_t *table = beat_detection_table_find(kind, size);
+    if (table != NULL) {
+        table->ref_count++;
+        taskEXIT_CRITICAL(&s_table_lock);
+        return table->data;
+    }
+    taskEXIT_CRITICAL(&s_table_lock);
+
+    beat_detection_table_t *created = (beat_detection_table_t *)heap_caps_malloc(sizeof(beat_detection_table_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    void *data = heap_caps_malloc(beat_detection_table_bytes(kind, size), caps | MALLOC_CAP_8BIT);
+    if (created == NULL || data == NULL) {
+        heap_caps_free(created);
+        heap_caps_free(data);
+        return NULL;
+    }
+    beat_detection_table_build(kind, size, data);
+    created->kind = kind;
+    created->size = size;
+    created->ref_count = 1;
+    created->data = data;
+
+    taskENTER_CRITICAL(&s_table_lock);
+    table = beat_detection_table_find(kind, size);
+    if (table != NULL) {
+        table->ref_count++;
+    } else {
+        created->next = s_table_list;
+        s_table_list = created;
+    }
+    taskEXIT_CRITICAL(&s_table_lock);
+
+    if (table != NULL) {
+        heap_caps_free(data);
+        heap_caps_free(created);
+        return table->data;
+    }
+    return data;
+}
+
+/**
+ * Without an arena all allocations of a detector go to the heap; with one they are carved from the workspace
+ */
+static void *beat_detection_malloc(beat_detection_arena_t *arena, size_t bytes, uint32_t caps)
+{
+    if (arena == NULL) {
+        return heap_caps_malloc(bytes, caps);
+    }
+    size_t rounded = BEAT_DETECTION_ARENA_ROUND(bytes);
+    if (rounded > arena->size - arena->used) {
+        return NULL;
+    }
+    void *block = arena->base + arena->used;
+    arena->used += rounded;
+    return block;
+}
+
+static void *beat_detection_calloc(beat_detection_arena_t *arena, size_t num, size_t bytes, uint32_t caps)
+{
+    void *block = beat_detection_malloc(arena, num * bytes, caps);
+    if (block != NULL) {
+        memset(block, 0, num * bytes);
+    }
+    return block;
+}
+
+/**
+ * Workspace detectors build private tables, so nothing they use outlives the caller's memory
+ */
+static void *beat_detection_table_get(beat_detection_arena_t *arena, beat_detection_table_kind_t kind, int size, uint32_t caps)
+{
+    if (arena == NULL) {
+        return beat_detection_table_acquire(kind, size, caps);
+    }
+    void *data = beat_detection_malloc(arena, beat_detection_table_bytes(kind, size), caps);
+    if (data != NULL) {
+        beat_detection_table_build(kind, size, data);
+    }
+    return data;
+}
+
+static void beat_detection_table_release(const void *data)
+{
+    if (data == NULL) {
+        return;
+    }
+    beat_detection_table_t *released = NULL;
+    taskENTER_CRITICAL(&s_table_lock);
+    for (beat_detection_table_t **link = &s_table_list; *link != NULL; link = &(*link)->next) {
+        if ((*link)->data == data) {
+            if (--(*link)->ref_count == 0) {
+                released = *link;
+                *link = released->next;
+            }
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_table_lock);
+
+    if (released != NULL) {
+        heap_caps_free(released->data);
+        heap_caps_free(released);
+    }
+}
+
+static beat_detection_t *beat_detection_instance_alloc(beat_detection_arena_t *arena, bool enable_psram, uint32_t caps)
+{
+    if (arena != NULL) {
+        beat_detection_t *instance = (beat_detection_t *)beat_detection_calloc(arena, 1, sizeof(beat_detection_t), caps);
+        if (instance != NULL) {
+            instance->workspace.base = arena->base;
+            instance->workspace.size = arena->size;
+        }
+        return instance;
+    }
+#if CONFIG_BEAT_DETECTION_INSTANCE_POOL_SIZE > 0
+    if (!enable_psram) {
+        beat_detection_t *instance = NULL;
+        taskENTER_CRITICAL(&s_table_lock);
+        for (int i = 0; i < CONFIG_BEAT_DETECTION_INSTANCE_POOL_SIZE; i++) {
+            if (!s_instance_used[i]) {
+                s_instance_used[i] = true;
+                instance = &s_instance_pool[i];
+                break;
+            }
+        }
+        taskEXIT_CRITICAL(&s_table_lock);
+        if (instance != NULL) {
+            memset(instance, 0, sizeof(beat_detection_t));
+            instance->status.pooled = true;
+            return instance;
+        }
+    }
+#endif
+    beat_detection_t *instance = (beat_detection_t *)heap_caps_malloc(sizeof(beat_detection_t), caps | MALLOC_CAP_8BIT);
+    if (instance != NULL) {
+        memset(instance, 0, sizeof(beat_detection_t));
+    }
+    return instance;
+}
+
+static void beat_detection_instance_free(beat_detection_t *instance)
+{
+    if (instance->workspace.base != NULL) {
+        return;
+    }
+#if CONFIG_BEAT_DETECTION_INSTANCE_POOL_SIZE > 0
+    if (instance->status.pooled) {
+        taskENTER_CRITICAL(&s_table_lock);
+        s_instance_used[instance - s_instance_pool] = false;
+        taskEXIT_CRITICAL(&s_table_lock);
+        return;
+    }
+#endif
+    heap_caps_free(instance);
+}
+
+/**
+ * Buffers that point into the handle are the static storage of the fixed layout, and buffers of a
+ * workspace detector belong to the caller; neither is freed
+ */
+static void beat_detection_buffer_free(beat_detection_t *instance, void *buffer)
+{
+    if (buffer == NULL || instance->workspace.base != NULL) {
+        return;
+    }
+    if ((uint8_t *)buffer < (uint8_t *)instance || (uint8_t *)buffer >= (uint8_t *)(instance + 1)) {
+        heap_caps_free(buffer);
+    }
+}
+
+static inline uint16_t beat_detection_hz_to_bin(uint16_t hz, uint32_t sample_rate, int fft_size)
+{
+    float bin_hz = (float)sample_rate / (float)fft_size;
+    int bin = (int)roundf(hz / bin_hz);
+    if (bin < 1) {
+        return 1;
+    }
+    if (bin >= fft_size / 2) {
+        return (fft_size / 2) - 1;
+    }
+    return (uint16_t)bin;
+}
+
+/**
+ * Band settings of a configuration: the band array, or the single bass band of audio_cfg stored in
+ * bass_band. Returns NULL for an invalid band array
+ */
+static const beat_detection_band_cfg_t *beat_detection_band_cfg(const beat_detection_cfg_t *cfg, beat_detection_band_cfg_t *bass_band, uint8_t *band_num)
+{
+    if (cfg->audio_cfg.band_num > 0) {
+        if (cfg->audio_cfg.bands == NULL || cfg->audio_cfg.band_num > BEAT_DETECTION_MAX_BANDS) {
+            ESP_LOGE(TAG, "Band array must hold 1 to %d bands", BEAT_DETECTION_MAX_BANDS);
+            return NULL;
+        }
+        *band_num = cfg->audio_cfg.band_num;
+        return cfg->audio_cfg.bands;
+    }
+    *bass_band = (beat_detection_band_cfg_t) {
+        .freq_start = (uint16_t)cfg->audio_cfg.bass_freq_start,
+        .freq_end = (uint16_t)cfg->audio_cfg.bass_freq_end,
+        .threshold = cfg->audio_cfg.threshold,
+        .average_ratio = cfg->audio_cfg.average_ratio,
+        .min_energy = cfg->audio_cfg.min_energy,
+        .time_interval = cfg->audio_cfg.time_interval,
+    };
+    *band_num = 1;
+    return bass_band;
+}
+
+/**
+ * Decimation factor of the input, 1 when disabled
+ */
+static inline uint8_t beat_detection_decimation(const beat_detection_cfg_t *cfg)
+{
+    return (cfg->audio_cfg.decimation > 1) ? cfg->audio_cfg.decimation : 1;
+}
+
+/**
+ * Input samples per channel between two frames; hop and FFT size count decimated samples
+ */
+static inline uint32_t beat_detection_frame_step(const beat_detection_cfg_t *cfg)
+{
+    uint32_t step = (cfg->audio_cfg.hop_size > 0) ? (uint32_t)cfg->audio_cfg.hop_size : (uint32_t)cfg->audio_cfg.fft_size;
+    return step * beat_detection_decimation(cfg);
+}
+
+/**
+ * Bytes of one sample of one channel in the input format
+ */
+static inline uint8_t beat_detection_sample_bytes(const beat_detection_cfg_t *cfg)
+{
+    return (cfg->audio_cfg.format == BEAT_DETECTION_FORMAT_S16) ? sizeof(int16_t) : sizeof(int32_t);
+}
+
+/**
+ * Bin edges of the exported feature bands: band b covers bins edges[b] .. edges[b + 1] - 1. The edges
+ * are spaced evenly in log or mel frequency between freq_min and freq_max, at the decimated rate, and
+ * pushed apart where needed so every band holds at least one bin.
+ */
+static esp_err_t beat_detection_feature_edges(const beat_detection_cfg_t *cfg, uint16_t edges[BEAT_DETECTION_MAX_FEATURE_BANDS + 1])
+{
+    int band_num = cfg->feature_cfg.band_num;
+    int fft_size = cfg->audio_cfg.fft_size;
+    float analysis_rate = (float)cfg->audio_cfg.sample_rate / (float)beat_detection_decimation(cfg);
+    float freq_min = (float)cfg->feature_cfg.freq_min;
+    float freq_max = fminf((float)cfg->feature_cfg.freq_max, 0.5f * analysis_rate);
+    bool mel = (cfg->feature_cfg.scale == BEAT_DETECTION_FEATURE_SCALE_MEL);
+    if (band_num > BEAT_DETECTION_MAX_FEATURE_BANDS || (unsigned)cfg->feature_cfg.scale > BEAT_DETECTION_FEATURE_SCALE_MEL
+        || freq_min <= 0.0f || freq_max <= freq_min) {
+        ESP_LOGE(TAG, "Feature export needs 1 to %d bands and 0 < freq_min < freq_max", BEAT_DETECTION_MAX_FEATURE_BANDS);
+        return ESP_ERR_INVALID_ARG;
+    }
+    float warp_min = mel ? 1127.0f * log1pf(freq_min / 700.0f) : logf(freq_min);
+    float warp_max = mel ? 1127.0f * log1pf(freq_max / 700.0f) : logf(freq_max);
+    for (int b = 0; b <= band_num; b++) {
+        float warp = warp_min + (warp_max - warp_min) * (float)b / (float)band_num;
+        float freq = mel ? 700.0f * expm1f(warp / 1127.0f) : expf(warp);
+        int edge = (int)roundf(freq * (float)fft_size / analysis_rate);
+        int lowest = (b == 0) ? 1 : edges[b - 1] + 1;
+        edge = (edge < lowest) ? lowest : edge;
+        if (edge > fft_size / 2) {
+            ESP_LOGE(TAG, "%d feature bands need more than the %d bins of the FFT", band_num, fft_size / 2);
+            return ESP_ERR_INVALID_ARG;
+        }
+        edges[b] = (uint16_t)edge;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t beat_detection_tempo_lags(const beat_detection_cfg_t *cfg, int *lag_min, int *lag_max)
+{
+    float frame_rate = (float)cfg->audio_cfg.sample_rate / (float)beat_detection_frame_step(cfg);
+    if (cfg->tempo_cfg.bpm_min == 0 || cfg->tempo_cfg.bpm_max <= cfg->tempo_cfg.bpm_min) {
+        ESP_LOGE(TAG, "Tempo range must satisfy 0 < bpm_min < bpm_max");
+        return ESP_ERR_INVALID_ARG;
+    }
+    *lag_min = (int)floorf(60.0f * frame_rate / (float)cfg->tempo_cfg.bpm_max);
+    *lag_max = (int)ceilf(60.0f * frame_rate / (float)cfg->tempo_cfg.bpm_min);
+    *lag_min = (*lag_min < 1) ? 1 : *lag_min;
+    if (*lag_max - *lag_min < 2) {
+        ESP_LOGE(TAG, "Frame rate too low to resolve the tempo range");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t beat_detection_adaptive_window(const beat_detection_cfg_t *cfg, uint16_t *window)
+{
+    uint64_t frames = (uint64_t)cfg->adaptive_cfg.window_ms * cfg->audio_cfg.sample_rate / 1000 / beat_detection_frame_step(cfg);
+    if (frames < 4 || frames > UINT16_MAX || cfg->adaptive_cfg.k < 0.0f) {
+        ESP_LOGE(TAG, "Adaptive threshold needs a window of 4 to %d frames and k >= 0", UINT16_MAX);
+        return ESP_ERR_INVALID_ARG;
+    }
+    *window = (uint16_t)frames;
+    return ESP_OK;
+}
+
+/**
+ * The right channel detector of the MAX and DUAL modes
+ */
+static void beat_detection_peer_cfg(const beat_detection_cfg_t *cfg, beat_detection_cfg_t *peer_cfg)
+{
+    *peer_cfg = *cfg;
+    peer_cfg->audio_cfg.channel_mode = BEAT_DETECTION_CHANNEL_RIGHT;
+    peer_cfg->audio_cfg.hop_size = 0;
+    peer_cfg->flags.verify_engine = false;
+    peer_cfg->flags.tempo_tracking = false;
+    if (cfg->audio_cfg.hop_size > 0) {
+        // The peer is fed once per hop of this detector, so its flux window must cover as many frames
+        peer_cfg->adaptive_cfg.window_ms = (uint32_t)((uint64_t)cfg->adaptive_cfg.window_ms * cfg->audio_cfg.fft_size / cfg->audio_cfg.hop_size);
+    }
+}
+
+/**
+ * Decision settings of one band, squared when the engine compares power. Shared by the detector and
+ * beat_detection_trace_replay(), so a replay decides on exactly the same values.
+ */
+static void beat_detection_band_params(beat_detection_band_t *band, const beat_detection_band_cfg_t *band_cfg, uint32_t sample_rate, bool power_domain)
+{
+    band->threshold = band_cfg->threshold;
+    band->average_ratio = band_cfg->average_ratio;
+    band->min_energy = band_cfg->min_energy;
+    if (power_domain) {
+        band->threshold *= band->threshold;
+        band->average_ratio *= band->average_ratio;
+        band->min_energy *= band->min_energy;
+    }
+    band->interval_samples = (uint64_t)band_cfg->time_interval * sample_rate / 1000;
+    band->next_beat_sample = 0;
+}
+
+static bool detect_bass_surge(float current_bass, float prev_bass, const beat_detection_band_t *band)
+{
+    if (prev_bass <= 0.0f) {
+        return false;
+    }
+    float ratio = current_bass / prev_bass;
+    return (ratio >= band->threshold);
+}
+
+static inline bool beat_detection_fixed_onset(const beat_detection_band_t *band, float current_bass, float prev_bass, float current_sum, float prev_sum)
+{
+    // Only an all-zero previous frame is offset by the band floor, it would give inf or 0 / 0 = NaN
+    float average_ratio;
+    if (prev_sum > 0.0f) {
+        average_ratio = current_sum / prev_sum;
+    } else {
+        float floor = band->min_energy + 1e-9f;
+        average_ratio = (current_sum + floor) / floor;
+    }
+    return detect_bass_surge(current_bass, prev_bass, band) || average_ratio > band->average_ratio;
+}
+
+/**
+ * Final test of a band with an onset, time_interval is measured on the sample clock so queueing
+ * delay does not move it
+ */
+static inline bool beat_detection_band_trigger(beat_detection_band_t *band, bool onset_test, float current_bass, uint64_t sample_index)
+{
+    bool triggered = onset_test && current_bass > band->min_energy && sample_index >= band->next_beat_sample;
+    if (triggered) {
+        band->next_beat_sample = sample_index + band->interval_samples + 1;
+    }
+    return triggered;
+}
+
+/**
+ * Compares the flux of band b with mean + k * sigma of the previous frames and stores it in the
+ * history slot of the current frame. The running sums keep this O(1) per band and frame.
+ */
+static bool beat_detection_flux_update(beat_detection_handle_t handle, int b, float flux)
+{
+    beat_detection_band_t *band = &handle->audio.bands[b];
+    float *history = handle->adaptive.history + b * handle->adaptive.window;
+    uint16_t count = handle->adaptive.count;
+    bool above = false;
+    if (count >= handle->adaptive.warmup) {
+        float mean = band->flux_sum / (float)count;
+        float variance = band->flux_sq_sum / (float)count - mean * mean;
+        float sigma = (variance > 0.0f) ? sqrtf(variance) : 0.0f;
+        above = flux > mean + handle->adaptive.k * sigma;
+    }
+    float oldest = (count == handle->adaptive.window) ? history[handle->adaptive.pos] : 0.0f;
+    band->flux_sum += flux - oldest;
+    band->flux_sq_sum += flux * flux - oldest * oldest;
+    history[handle->adaptive.pos] = flux;
+    return above;
+}
+
+static void beat_detection_flux_advance(beat_detection_handle_t handle)
+{
+    if (handle->adaptive.count < handle->adaptive.window) {
+        handle->adaptive.count++;
+    }
+    if (++handle->adaptive.pos < handle->adaptive.window) {
+        return;
+    }
+    handle->adaptive.pos = 0;
+    // Once per window the sums are rebuilt, so float rounding in the running updates cannot accumulate
+    for (int b = 0; b < handle->audio.band_num; b++) {
+        const float *history = handle->adaptive.history + b * handle->adaptive.window;
+        float sum = 0.0f;
+        float sq_sum = 0.0f;
+        for (int i = 0; i < handle->adaptive.window; i++) {
+            sum += history[i];
+            sq_sum += history[i] * history[i];
+        }
+        handle->audio.bands[b].flux_sum = sum;
+        handle->audio.bands[b].flux_sq_sum = sq_sum;
+    }
+}
+
+#if CONFIG_BEAT_DETECTION_PROFILE
+static inline void beat_detection_profile_start(beat_detection_handle_t handle)
+{
+    handle->profile.mark = esp_cpu_get_cycle_count();
+}
+
+static inline void beat_detection_profile_mark(beat_detection_handle_t handle, beat_detection_stage_t stage)
+{
+    uint32_t now = esp_cpu_get_cycle_count();
+    handle->profile.frame_cycles[stage] += (uint32_t)(now - handle->profile.mark);
+    handle->profile.mark = now;
+}
+
+/* The transform task of the pipeline keeps its own mark and hands its cycles over with the slot */
+static inline void beat_detection_pipeline_mark(beat_detection_handle_t handle, uint32_t *cycles)
+{
+    uint32_t now = esp_cpu_get_cycle_count();
+    if (cycles != NULL) {
+        *cycles = now - handle->pipeline.mark;
+    }
+    handle->pipeline.mark = now;
+}
+#else
+#define beat_detection_profile_start(handle)            ((void)0)
+#define beat_detection_profile_mark(handle, stage)      ((void)0)
+#define beat_detection_pipeline_mark(handle, cycles)    ((void)0)
+#endif
+
+/**
+ * Counters are kept twice, since init and since the last beat_detection_get_stats() call. Writer
+ * and task update them in one short critical section per write or frame, which also keeps the
+ * 64-bit sums consistent for the reader.
+ */
+static void beat_detection_counters_reset(beat_detection_counters_t *counters)
+{
+    memset(counters, 0, sizeof(beat_detection_counters_t));
+    for (int stage = 0; stage < BEAT_DETECTION_STAGE_MAX; stage++) {
+        counters->cycles_min[stage] = UINT32_MAX;
+    }
+}
+
+static void beat_detection_stats_drop(beat_detection_handle_t handle, beat_detection_drop_reason_t reason, size_t samples)
+{
+    taskENTER_CRITICAL(&handle->profile.lock);
+    for (int i = 0; i < 2; i++) {
+        beat_detection_counters_t *c = (i == 0) ? &handle->profile.total : &handle->profile.window;
+        c->dropped[reason]++;
+        c->dropped_samples += samples;
+    }
+    taskEXIT_CRITICAL(&handle->profile.lock);
+}
+
+static void beat_detection_stats_queued(beat_detection_handle_t handle, uint32_t frames)
+{
+    uint32_t waiting = (handle->task.audio_queue != NULL) ? (uint32_t)uxQueueMessagesWaiting(handle->task.audio_queue) : 0;
+    taskENTER_CRITICAL(&handle->profile.lock);
+    for (int i = 0; i < 2; i++) {
+        beat_detection_counters_t *c = (i == 0) ? &handle->profile.total : &handle->profile.window;
+        c->frames_in += frames;
+        c->queue_high_water = (waiting > c->queue_high_water) ? waiting : c->queue_high_water;
+    }
+    taskEXIT_CRITICAL(&handle->profile.lock);
+}
+
+static void beat_detection_stats_frame(beat_detection_handle_t handle, bool failed, uint32_t events_dropped)
+{
+    taskENTER_CRITICAL(&handle->profile.lock);
+    for (int i = 0; i < 2; i++) {
+        beat_detection_counters_t *c = (i == 0) ? &handle->profile.total : &handle->profile.window;
+        c->frames_processed++;
+        c->frames_failed += failed;
+        c->frames_gated += handle->gate.skipped;
+        c->events_dropped += events_dropped;
+        for (int stage = 0; stage < BEAT_DETECTION_STAGE_MAX; stage++) {
+            uint32_t cycles = handle->profile.frame_cycles[stage];
+            c->cycles_total[stage] += cycles;
+            c->cycles_min[stage] = (cycles < c->cycles_min[stage]) ? cycles : c->cycles_min[stage];
+            c->cycles_max[stage] = (cycles > c->cycles_max[stage]) ? cycles : c->cycles_max[stage];
+        }
+    }
+    taskEXIT_CRITICAL(&handle->profile.lock);
+}
+
+static inline esp_err_t beat_detection_check_channel(beat_detection_handle_t handle)
+{
+    if (handle->audio.channel != 1 && handle->audio.channel != 2) {
+        ESP_LOGE(TAG, "Invalid channel");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+/**
+ * Sample `index` of an interleaved frame. A 32-bit word is shifted left by `shift`, which puts a
+ * right-justified 24-bit sample at the top and drops its upper byte, so every wide format has a full
+ * scale of 2^31. With `wide` a compile-time constant the accessor folds into a plain load.
+ */
+static inline __attribute__((always_inline)) int32_t beat_detection_pcm_read(const void *restrict buffer, size_t index, bool wide, int shift)
+{
+    if (wide) {
+        return (int32_t)((uint32_t)((const int32_t *)buffer)[index] << shift);
+    }
+    return ((const int16_t *)buffer)[index];
+}
+
+/**
+ * Deinterleave, PCM to float conversion and windowing in one pass. The channel selection is
+ * resolved outside the loops, so each loop is a plain multiply of unit- or fixed-stride data that
+ * the compiler can unroll and vectorize; esp-dsp has no strided int16 to float primitive to fuse with.
+ * The same pass sums the squares of the unwindowed samples in integers, an associative reduction that
+ * vectorizes too, and returns the mean square power of the frame relative to full scale for the gate.
+ * 32-bit samples are reduced to their top 16 bits for the power, which the gate does not need finer.
+ */
+static inline __attribute__((always_inline)) float beat_detection_load_pcm(beat_detection_handle_t handle, const void *restrict audio_buffer,
+                                                                           float *restrict out, int stride, bool wide)
+{
+    const float *restrict window = handle->audio.window;
+    const int fft_size = BEAT_DETECTION_FFT_SIZE(handle);
+    const int shift = handle->audio.sample_shift;
+    const float scale = wide ? (1.0f / 2147483648.0f) : (1.0f / 32768.0f);
+    const int power_shift = wide ? 16 : 0;
+    int64_t sum = 0;
+    if (BEAT_DETECTION_CHANNEL(handle) == 1) {
+        BEAT_DETECTION_UNROLL
+        for (int i = 0; i < fft_size; i++) {
+            int32_t x = beat_detection_pcm_read(audio_buffer, i, wide, shift);
+            out[stride * i] = (float)x * scale * window[i];
+            int32_t p = x >> power_shift;
+            sum += p * p;
+        }
+    } else if (handle->audio.channel_mix && wide) {
+        // Halve before adding so the mid sample stays in 32 bits
+        BEAT_DETECTION_UNROLL
+        for (int i = 0; i < fft_size; i++) {
+            int32_t x = (beat_detection_pcm_read(audio_buffer, 2 * i, true, shift) >> 1) + (beat_detection_pcm_read(audio_buffer, 2 * i + 1, true, shift) >> 1);
+            out[stride * i] = (float)x * scale * window[i];
+            int32_t p = x >> power_shift;
+            sum += p * p;
+        }
+    } else if (handle->audio.channel_mix) {
+        // Twice the mid sample; it is halved for the power, as its square reaches 2^32 at -65536
+        BEAT_DETECTION_UNROLL
+        for (int i = 0; i < fft_size; i++) {
+            int32_t x = beat_detection_pcm_read(audio_buffer, 2 * i, false, 0) + beat_detection_pcm_read(audio_buffer, 2 * i + 1, false, 0);
+            out[stride * i] = (float)x * (0.5f * scale) * window[i];
+            int32_t p = x >> 1;
+            sum += p * p;
+        }
+    } else {
+        const int offset = handle->audio.channel_offset;
+        BEAT_DETECTION_UNROLL
+        for (int i = 0; i < fft_size; i++) {
+            int32_t x = beat_detection_pcm_read(audio_buffer, 2 * i + offset, wide, shift);
+            out[stride * i] = (float)x * scale * window[i];
+            int32_t p = x >> power_shift;
+            sum += p * p;
+        }
+    }
+    return (float)sum * (1.0f / (32768.0f * 32768.0f)) / (float)fft_size;
+}
+
+/**
+ * Windowed float frame of the engine input. The sample width is dispatched once per frame so each
+ * format gets its own specialized loops.
+ */
+static float beat_detection_load_frame(beat_detection_handle_t handle, const void *audio_buffer, float *restrict out, int stride)
+{
+    if (handle->decimator.factor > 1) {
+        // The decimator already selected the channel and converted, its frame only needs the window
+        const float *restrict window = handle->audio.window;
+        const float *restrict input = handle->decimator.history;
+        const int fft_size = BEAT_DETECTION_FFT_SIZE(handle);
+        float power = 0.0f;
+        BEAT_DETECTION_UNROLL
+        for (int i = 0; i < fft_size; i++) {
+            out[stride * i] = input[i] * window[i];
+            power += input[i] * input[i];
+        }
+        return power / (float)fft_size;
+    }
+    if (handle->audio.sample_bytes == sizeof(int32_t)) {
+        return beat_detection_load_pcm(handle, audio_buffer, out, stride, true);
+    }
+    return beat_detection_load_pcm(handle, audio_buffer, out, stride, false);
+}
+
+/**
+ * Full-size complex FFT with a zero imaginary channel. The magnitude stages of all engines only
+ * compute the bins from mag_bin_start to mag_bin_start + mag_bin_count - 1, which cover the bands.
+ */
+static float beat_detection_complex_load(beat_detection_handle_t handle, const void *audio_buffer, float *fft_buffer)
+{
+    float power = beat_detection_load_frame(handle, audio_buffer, fft_buffer, 2);
+    BEAT_DETECTION_UNROLL
+    for (int i = 0; i < BEAT_DETECTION_FFT_SIZE(handle); i++) {
+        fft_buffer[2 * i + 1] = 0.0f;
+    }
+    return power;
+}
+
+static void beat_detection_complex_fft(beat_detection_handle_t handle, float *fft_buffer)
+{
+    beat_detection_fft2r_fc32(fft_buffer, BEAT_DETECTION_FFT_SIZE(handle), handle->audio.fft_twiddle);
+    dsps_bit_rev_fc32(fft_buffer, BEAT_DETECTION_FFT_SIZE(handle));
+}
+
+static void beat_detection_complex_magnitude(beat_detection_handle_t handle, const float *fft_buffer, float *magnitude)
+{
+    fft_buffer += 2 * handle->audio.mag_bin_start;
+    for (int i = 0; i < handle->audio.mag_bin_count; ++i) {
+        float real = fft_buffer[2 * i];
+        float imag = fft_buffer[2 * i + 1];
+        magnitude[i] = sqrtf(real * real + imag * imag);
+    }
+}
+
+/**
+ * Real-input FFT: the N real samples are packed as N/2 complex samples z[m] = x[2m] + j*x[2m+1],
+ * transformed with an N/2 complex FFT and split into X[k] = Fe[k] + W^k * Fo[k], where
+ * Fe[k] = (Z[k] + conj(Z[N/2-k])) / 2 and Fo[k] = (Z[k] - conj(Z[N/2-k])) / 2j.
+ */
+static void beat_detection_real_fft(beat_detection_handle_t handle, float *fft_buffer)
+{
+    beat_detection_fft2r_fc32(fft_buffer, BEAT_DETECTION_FFT_SIZE(handle) / 2, handle->audio.fft_twiddle);
+    dsps_bit_rev_fc32(fft_buffer, BEAT_DETECTION_FFT_SIZE(handle) / 2);
+}
+
+static void beat_detection_real_magnitude(beat_detection_handle_t handle, const float *fft_buffer, float *magnitude)
+{
+    const int half_size = BEAT_DETECTION_FFT_SIZE(handle) / 2;
+    const float *twiddle = handle->audio.rfft_twiddle;
+    magnitude -= handle->audio.mag_bin_start;
+    for (int k = handle->audio.mag_bin_start; k < handle->audio.mag_bin_start + handle->audio.mag_bin_count; ++k) {
+        int mirror = (k == 0) ? 0 : half_size - k;
+        float a = fft_buffer[2 * k];
+        float b = fft_buffer[2 * k + 1];
+        float c = fft_buffer[2 * mirror];
+        float d = fft_buffer[2 * mirror + 1];
+        float even_re = 0.5f * (a + c);
+        float even_im = 0.5f * (b - d);
+        float odd_re = 0.5f * (b + d);
+        float odd_im = -0.5f * (a - c);
+        float cos_k = twiddle[2 * k];
+        float sin_k = twiddle[2 * k + 1];
+        float real = even_re + cos_k * odd_re + sin_k * odd_im;
+        float imag = even_im + cos_k * odd_im - sin_k * odd_re;
+        magnitude[k] = sqrtf(real * real + imag * imag);
+    }
+}
+
+/**
+ * Adds the state of the first half, carried through the N / 2 silent samples of the second, to the state
+ * of the second half. Carrying a state (s[m], s[m-1]) j steps gives s[m+j] = U_j * s[m] - U_(j-1) * s[m-1]
+ * with the Chebyshev polynomials U_j(cos w) = sin((j + 1) * w) / sin(w). At bin k, w * N / 2 = k * pi,
+ * so over N / 2 steps U_(N/2) = (-1)^k and U_(N/2-1) = 0: the state only flips sign for odd bins.
+ * That needs sin(w) != 0, which holds as band bins are kept within 1..N/2-1.
+ * The merged s1 and s2 are left in the first 2 * bin_count floats, where the magnitude reads them.
+ */
+static void beat_detection_goertzel_merge(beat_detection_handle_t handle, float *state)
+{
+    int bin_count = handle->audio.mag_bin_count;
+    float *a1 = state;
+    float *a2 = state + bin_count;
+    const float *b1 = state + 2 * bin_count;
+    const float *b2 = state + 3 * bin_count;
+    for (int b = 0; b < bin_count; b++) {
+        float sign = ((handle->audio.mag_bin_start + b) & 1) ? -1.0f : 1.0f;
+        a1[b] = b1[b] + sign * a1[b];
+        a2[b] = b2[b] + sign * a2[b];
+    }
+}
+
+/**
+ * Goertzel filters for the bins of the configured bands only. The Hann window is generated on the fly by
+ * rotating a unit phasor, so the result matches the FFT engines without a window or twiddle table.
+ * Conversion and windowing are fused into the filter loop.
+ * Each filter is a serial recurrence, so with the few bins of a bass band its latency, not the
+ * arithmetic, bounds the loop. The two halves of the frame are therefore filtered as independent
+ * chains in the same loop and merged at the end. Past BEAT_DETECTION_GOERTZEL_MAX_BINS bins the
+ * arithmetic takes over and the real FFT is faster.
+ */
+static void beat_detection_goertzel_filter(beat_detection_handle_t handle, const void *audio_buffer, float *state)
+{
+    const int stride = BEAT_DETECTION_CHANNEL(handle);
+    const bool wide = handle->audio.sample_bytes == sizeof(int32_t);
+    const int shift = handle->audio.sample_shift;
+    int offset = handle->audio.channel_offset;
+    const bool mix = handle->audio.channel_mix;
+    const float scale = (mix ? 0.5f : 1.0f) / (wide ? 2147483648.0f : 32768.0f);
+    const int half = BEAT_DETECTION_FFT_SIZE(handle) / 2;
+    int bin_count = handle->audio.mag_bin_count;
+    const float *coeff = handle->audio.goertzel_coeff;
+    // s1 and s2 of the first half, then of the second
+    float *a1 = state;
+    float *a2 = state + bin_count;
+    float *b1 = state + 2 * bin_count;
+    float *b2 = state + 3 * bin_count;
+    memset(state, 0, 4 * bin_count * sizeof(float));
+
+    // cos(2 * pi * n / (N - 1)) by rotating a unit phasor, which drifts far less than a second-order recurrence;
+    // the second half starts from the precomputed phasor of sample N / 2
+    float rot_cos = handle->audio.goertzel_window_rot[0];
+    float rot_sin = handle->audio.goertzel_window_rot[1];
+    float cos_a = 1.0f;
+    float sin_a = 0.0f;
+    float cos_b = handle->audio.goertzel_window_rot[2];
+    float sin_b = handle->audio.goertzel_window_rot[3];
+    for (int n = 0; n < half; n += 2) {
+        // Two samples of each half per pass, so every filter state is loaded and stored once per two steps
+        float xa[2];
+        float xb[2];
+        for (int i = 0; i < 2; i++) {
+            // Mid adds the other channel at half weight; mono input has none, so it is only read when mixing
+            float sample_a = (float)beat_detection_pcm_read(audio_buffer, stride * (n + i) + offset, wide, shift);
+            float sample_b = (float)beat_detection_pcm_read(audio_buffer, stride * (half + n + i) + offset, wide, shift);
+            if (mix) {
+                sample_a += (float)beat_detection_pcm_read(audio_buffer, stride * (n + i) + 1, wide, shift);
+                sample_b += (float)beat_detection_pcm_read(audio_buffer, stride * (half + n + i) + 1, wide, shift);
+            }
+            xa[i] = sample_a * scale * (0.5f - 0.5f * cos_a);
+            xb[i] = sample_b * scale * (0.5f - 0.5f * cos_b);
+            float cos_next = cos_a * rot_cos - sin_a * rot_sin;
+            sin_a = sin_a * rot_cos + cos_a * rot_sin;
+            cos_a = cos_next;
+            cos_next = cos_b * rot_cos - sin_b * rot_sin;
+            sin_b = sin_b * rot_cos + cos_b * rot_sin;
+            cos_b = cos_next;
+        }
+        for (int b = 0; b < bin_count; b++) {
+            float sa = xa[0] + coeff[b] * a1[b] - a2[b];
+            float sb = xb[0] + coeff[b] * b1[b] - b2[b];
+            a2[b] = sa;
+            b2[b] = sb;
+            a1[b] = xa[1] + coeff[b] * sa - a1[b];
+            b1[b] = xb[1] + coeff[b] * sb - b1[b];
+        }
+    }
+    beat_detection_goertzel_merge(handle, state);
+}
+
+/**
+ * Mean square power of the analyzed channel for the gate of the Goertzel engine, whose filters
+ * convert the samples themselves. This integer pass is far cheaper than the filters it may skip.
+ */
+static float beat_detection_goertzel_power(beat_detection_handle_t handle, const void *restrict audio_buffer)
+{
+    const int stride = BEAT_DETECTION_CHANNEL(handle);
+    const int offset = handle->audio.channel_offset;
+    const int fft_size = BEAT_DETECTION_FFT_SIZE(handle);
+    const bool wide = handle->audio.sample_bytes == sizeof(int32_t);
+    const int shift = handle->audio.sample_shift;
+    const int power_shift = wide ? 16 : 0;
+    int64_t sum = 0;
+    if (handle->audio.channel_mix) {
+        for (int i = 0; i < fft_size; i++) {
+            int32_t a = beat_detection_pcm_read(audio_buffer, 2 * i, wide, shift);
+            int32_t b = beat_detection_pcm_read(audio_buffer, 2 * i + 1, wide, shift);
+            int32_t mid = (wide ? (a >> 1) + (b >> 1) : (a + b) >> 1) >> power_shift;
+            sum += mid * mid;
+        }
+    } else {
+        for (int i = 0; i < fft_size; i++) {
+            int32_t x = beat_detection_pcm_read(audio_buffer, stride * i + offset, wide, shift) >> power_shift;
+            sum += x * x;
+        }
+    }
+    return (float)sum * (1.0f / (32768.0f * 32768.0f)) / (float)fft_size;
+}
+
+static void beat_detection_goertzel_magnitude(beat_detection_handle_t handle, const float *state, float *magnitude)
+{
+    int bin_count = handle->audio.mag_bin_count;
+    const float *coeff = handle->audio.goertzel_coeff;
+    const float *s1 = state;
+    const float *s2 = state + bin_count;
+    for (int b = 0; b < bin_count; b++) {
+        float power = s1[b] * s1[b] + s2[b] * s2[b] - coeff[b] * s1[b] * s2[b];
+        magnitude[b] = (power > 0.0f) ? sqrtf(power) : 0.0f;
+    }
+}
+
+/**
+ * Fixed-point path: Q15 window, dsps_fft2r_sc16 (which scales by 1/N) and integer power.
+ * The power of the band bins is converted to the float path's units, (|X| * N / 32768)^2,
+ * so the decision compares power against squared thresholds and no sqrtf is needed.
+ * The rounding of the nine or so FFT stages leaves a few LSB of noise in every bin, about N / 32768
+ * in magnitude, which would bury the bins of a quiet frame. Each frame is therefore block scaled:
+ * shifted left by its headroom before the window, so its peak sample uses the full 16 bits, and
+ * the exponent is stored behind the FFT data for the power to undo. The noise then stays that far
+ * below the frame's own peak whatever its level.
+ */
+static inline __attribute__((always_inline)) int32_t beat_detection_q15_sample(beat_detection_handle_t handle, const void *restrict audio_buffer,
+                                                                               int i, bool wide, int shift)
+{
+    if (handle->audio.channel_mix) {
+        int32_t a = beat_detection_pcm_read(audio_buffer, 2 * i, wide, shift);
+        int32_t b = beat_detection_pcm_read(audio_buffer, 2 * i + 1, wide, shift);
+        return wide ? (a >> 1) + (b >> 1) : (a + b) >> 1;
+    }
+    return beat_detection_pcm_read(audio_buffer, BEAT_DETECTION_CHANNEL(handle) * i + handle->audio.channel_offset, wide, shift);
+}
+
+static inline __attribute__((always_inline)) float beat_detection_q15_pcm(beat_detection_handle_t handle, const void *restrict audio_buffer,
+                                                                          int16_t *restrict fft_buffer, bool wide)
+{
+    const int fft_size = BEAT_DETECTION_FFT_SIZE(handle);
+    const int16_t *restrict window = handle->audio.window_q15;
+    const int shift = handle->audio.sample_shift;
+    // The gate power uses the top 16 bits of 32-bit samples
+    const int narrow = wide ? 16 : 0;
+    int64_t sum = 0;
+    // The OR of the magnitudes has the leading zeros of the largest one, and vectorizes like the sum
+    uint32_t peak = 0;
+    BEAT_DETECTION_UNROLL
+    for (int i = 0; i < fft_size; i++) {
+        int32_t x = beat_detection_q15_sample(handle, audio_buffer, i, wide, shift);
+        peak |= (x < 0) ? 0u - (uint32_t)x : (uint32_t)x;
+        int32_t p = x >> narrow;
+        sum += p * p;
+    }
+    // Left shift that brings the peak to 15 bits plus sign, at most 14 for 16-bit and 30 for 32-bit samples
+    int exponent = (peak == 0) ? 0 : __builtin_clz(peak) - (wide ? 1 : 17);
+    exponent = (exponent > 0) ? exponent : 0;
+    const int left = wide ? ((exponent > 16) ? exponent - 16 : 0) : exponent;
+    const int right = wide ? ((exponent > 16) ? 0 : 16 - exponent) : 0;
+    BEAT_DETECTION_UNROLL
+    for (int i = 0; i < fft_size; i++) {
+        int32_t x = (beat_detection_q15_sample(handle, audio_buffer, i, wide, shift) >> right) * (1 << left);
+        fft_buffer[2 * i] = (int16_t)((x * window[i] + (1 << 14)) >> 15);
+        fft_buffer[2 * i + 1] = 0;
+    }
+    fft_buffer[2 * fft_size] = (int16_t)exponent;
+    return (float)sum * (1.0f / (32768.0f * 32768.0f)) / (float)fft_size;
+}
+
+static float beat_detection_q15_load(beat_detection_handle_t handle, const void *audio_buffer, int16_t *restrict fft_buffer)
+{
+    if (handle->audio.sample_bytes == sizeof(int32_t)) {
+        return beat_detection_q15_pcm(handle, audio_buffer, fft_buffer, true);
+    }
+    return beat_detection_q15_pcm(handle, audio_buffer, fft_buffer, false);
+}
+
+static void beat_detection_q15_fft(beat_detection_handle_t handle, int16_t *fft_buffer)
+{
+    beat_detection_fft2r_sc16(fft_buffer, BEAT_DETECTION_FFT_SIZE(handle), handle->audio.twiddle_sc16);
+    dsps_bit_rev_sc16_ansi(fft_buffer, BEAT_DETECTION_FFT_SIZE(handle));
+}
+
+static void beat_detection_q15_power(beat_detection_handle_t handle, const int16_t *fft_buffer, float *power)
+{
+    // The block exponent of the frame, stored behind the FFT data by the load
+    const float scale = ldexpf(handle->audio.q15_power_scale, -2 * fft_buffer[2 * BEAT_DETECTION_FFT_SIZE(handle)]);
+    for (int b = 0; b < handle->audio.mag_bin_count; b++) {
+        int bin = handle->audio.mag_bin_start + b;
+        int32_t real = fft_buffer[2 * bin];
+        int32_t imag = fft_buffer[2 * bin + 1];
+        uint32_t bin_power = (uint32_t)(real * real) + (uint32_t)(imag * imag);
+        power[b] = (float)bin_power * scale;
+    }
+}
+
+/**
+ * Engine output of one frame: the FFT buffer, the Q15 FFT buffer or the Goertzel filter state.
+ * The stages take it as a parameter so the pipeline can transform into a second one.
+ */
+static inline void *beat_detection_spectrum(beat_detection_handle_t handle)
+{
+    switch (handle->audio.engine) {
+    case BEAT_DETECTION_ENGINE_GOERTZEL:
+        return handle->audio.goertzel_state;
+    case BEAT_DETECTION_ENGINE_FFT_Q15:
+        return handle->audio.fft_buffer_sc16;
+    default:
+        return handle->audio.fft_buffer;
+    }
+}
+
+static size_t beat_detection_spectrum_bytes(beat_detection_engine_t engine, int fft_size, size_t bin_count)
+{
+    switch (engine) {
+    case BEAT_DETECTION_ENGINE_GOERTZEL:
+        // The two half-frame filter states, merged into the first two
+        return 4 * bin_count * sizeof(float);
+    case BEAT_DETECTION_ENGINE_FFT_Q15:
+        // The block exponent and a pad follow the FFT data
+        return (2 * fft_size + 2) * sizeof(int16_t);
+    case BEAT_DETECTION_ENGINE_REAL_FFT:
+        return fft_size * sizeof(float);
+    default:
+        return 2 * fft_size * sizeof(float);
+    }
+}
+
+/**
+ * Load the frame into the engine input and leave its mean square power in gate.power
+ */
+static void beat_detection_stage_convert(beat_detection_handle_t handle, const void *audio_buffer, void *spectrum)
+{
+    switch (handle->audio.engine) {
+    case BEAT_DETECTION_ENGINE_REAL_FFT:
+        handle->gate.power = beat_detection_load_frame(handle, audio_buffer, (float *)spectrum, 1);
+        break;
+    case BEAT_DETECTION_ENGINE_GOERTZEL:
+        // The filters convert the samples in the FFT stage, only the gate needs a pass ahead of them
+        handle->gate.power = handle->status.silence_gate ? beat_detection_goertzel_power(handle, audio_buffer) : 0.0f;
+        break;
+    case BEAT_DETECTION_ENGINE_FFT_Q15:
+        handle->gate.power = beat_detection_q15_load(handle, audio_buffer, (int16_t *)spectrum);
+        break;
+    default:
+        handle->gate.power = beat_detection_complex_load(handle, audio_buffer, (float *)spectrum);
+        break;
+    }
+}
+
+/**
+ * Silence gate with hysteresis on the power of the converted frame: it closes below close_power and
+ * opens again only above open_power. Like the hold time of an audio gate it closes only after
+ * BEAT_DETECTION_GATE_HOLD_FRAMES quiet frames went through the whole analysis, so the spectrum it then
+ * holds is that of the quiet input. Returns true when the frame is to skip the FFT and magnitude.
+ */
+static bool beat_detection_gate_closed(beat_detection_handle_t handle, float power)
+{
+    if (!handle->status.silence_gate) {
+        return false;
+    }
+    if (handle->gate.open ? power < handle->gate.close_power : power < handle->gate.open_power) {
+        if (handle->gate.open && ++handle->gate.quiet <= BEAT_DETECTION_GATE_HOLD_FRAMES) {
+            return false;
+        }
+        handle->gate.open = false;
+        return true;
+    }
+    handle->gate.open = true;
+    handle->gate.quiet = 0;
+    return false;
+}
+
+/**
+ * Magnitude of a gated frame without the transform: the spectrum of the last analyzed frame, which the
+ * hold of the gate made a quiet one. Its level says nothing about where the energy of the gated frame
+ * is, so a gated frame neither rises, and cannot trigger, nor lowers the history, and the first frame
+ * past the gate is compared with the noise floor exactly as without the gate.
+ */
+static void beat_detection_gate_magnitude(beat_detection_handle_t handle)
+{
+    memcpy(handle->audio.magnitude, handle->audio.magnitude_prev, sizeof(float) * handle->audio.mag_bin_count);
+}
+
+static void beat_detection_stage_fft(beat_detection_handle_t handle, const void *audio_buffer, void *spectrum)
+{
+    switch (handle->audio.engine) {
+    case BEAT_DETECTION_ENGINE_REAL_FFT:
+        beat_detection_real_fft(handle, (float *)spectrum);
+        break;
+    case BEAT_DETECTION_ENGINE_GOERTZEL:
+        beat_detection_goertzel_filter(handle, audio_buffer, (float *)spectrum);
+        break;
+    case BEAT_DETECTION_ENGINE_FFT_Q15:
+        beat_detection_q15_fft(handle, (int16_t *)spectrum);
+        break;
+    default:
+        beat_detection_complex_fft(handle, (float *)spectrum);
+        break;
+    }
+}
+
+static void beat_detection_stage_magnitude(beat_detection_handle_t handle, const void *spectrum)
+{
+    switch (handle->audio.engine) {
+    case BEAT_DETECTION_ENGINE_REAL_FFT:
+        beat_detection_real_magnitude(handle, (const float *)spectrum, handle->audio.magnitude);
+        break;
+    case BEAT_DETECTION_ENGINE_GOERTZEL:
+        beat_detection_goertzel_magnitude(handle, (const float *)spectrum, handle->audio.magnitude);
+        break;
+    case BEAT_DETECTION_ENGINE_FFT_Q15:
+        beat_detection_q15_power(handle, (const int16_t *)spectrum, handle->audio.magnitude);
+        break;
+    default:
+        beat_detection_complex_magnitude(handle, (const float *)spectrum, handle->audio.magnitude);
+        break;
+    }
+}
+
+static void beat_detection_verify_engine(beat_detection_handle_t handle, const void *audio_buffer)
+{
+    beat_detection_complex_load(handle, audio_buffer, handle->verify.fft_buffer);
+    beat_detection_complex_fft(handle, handle->verify.fft_buffer);
+    beat_detection_complex_magnitude(handle, handle->verify.fft_buffer, handle->verify.magnitude);
+
+    const float *reference = handle->verify.magnitude;
+    float peak = 0.0f;
+    float max_abs_error = 0.0f;
+    bool exact = true;
+    for (int i = 0; i < handle->audio.mag_bin_count; ++i) {
+        float value = handle->status.power_domain ? sqrtf(handle->audio.magnitude[i]) : handle->audio.magnitude[i];
+        float error = fabsf(value - reference[i]);
+        if (error > max_abs_error) {
+            max_abs_error = error;
+        }
+        if (reference[i] > peak) {
+            peak = reference[i];
+        }
+        if (memcmp(&value, &reference[i], sizeof(float)) != 0) {
+            exact = false;
+        }
+    }
+
+    handle->verify.result.frame_count++;
+    if (exact) {
+        handle->verify.result.exact_frame_count++;
+    }
+    if (max_abs_error > handle->verify.result.max_abs_error) {
+        handle->verify.result.max_abs_error = max_abs_error;
+    }
+    if (peak > 0.0f && max_abs_error / peak > handle->verify.result.max_rel_error) {
+        handle->verify.result.max_rel_error = max_abs_error / peak;
+    }
+}
+
+/**
+ * Tempo tracker. The onset strength of every frame (rise of the band energies) is mean-removed
+ * and correlated with its own history over the lags of bpm_min..bpm_max in a leaky autocorrelation,
+ * weighted by a log-Gaussian prior around 120 BPM against octave errors. The beat phase follows
+ * the detected beats in a phase-locked loop that keeps predicting on the tempo period between them.
+ */
+static void beat_detection_tempo_update(beat_detection_handle_t handle, float onset, bool detected)
+{
+    int lag_count = handle->tempo.lag_max - handle->tempo.lag_min + 1;
+    int history_len = handle->tempo.lag_max + 1;
+
+    handle->tempo.mean += (onset - handle->tempo.mean) * handle->tempo.mean_rate;
+    float x = onset - handle->tempo.mean;
+    handle->tempo.history[handle->tempo.history_pos] = x;
+    handle->tempo.energy = handle->tempo.decay * handle->tempo.energy + x * x;
+
+    int best = 0;
+    float best_score = 0.0f;
+    for (int i = 0; i < lag_count; i++) {
+        int pos = handle->tempo.history_pos - (handle->tempo.lag_min + i);
+        if (pos < 0) {
+            pos += history_len;
+        }
+        handle->tempo.acf[i] = handle->tempo.decay * handle->tempo.acf[i] + x * handle->tempo.history[pos];
+        float score = handle->tempo.acf[i] * handle->tempo.prior[i];
+        if (score > best_score) {
+            best_score = score;
+            best = i;
+        }
+    }
+    handle->tempo.history_pos = (handle->tempo.history_pos + 1) % history_len;
+    if (best_score <= 0.0f || handle->tempo.energy <= 0.0f) {
+        return;
+    }
+
+    // Parabolic interpolation around the peak for a lag finer than one frame
+    float lag = (float)(handle->tempo.lag_min + best);
+    if (best > 0 && best < lag_count - 1) {
+        float left = handle->tempo.acf[best - 1];
+        float center = handle->tempo.acf[best];
+        float right = handle->tempo.acf[best + 1];
+        float denom = left - 2.0f * center + right;
+        if (denom < 0.0f) {
+            lag += 0.5f * (left - right) / denom;
+        }
+    }
+    float period = lag * (float)handle->tempo.frame_step;
+    float confidence = handle->tempo.acf[best] / handle->tempo.energy;
+    confidence = (confidence > 1.0f) ? 1.0f : confidence;
+
+    double now = (double)handle->audio.sample_index;
+    double next = handle->tempo.next_beat;
+
+    // Predictive callback once per predicted beat, lead_samples ahead of it
+    if (handle->tempo.locked && confidence >= handle->tempo.min_confidence
+        && handle->tempo.fired_number != handle->tempo.beat_number
+        && now + (double)handle->tempo.lead_samples >= next) {
+        handle->tempo.fired_number = handle->tempo.beat_number;
+        handle->tempo.fired.bpm = 60.0f * (float)handle->audio.sample_rate / period;
+        handle->tempo.fired.confidence = confidence;
+        handle->tempo.fired.beat_period = period;
+        handle->tempo.fired.next_beat_sample = (uint64_t)next;
+        handle->tempo.fired.sample_index = handle->audio.sample_index;
+        handle->tempo.fire = true;
+    }
+
+    if (detected) {
+        double previous = next - period;
+        bool early = (next - now) < (now - previous);
+        double error = now - (early ? next : previous);
+        if (handle->tempo.locked && fabs(error) < 0.25 * period) {
+            // Pull the phase halfway towards the detected beat
+            next += 0.5 * error + (early ? period : 0.0);
+            handle->tempo.beat_number += early;
+        } else if (!handle->tempo.locked || confidence < handle->tempo.min_confidence) {
+            // Not locked yet or the tempo is unreliable, restart the phase from this beat
+            next = now + period;
+            handle->tempo.beat_number++;
+            handle->tempo.locked = true;
+        }
+    }
+    // Flywheel over beats that passed without a detection
+    while (handle->tempo.locked && next <= now) {
+        next += period;
+        handle->tempo.beat_number++;
+    }
+    handle->tempo.next_beat = next;
+
+    taskENTER_CRITICAL(&handle->tempo.lock);
+    handle->tempo.state.bpm = 60.0f * (float)handle->audio.sample_rate / period;
+    handle->tempo.state.confidence = confidence;
+    handle->tempo.state.beat_period = period;
+    handle->tempo.state.next_beat_sample = handle->tempo.locked ? (uint64_t)next : 0;
+    handle->tempo.state.sample_index = handle->audio.sample_index;
+    taskEXIT_CRITICAL(&handle->tempo.lock);
+}
+
+/**
+ * Publish the feature frame of the smoothed spectrum. Frame n goes to slot n % 3 while readers copy
+ * the latest complete frame n - 1, so the detector never waits for them. The slot's sequence is
+ * cleared before and set after the write, so a reader lapped twice during its copy sees it change
+ * and copies again. `magnitude` is indexed by bin.
+ */
+static void beat_detection_features_publish(beat_detection_handle_t handle, const float *magnitude, float bass_energy, float onset)
+{
+    // Sequence 0 means no frame, so it is skipped when the counter wraps
+    uint32_t sequence = handle->features.published + 1;
+    sequence = (sequence == 0) ? 1 : sequence;
+    beat_detection_feature_slot_t *slot = &handle->features.slots[sequence % BEAT_DETECTION_FEATURE_SLOTS];
+    __atomic_store_n(&slot->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    beat_detection_features_t *frame = &slot->frame;
+    frame->sample_index = handle->audio.sample_index;
+    frame->sequence = sequence;
+    frame->bass_energy = bass_energy;
+    frame->onset = onset;
+    frame->band_num = handle->features.band_num;
+    for (int b = 0; b < handle->features.band_num; b++) {
+        const beat_detection_feature_band_t *band = &handle->features.bands[b];
+        const float *bins = magnitude + band->bin_start;
+        float sum = 0.0f;
+        if (handle->status.power_domain) {
+            for (int i = 0; i < band->bin_count; i++) {
+                sum += bins[i];
+            }
+        } else {
+            for (int i = 0; i < band->bin_count; i++) {
+                sum += bins[i] * bins[i];
+            }
+        }
+        frame->bands[b] = sqrtf(sum * band->scale);
+    }
+
+    __atomic_store_n(&slot->sequence, sequence, __ATOMIC_RELEASE);
+    __atomic_store_n(&handle->features.published, sequence, __ATOMIC_RELEASE);
+}
+
+/**
+ * Push one decision record into the trace ring of `sink`. The decision is the only writer of head and
+ * dropped, the consumer the only writer of tail; the release store of head publishes the record.
+ */
+static void beat_detection_trace_push(beat_detection_handle_t sink, beat_detection_trace_record_t *record)
+{
+    uint32_t head = sink->trace.head;
+    uint32_t dropped = sink->trace.dropped;
+    record->sequence = head + dropped;
+    if (head - __atomic_load_n(&sink->trace.tail, __ATOMIC_ACQUIRE) > sink->trace.mask) {
+        __atomic_store_n(&sink->trace.dropped, dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    sink->trace.records[head & sink->trace.mask] = *record;
+    __atomic_store_n(&sink->trace.head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Smoothing and band decision on handle->audio.magnitude, the part of the analysis after the
+ * magnitude stage. Fills in the event for the frame ending at handle->audio.sample_index.
+ */
+static beat_detection_result_t beat_detection_decision(beat_detection_handle_t handle, beat_detection_event_t *event)
+{
+    for (int i = 0; i < handle->audio.mag_bin_count; ++i) {
+        float a = 0.9f;
+        handle->audio.magnitude[i] = a * handle->audio.magnitude[i] + (1 - a) * handle->audio.magnitude_prev[i];
+    }
+
+    // magnitude[] holds bins mag_bin_start .. mag_bin_start + mag_bin_count - 1
+    const float *magnitude = handle->audio.magnitude - handle->audio.mag_bin_start;
+    const float *magnitude_prev = handle->audio.magnitude_prev - handle->audio.mag_bin_start;
+    event->sample_index = handle->audio.sample_index;
+    event->channel = handle->audio.detector;
+    event->band_mask = 0;
+    float onset = 0.0f;
+    float bass_energy = 0.0f;
+    for (int b = 0; b < handle->audio.band_num; ++b) {
+        beat_detection_band_t *band = &handle->audio.bands[b];
+        float current_bass = 0.0f;
+        float prev_bass = 0.0f;
+        float current_sum = 0.0f;
+        float prev_sum = 0.0f;
+        float flux = 0.0f;
+        for (int bin = band->bin_start; bin <= band->bin_end; ++bin) {
+            if (magnitude_prev[bin] > prev_bass) {
+                prev_bass = magnitude_prev[bin];
+            }
+            if (magnitude[bin] > current_bass) {
+                current_bass = magnitude[bin];
+            }
+            current_sum += magnitude[bin];
+            prev_sum += magnitude_prev[bin];
+            // Half-wave rectified spectral flux
+            float rise = magnitude[bin] - magnitude_prev[bin];
+            flux += (rise > 0.0f) ? rise : 0.0f;
+        }
+        if (current_sum > prev_sum) {
+            onset += logf((current_sum + 1e-9f) / (prev_sum + 1e-9f));
+        }
+
+        bool onset_test;
+        if (handle->status.adaptive_threshold) {
+            // Log compression keeps a few loud onsets from inflating sigma above the quieter ones
+            onset_test = beat_detection_flux_update(handle, b, log1pf(flux / (band->min_energy + 1e-9f)));
+        } else {
+            onset_test = beat_detection_fixed_onset(band, current_bass, prev_bass, current_sum, prev_sum);
+        }
+        bool triggered = beat_detection_band_trigger(band, onset_test, current_bass, handle->audio.sample_index);
+        if (handle->trace.sink != NULL) {
+            beat_detection_trace_record_t record = {
+                .sample_index = handle->audio.sample_index,
+                .current_peak = current_bass,
+                .prev_peak = prev_bass,
+                .current_sum = current_sum,
+                .prev_sum = prev_sum,
+                .band = (uint8_t)b,
+                .channel = handle->audio.detector,
+                .flags = (triggered ? BEAT_DETECTION_TRACE_TRIGGERED : 0) | (handle->gate.skipped ? BEAT_DETECTION_TRACE_GATED : 0),
+            };
+            beat_detection_trace_push(handle->trace.sink, &record);
+        }
+
+        // The event carries the values of the lowest triggered band, or of band 0 when none triggered.
+        // They are reported as magnitudes whatever domain the engine compares in
+        if (b == 0) {
+            bass_energy = handle->status.power_domain ? sqrtf(current_bass) : current_bass;
+        }
+        if (b == 0 || (triggered && event->band_mask == 0)) {
+            float surge_ratio = (prev_bass > 0.0f) ? current_bass / prev_bass : 0.0f;
+            event->energy = handle->status.power_domain ? sqrtf(current_bass) : current_bass;
+            event->surge_ratio = handle->status.power_domain ? sqrtf(surge_ratio) : surge_ratio;
+        }
+        if (triggered) {
+            event->band_mask |= 1u << b;
+        }
+    }
+
+    if (handle->status.adaptive_threshold) {
+        beat_detection_flux_advance(handle);
+    }
+    if (handle->features.slots != NULL) {
+        beat_detection_features_publish(handle, magnitude, bass_energy, onset);
+    }
+    memcpy(handle->audio.magnitude_prev, handle->audio.magnitude, sizeof(float) * handle->audio.mag_bin_count);
+
+    event->result = (event->band_mask != 0) ? BEAT_DETECTED : BEAT_NOT_DETECTED;
+    if (handle->status.tempo_tracking) {
+        beat_detection_tempo_update(handle, onset, event->result == BEAT_DETECTED);
+    }
+    beat_detection_profile_mark(handle, BEAT_DETECTION_STAGE_DECISION);
+    return event->result;
+}
+
+/**
+ * Analyze one frame ending at handle->audio.sample_index and fill in the event for it.
+ */
+static beat_detection_result_t beat_detection(beat_detection_handle_t handle, const void *audio_buffer, beat_detection_event_t *event)
+{
+    if (handle == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return BEAT_DETECTION_FAILED;
+    }
+
+    if (beat_detection_check_channel(handle) != ESP_OK) {
+        return BEAT_DETECTION_FAILED;
+    }
+
+    void *spectrum = beat_detection_spectrum(handle);
+    beat_detection_handle_t peer = (handle->audio.channel_mode == BEAT_DETECTION_CHANNEL_MAX) ? handle->audio.peer : NULL;
+    beat_detection_profile_start(handle);
+    beat_detection_stage_convert(handle, audio_buffer, spectrum);
+    float power = handle->gate.power;
+    if (peer != NULL) {
+        // The peer converts the right channel up front, so the gate stays open while either channel is loud
+        beat_detection_stage_convert(peer, audio_buffer, beat_detection_spectrum(peer));
+        power = fmaxf(power, peer->gate.power);
+    }
+    beat_detection_profile_mark(handle, BEAT_DETECTION_STAGE_CONVERT);
+    handle->gate.skipped = beat_detection_gate_closed(handle, power);
+    if (handle->gate.skipped) {
+        beat_detection_gate_magnitude(handle);
+        beat_detection_profile_mark(handle, BEAT_DETECTION_STAGE_MAGNITUDE);
+        return beat_detection_decision(handle, event);
+    }
+    beat_detection_stage_fft(handle, audio_buffer, spectrum);
+    beat_detection_profile_mark(handle, BEAT_DETECTION_STAGE_FFT);
+    beat_detection_stage_magnitude(handle, spectrum);
+    beat_detection_profile_mark(handle, BEAT_DETECTION_STAGE_MAGNITUDE);
+
+    if (handle->status.verify_engine) {
+        beat_detection_verify_engine(handle, audio_buffer);
+        beat_detection_profile_start(handle);
+    }
+
+    if (peer != NULL) {
+        // The peer analyzes the right channel; the louder channel wins in every bin
+        void *peer_spectrum = beat_detection_spectrum(peer);
+        beat_detection_stage_fft(peer, audio_buffer, peer_spectrum);
+        beat_detection_stage_magnitude(peer, peer_spectrum);
+        for (int i = 0; i < handle->audio.mag_bin_count; ++i) {
+            handle->audio.magnitude[i] = fmaxf(handle->audio.magnitude[i], peer->audio.magnitude[i]);
+        }
+        beat_detection_profile_mark(handle, BEAT_DETECTION_STAGE_MAGNITUDE);
+    }
+    return beat_detection_decision(handle, event);
+}
+
+/**
+ * Analyze one frame on every detector of the handle. In dual mode the peer detects the right channel
+ * independently and fills events[1]; the result is BEAT_DETECTED when either channel triggers.
+ */
+static beat_detection_result_t beat_detection_analyze(beat_detection_handle_t handle, const void *audio_buffer,
+                                                      beat_detection_event_t events[2], int *event_num)
+{
+    beat_detection_result_t result = beat_detection(handle, audio_buffer, &events[0]);
+    *event_num = 1;
+    if (handle->audio.channel_mode == BEAT_DETECTION_CHANNEL_DUAL && result != BEAT_DETECTION_FAILED) {
+        beat_detection_handle_t peer = handle->audio.peer;
+        peer->audio.sample_index = handle->audio.sample_index;
+        memset(peer->profile.frame_cycles, 0, sizeof(peer->profile.frame_cycles));
+        beat_detection_result_t peer_result = beat_detection(peer, audio_buffer, &events[1]);
+        for (int stage = 0; stage < BEAT_DETECTION_STAGE_MAX; stage++) {
+            handle->profile.frame_cycles[stage] += peer->profile.frame_cycles[stage];
+        }
+        if (peer_result == BEAT_DETECTION_FAILED) {
+            return BEAT_DETECTION_FAILED;
+        }
+        result = (peer_result == BEAT_DETECTED) ? BEAT_DETECTED : result;
+        // The frame only counts as gated when neither channel needed the transform
+        handle->gate.skipped = handle->gate.skipped && peer->gate.skipped;
+        *event_num = 2;
+    }
+    return result;
+}
+
+/**
+ * Push the beat events of one frame into the event ring. The task is the only writer of head and the
+ * consumer the only writer of tail; the release store of head publishes the event contents with it.
+ * Returns the number of events that did not fit.
+ */
+static uint32_t beat_detection_event_push(beat_detection_handle_t handle, const beat_detection_event_t *events, int event_num)
+{
+    uint32_t dropped = 0;
+    uint32_t head = handle->events.head;
+    uint32_t tail = __atomic_load_n(&handle->events.tail, __ATOMIC_ACQUIRE);
+    for (int e = 0; e < event_num; e++) {
+        if (events[e].result != BEAT_DETECTED) {
+            continue;
+        }
+        if (head - tail > handle->events.mask) {
+            dropped++;
+            continue;
+        }
+        handle->events.buffer[head & handle->events.mask] = events[e];
+        head++;
+        if (handle->events.notify_task != NULL && handle->events.unnotified++ == 0) {
+            handle->events.unnotified_since = xTaskGetTickCount();
+        }
+    }
+    __atomic_store_n(&handle->events.head, head, __ATOMIC_RELEASE);
+
+    // Checked every frame, so the timeout resolution is one hop
+    if (handle->events.notify_task != NULL && handle->events.unnotified > 0
+        && (handle->events.unnotified >= handle->events.notify_count
+            || (handle->events.notify_timeout > 0 && xTaskGetTickCount() - handle->events.unnotified_since >= handle->events.notify_timeout))) {
+        handle->events.unnotified = 0;
+        xTaskNotifyGive(handle->events.notify_task);
+    }
+    return dropped;
+}
+
+static esp_err_t beat_detection_stream_write(beat_detection_handle_t handle, const uint8_t *data, size_t bytes_size)
+{
+    size_t sample_bytes = handle->audio.channel * handle->audio.sample_bytes;
+    if (bytes_size % sample_bytes != 0) {
+        ESP_LOGE(TAG, "Audio buffer size is not a multiple of the sample frame size");
+        beat_detection_stats_drop(handle, BEAT_DETECTION_DROP_INVALID, 0);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    TickType_t wait = handle->status.write_blocking ? handle->ring.write_timeout : 0;
+    while (bytes_size > 0) {
+        if (!handle->ring.frame_held) {
+            if (xSemaphoreTake(handle->ring.free_frames, wait) != pdTRUE) {
+                // Dropped audio still advances the stream position
+                handle->ring.write_sample += bytes_size / sample_bytes;
+                beat_detection_stats_drop(handle, BEAT_DETECTION_DROP_RING_FULL, bytes_size / sample_bytes);
+                return ESP_ERR_TIMEOUT;
+            }
+            handle->ring.frame_held = true;
+            handle->ring.fill_bytes = 0;
+        }
+
+        uint8_t *frame = handle->ring.buffer + handle->ring.write_index * handle->ring.frame_bytes;
+        size_t copy_bytes = handle->ring.frame_bytes - handle->ring.fill_bytes;
+        if (copy_bytes > bytes_size) {
+            copy_bytes = bytes_size;
+        }
+        memcpy(frame + handle->ring.fill_bytes, data, copy_bytes);
+        handle->ring.fill_bytes += copy_bytes;
+        handle->ring.write_sample += copy_bytes / sample_bytes;
+        data += copy_bytes;
+        bytes_size -= copy_bytes;
+
+        // Only whole hops are handed to the task, each one yields exactly one analysis frame
+        if (handle->ring.fill_bytes == handle->ring.frame_bytes) {
+            beat_detection_queue_item_t item = {
+                .data = frame,
+                .bytes_size = handle->ring.frame_bytes,
+                .sample_index = handle->ring.write_sample,
+            };
+            xQueueSend(handle->task.audio_queue, &item, 0);
+            beat_detection_stats_queued(handle, 1);
+            handle->ring.write_index = (handle->ring.write_index + 1) % handle->ring.frame_num;
+            handle->ring.frame_held = false;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t beat_detection_data_write(beat_detection_handle_t handle, beat_detection_audio_buffer_t buffer)
+{
+    if (handle == NULL || buffer.audio_buffer == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->status.synchronous) {
+        ESP_LOGE(TAG, "Detector has no task, use beat_detection_process()");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (handle->ring.frame_acquired) {
+        ESP_LOGE(TAG, "A ring frame is acquired and not committed");
+        beat_detection_stats_drop(handle, BEAT_DETECTION_DROP_INVALID, 0);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (handle->audio.hop_size > 0) {
+        return beat_detection_stream_write(handle, buffer.audio_buffer, buffer.bytes_size);
+    }
+
+    if (buffer.bytes_size < handle->ring.frame_bytes) {
+        ESP_LOGE(TAG, "Audio buffer size is less than FFT size");
+        beat_detection_stats_drop(handle, BEAT_DETECTION_DROP_INVALID, 0);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The whole buffer counts towards the stream position, although only its first fft_size samples are analyzed
+    uint64_t frame_start = handle->ring.write_sample;
+    handle->ring.write_sample += buffer.bytes_size / (handle->audio.channel * handle->audio.sample_bytes);
+
+    TickType_t wait = handle->status.write_blocking ? handle->ring.write_timeout : 0;
+    if (xSemaphoreTake(handle->ring.free_frames, wait) != pdTRUE) {
+        beat_detection_stats_drop(handle, BEAT_DETECTION_DROP_RING_FULL, buffer.bytes_size / (handle->audio.channel * handle->audio.sample_bytes));
+        return ESP_ERR_TIMEOUT;
+    }
+
+    uint8_t *frame = handle->ring.buffer + handle->ring.write_index * handle->ring.frame_bytes;
+    memcpy(frame, buffer.audio_buffer, handle->ring.frame_bytes);
+    handle->ring.write_index = (handle->ring.write_index + 1) % handle->ring.frame_num;
+
+    beat_detection_queue_item_t item = {
+        .data = frame,
+        .bytes_size = handle->ring.frame_bytes,
+        .sample_index = frame_start + handle->audio.frame_step,
+    };
+    // The queue has a slot for every ring frame and every lent buffer, so this never fails
+    xQueueSend(handle->task.audio_queue, &item, 0);
+    beat_detection_stats_queued(handle, 1);
+    return ESP_OK;
+}
+
+esp_err_t beat_detection_frame_acquire(beat_detection_handle_t handle, uint8_t **frame, size_t *bytes_size)
+{
+    if (handle == NULL || frame == NULL || bytes_size == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->status.synchronous) {
+        ESP_LOGE(TAG, "Detector has no task, use beat_detection_process()");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (handle->ring.frame_acquired || handle->ring.frame_held) {
+        ESP_LOGE(TAG, "Previous frame is not committed or a written hop is incomplete");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    TickType_t wait = handle->status.write_blocking ? handle->ring.write_timeout : 0;
+    if (xSemaphoreTake(handle->ring.free_frames, wait) != pdTRUE) {
+        // The producer drops the frame it could not place, keep the clock in step with it
+        handle->ring.write_sample += handle->ring.frame_bytes / (handle->audio.channel * handle->audio.sample_bytes);
+        beat_detection_stats_drop(handle, BEAT_DETECTION_DROP_RING_FULL, handle->ring.frame_bytes / (handle->audio.channel * handle->audio.sample_bytes));
+        return ESP_ERR_TIMEOUT;
+    }
+    handle->ring.frame_acquired = true;
+    *frame = handle->ring.buffer + handle->ring.write_index * handle->ring.frame_bytes;
+    *bytes_size = handle->ring.frame_bytes;
+    return ESP_OK;
+}
+
+esp_err_t beat_detection_frame_commit(beat_detection_handle_t handle, uint8_t *frame)
+{
+    if (handle == NULL || frame == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!handle->ring.frame_acquired || frame != handle->ring.buffer + handle->ring.write_index * handle->ring.frame_bytes) {
+        ESP_LOGE(TAG, "Frame was not acquired from this handle");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint64_t frame_start = handle->ring.write_sample;
+    handle->ring.write_sample += handle->ring.frame_bytes / (handle->audio.channel * handle->audio.sample_bytes);
+    beat_detection_queue_item_t item = {
+        .data = frame,
+        .bytes_size = handle->ring.frame_bytes,
+        .sample_index = frame_start + handle->audio.frame_step,
+    };
+    handle->ring.write_index = (handle->ring.write_index + 1) % handle->ring.frame_num;
+    handle->ring.frame_acquired = false;
+    xQueueSend(handle->task.audio_queue, &item, 0);
+    beat_detection_stats_queued(handle, 1);
+    return ESP_OK;
+}
+
+esp_err_t beat_detection_data_lend(beat_detection_handle_t handle, beat_detection_audio_buffer_t buffer,
+                                   beat_detection_release_callback_t release_cb, void *release_ctx)
+{
+    if (handle == NULL || buffer.audio_buffer == NULL || release_cb == NULL || ((uintptr_t)buffer.audio_buffer % handle->audio.sample_bytes) != 0) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->status.synchronous) {
+        ESP_LOGE(TAG, "Detector has no task, use beat_detection_process()");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (handle->ring.frame_acquired || handle->ring.frame_held) {
+        ESP_LOGE(TAG, "Previous frame is not committed or a written hop is incomplete");
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Streaming needs whole hops, frame mode at least one frame of which the first fft_size samples are analyzed
+    if ((handle->audio.hop_size > 0) ? (buffer.bytes_size == 0 || buffer.bytes_size % handle->ring.frame_bytes != 0)
+                                     : (buffer.bytes_size < handle->ring.frame_bytes)) {
+        ESP_LOGE(TAG, "Lent buffer must hold a whole number of hops, or at least one FFT frame");
+        beat_detection_stats_drop(handle, BEAT_DETECTION_DROP_INVALID, 0);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint64_t frame_start = handle->ring.write_sample;
+    handle->ring.write_sample += buffer.bytes_size / (handle->audio.channel * handle->audio.sample_bytes);
+
+    TickType_t wait = handle->status.write_blocking ? handle->ring.write_timeout : 0;
+    if (xSemaphoreTake(handle->ring.free_lends, wait) != pdTRUE) {
+        beat_detection_stats_drop(handle, BEAT_DETECTION_DROP_LEND_FULL, buffer.bytes_size / (handle->audio.channel * handle->audio.sample_bytes));
+        return ESP_ERR_TIMEOUT;
+    }
+    beat_detection_queue_item_t item = {
+        .data = buffer.audio_buffer,
+        .bytes_size = buffer.bytes_size,
+        .sample_index = frame_start + handle->audio.frame_step,
+        .release_cb = release_cb,
+        .release_ctx = release_ctx,
+    };
+    xQueueSend(handle->task.audio_queue, &item, 0);
+    beat_detection_stats_queued(handle, (handle->audio.hop_size > 0) ? buffer.bytes_size / handle->ring.frame_bytes : 1);
+    return ESP_OK;
+}
+
+esp_err_t beat_detection_get_overrun_count(beat_detection_handle_t handle, uint32_t *count)
+{
+    if (handle == NULL || count == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&handle->profile.lock);
+    *count = handle->profile.total.dropped[BEAT_DETECTION_DROP_RING_FULL] + handle->profile.total.dropped[BEAT_DETECTION_DROP_LEND_FULL];
+    taskEXIT_CRITICAL(&handle->profile.lock);
+    return ESP_OK;
+}
+
+static void beat_detection_stats_fill(const beat_detection_counters_t *counters, beat_detection_stats_t *stats)
+{
+    memset(stats, 0, sizeof(beat_detection_stats_t));
+    stats->frames_in = counters->frames_in;
+    stats->frames_processed = counters->frames_processed;
+    stats->frames_failed = counters->frames_failed;
+    stats->frames_gated = counters->frames_gated;
+    memcpy(stats->dropped, counters->dropped, sizeof(stats->dropped));
+    stats->dropped_samples = counters->dropped_samples;
+    stats->queue_high_water = counters->queue_high_water;
+    stats->events_dropped = counters->events_dropped;
+    for (int stage = 0; stage < BEAT_DETECTION_STAGE_MAX && counters->frames_processed > 0; stage++) {
+        stats->cycles[stage].min = counters->cycles_min[stage];
+        stats->cycles[stage].max = counters->cycles_max[stage];
+        stats->cycles[stage].avg = (uint32_t)(counters->cycles_total[stage] / counters->frames_processed);
+    }
+}
+
+esp_err_t beat_detection_get_stats(beat_detection_handle_t handle, beat_detection_stats_t *total, beat_detection_stats_t *window)
+{
+    if (handle == NULL || (total == NULL && window == NULL)) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    beat_detection_counters_t total_counters;
+    beat_detection_counters_t window_counters;
+    taskENTER_CRITICAL(&handle->profile.lock);
+    total_counters = handle->profile.total;
+    window_counters = handle->profile.window;
+    if (window != NULL) {
+        beat_detection_counters_reset(&handle->profile.window);
+    }
+    taskEXIT_CRITICAL(&handle->profile.lock);
+
+    uint32_t stack_high_water = (handle->task.task_handle != NULL) ? (uint32_t)uxTaskGetStackHighWaterMark(handle->task.task_handle) : 0;
+    if (total != NULL) {
+        beat_detection_stats_fill(&total_counters, total);
+        total->stack_high_water = stack_high_water;
+    }
+    if (window != NULL) {
+        beat_detection_stats_fill(&window_counters, window);
+        window->stack_high_water = stack_high_water;
+    }
+    return ESP_OK;
+}
+
+esp_err_t beat_detection_event_drain(beat_detection_handle_t handle, beat_detection_event_t *events, size_t max_events, size_t *count)
+{
+    if (handle == NULL || events == NULL || count == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->events.buffer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t tail = handle->events.tail;
+    uint32_t head = __atomic_load_n(&handle->events.head, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    while (n < max_events && tail != head) {
+        events[n++] = handle->events.buffer[tail & handle->events.mask];
+        tail++;
+    }
+    __atomic_store_n(&handle->events.tail, tail, __ATOMIC_RELEASE);
+    *count = n;
+    return ESP_OK;
+}
+
+esp_err_t beat_detection_event_poll(beat_detection_handle_t handle, beat_detection_event_t *event)
+{
+    size_t count = 0;
+    esp_err_t ret = beat_detection_event_drain(handle, event, 1, &count);
+    if (ret == ESP_OK && count == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ret;
+}
+
+esp_err_t beat_detection_get_features(beat_detection_handle_t handle, beat_detection_features_t *features)
+{
+    if (handle == NULL || features == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->features.slots == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Seqlock read of the latest slot, which the detector only rewrites two frames later
+    for (;;) {
+        uint32_t sequence = __atomic_load_n(&handle->features.published, __ATOMIC_ACQUIRE);
+        if (sequence == 0) {
+            return ESP_ERR_NOT_FOUND;
+        }
+        const beat_detection_feature_slot_t *slot = &handle->features.slots[sequence % BEAT_DETECTION_FEATURE_SLOTS];
+        *features = slot->frame;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence) {
+            return ESP_OK;
+        }
+    }
+}
+
+esp_err_t beat_detection_trace_read(beat_detection_handle_t handle, beat_detection_trace_record_t *records, size_t max_records, size_t *count)
+{
+    if (handle == NULL || records == NULL || count == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->trace.records == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t tail = handle->trace.tail;
+    uint32_t head = __atomic_load_n(&handle->trace.head, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    while (n < max_records && tail != head) {
+        records[n++] = handle->trace.records[tail & handle->trace.mask];
+        tail++;
+    }
+    __atomic_store_n(&handle->trace.tail, tail, __ATOMIC_RELEASE);
+    *count = n;
+    return ESP_OK;
+}
+
+esp_err_t beat_detection_trace_dump(beat_detection_handle_t handle, beat_detection_trace_write_t write, void *ctx, size_t *count)
+{
+    if (handle == NULL || write == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->trace.records == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t tail = handle->trace.tail;
+    uint32_t head = __atomic_load_n(&handle->trace.head, __ATOMIC_ACQUIRE);
+    if (count != NULL) {
+        *count = head - tail;
+    }
+    if (head == tail) {
+        return ESP_OK;
+    }
+    beat_detection_trace_header_t header = *handle->trace.header;
+    header.record_count = head - tail;
+    header.dropped = __atomic_load_n(&handle->trace.dropped, __ATOMIC_RELAXED);
+    esp_err_t ret = write(&header, sizeof(header), ctx);
+    // The pending records form at most two runs of the ring, each written without a copy
+    while (ret == ESP_OK && tail != head) {
+        uint32_t index = tail & handle->trace.mask;
+        uint32_t run = handle->trace.mask + 1 - index;
+        run = (run < head - tail) ? run : head - tail;
+        ret = write(&handle->trace.records[index], run * sizeof(beat_detection_trace_record_t), ctx);
+        tail += run;
+        __atomic_store_n(&handle->trace.tail, tail, __ATOMIC_RELEASE);
+    }
+    return ret;
+}
+
+esp_err_t beat_detection_get_verify_result(beat_detection_handle_t handle, beat_detection_verify_result_t *result)
+{
+    if (handle == NULL || result == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!handle->status.verify_engine) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    *result = handle->verify.result;
+    return ESP_OK;
+}
+
+esp_err_t beat_detection_get_tempo(beat_detection_handle_t handle, beat_detection_tempo_t *tempo)
+{
+    if (handle == NULL || tempo == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!handle->status.tempo_tracking) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    taskENTER_CRITICAL(&handle->tempo.lock);
+    *tempo = handle->tempo.state;
+    taskEXIT_CRITICAL(&handle->tempo.lock);
+    return ESP_OK;
+}
+
+/**
+ * Append one hop to the streaming history and return the analysis frame ending with it
+ */
+static const void *beat_detection_stream_push(beat_detection_handle_t handle, const void *hop)
+{
+    size_t sample_bytes = BEAT_DETECTION_CHANNEL(handle) * handle->audio.sample_bytes;
+    size_t history_bytes = sample_bytes * BEAT_DETECTION_FFT_SIZE(handle);
+    size_t hop_bytes = sample_bytes * handle->audio.hop_size;
+    memmove(handle->audio.history, handle->audio.history + hop_bytes, history_bytes - hop_bytes);
+    memcpy(handle->audio.history + history_bytes - hop_bytes, hop, hop_bytes);
+    return handle->audio.history;
+}
+
+/**
+ * Decimating FIR fused with the channel selection and PCM to float conversion, so the PCM is read
+ * once. Every input sample enters the delay line, and the low-pass is only evaluated at the kept
+ * output instants, which is the polyphase cost of taps_len / factor multiply-adds per input sample.
+ * The delay line carries over between calls; `count` outputs take count * factor input samples.
+ */
+static void beat_detection_decimate(beat_detection_handle_t handle, const void *restrict input, float *restrict out, size_t count)
+{
+    const int stride = BEAT_DETECTION_CHANNEL(handle);
+    const int offset = handle->audio.channel_offset;
+    const bool mix = handle->audio.channel_mix;
+    const bool wide = handle->audio.sample_bytes == sizeof(int32_t);
+    const int shift = handle->audio.sample_shift;
+    const float scale = (mix ? 0.5f : 1.0f) / (wide ? 2147483648.0f : 32768.0f);
+    const int factor = handle->decimator.factor;
+    const int taps_len = handle->decimator.taps_len;
+    const float *restrict taps = handle->decimator.taps;
+    float *restrict delay = handle->decimator.delay;
+    int pos = handle->decimator.pos;
+    size_t index = 0;
+    for (size_t n = 0; n < count; n++) {
+        for (int m = 0; m < factor; m++, index += stride) {
+            // Mid adds the other channel; mono input has none, so it is only read when mixing
+            float x = (float)beat_detection_pcm_read(input, index + offset, wide, shift);
+            if (mix) {
+                x += (float)beat_detection_pcm_read(input, index + 1, wide, shift);
+            }
+            x *= scale;
+            delay[pos] = x;
+            delay[pos + taps_len] = x;
+            pos = (pos + 1 == taps_len) ? 0 : pos + 1;
+        }
+        // delay[pos .. pos + taps_len - 1] runs from the oldest to the newest sample; the taps are symmetric
+        const float *restrict window = delay + pos;
+        float acc = 0.0f;
+        for (int k = 0; k < taps_len; k++) {
+            acc += taps[k] * window[k];
+        }
+        out[n] = acc;
+    }
+    handle->decimator.pos = pos;
+}
+
+/**
+ * Take one hop in streaming mode, otherwise one frame, and return the analysis frame it completes.
+ * A decimating detector keeps the frame as float in decimator.history, read by the convert stage,
+ * and returns NULL.
+ */
+static const void *beat_detection_frame_push(beat_detection_handle_t handle, const void *input)
+{
+    if (handle->decimator.factor > 1) {
+        size_t fft_size = BEAT_DETECTION_FFT_SIZE(handle);
+        size_t hop = (handle->audio.hop_size > 0) ? (size_t)handle->audio.hop_size : fft_size;
+        float *history = handle->decimator.history;
+        memmove(history, history + hop, (fft_size - hop) * sizeof(float));
+        beat_detection_decimate(handle, input, history + fft_size - hop, hop);
+        return NULL;
+    }
+    if (handle->audio.hop_size > 0) {
+        return beat_detection_stream_push(handle, input);
+    }
+    return input;
+}
+
+/**
+ * Hand a queued item back: lent buffers to their owner, ring frames to the writer
+ */
+static void beat_detection_item_release(beat_detection_handle_t handle, const beat_detection_queue_item_t *item)
+{
+    if (item->release_cb != NULL) {
+        item->release_cb(item->data, item->release_ctx);
+        xSemaphoreGive(handle->ring.free_lends);
+    } else {
+        xSemaphoreGive(handle->ring.free_frames);
+    }
+}
+
+/**
+ * First pipeline stage, on the detection task: convert and transform one frame into the next free
+ * spectrum slot and publish it to the decision task. The two slots form a single-producer
+ * single-consumer ring like the event ring; a task notification only wakes the side that waits.
+ */
+static void beat_detection_pipeline_transform(beat_detection_handle_t handle, const void *audio_buffer, uint64_t sample_index)
+{
+    uint32_t produced = handle->pipeline.produced;
+    while (produced - __atomic_load_n(&handle->pipeline.consumed, __ATOMIC_ACQUIRE) >= 2) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    int slot = produced & 1;
+    void *spectrum = handle->pipeline.spectrum[slot];
+    beat_detection_pipeline_mark(handle, NULL);
+    beat_detection_stage_convert(handle, audio_buffer, spectrum);
+    beat_detection_pipeline_mark(handle, &handle->pipeline.cycles[slot][0]);
+    handle->pipeline.gated[slot] = beat_detection_gate_closed(handle, handle->gate.power);
+    if (!handle->pipeline.gated[slot]) {
+        beat_detection_stage_fft(handle, audio_buffer, spectrum);
+    }
+    beat_detection_pipeline_mark(handle, &handle->pipeline.cycles[slot][1]);
+    handle->pipeline.sample_index[slot] = sample_index;
+    __atomic_store_n(&handle->pipeline.produced, produced + 1, __ATOMIC_RELEASE);
+    xTaskNotifyGive(handle->pipeline.decision_task);
+}
+
+/**
+ * Callbacks, event ring and statistics of one analyzed frame, shared by the task and beat_detection_process()
+ */
+static void beat_detection_deliver(beat_detection_handle_t handle, beat_detection_result_t result,
+                                   const beat_detection_event_t *events, int event_num)
+{
+    if (handle->audio.result_callback != NULL) {
+        handle->audio.result_callback(result, handle->audio.result_callback_ctx);
+    }
+    for (int e = 0; handle->audio.event_callback != NULL && result != BEAT_DETECTION_FAILED && e < event_num; e++) {
+        handle->audio.event_callback(&events[e], handle->audio.result_callback_ctx);
+    }
+    if (handle->tempo.fire) {
+        handle->tempo.fire = false;
+        if (handle->tempo.callback != NULL) {
+            handle->tempo.callback(&handle->tempo.fired, handle->audio.result_callback_ctx);
+        }
+    }
+    uint32_t events_dropped = 0;
+    if (handle->events.buffer != NULL && result != BEAT_DETECTION_FAILED) {
+        events_dropped = beat_detection_event_push(handle, events, event_num);
+    }
+    beat_detection_profile_mark(handle, BEAT_DETECTION_STAGE_CALLBACK);
+    beat_detection_stats_frame(handle, result == BEAT_DETECTION_FAILED, events_dropped);
+}
+
+/**
+ * Second pipeline stage: magnitude, decision and delivery of the published frames in order. The
+ * slot is freed as soon as its magnitude is taken, so the next transform overlaps the decision.
+ */
+static void beat_detection_decision_task(void *arg)
+{
+    beat_detection_handle_t handle = (beat_detection_handle_t)arg;
+    uint32_t consumed = handle->pipeline.consumed;
+    while (true) {
+        while (__atomic_load_n(&handle->pipeline.produced, __ATOMIC_ACQUIRE) == consumed) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        int slot = consumed & 1;
+        handle->audio.sample_index = handle->pipeline.sample_index[slot];
+        memset(handle->profile.frame_cycles, 0, sizeof(handle->profile.frame_cycles));
+        handle->profile.frame_cycles[BEAT_DETECTION_STAGE_CONVERT] = handle->pipeline.cycles[slot][0];
+        handle->profile.frame_cycles[BEAT_DETECTION_STAGE_FFT] = handle->pipeline.cycles[slot][1];
+        beat_detection_profile_start(handle);
+        handle->gate.skipped = handle->pipeline.gated[slot];
+        if (handle->gate.skipped) {
+            beat_detection_gate_magnitude(handle);
+        } else {
+            beat_detection_stage_magnitude(handle, handle->pipeline.spectrum[slot]);
+        }
+        beat_detection_profile_mark(handle, BEAT_DETECTION_STAGE_MAGNITUDE);
+        __atomic_store_n(&handle->pipeline.consumed, ++consumed, __ATOMIC_RELEASE);
+        xTaskNotifyGive(handle->pipeline.transform_task);
+
+        beat_detection_event_t event = { 0 };
+        beat_detection_result_t result = beat_detection_decision(handle, &event);
+        beat_detection_profile_start(handle);
+        beat_detection_deliver(handle, result, &event, 1);
+    }
+    vTaskDelete(NULL);
+}
+
+static void beat_detection_task(void *arg)
+{
+    beat_detection_handle_t handle = (beat_detection_handle_t)arg;
+    // Published to the decision task by the first produced slot
+    handle->pipeline.transform_task = xTaskGetCurrentTaskHandle();
+    while (true) {
+        beat_detection_queue_item_t item;
+        xQueueReceive(handle->task.audio_queue, &item, portMAX_DELAY);
+        // A lent buffer may hold several hops, a ring slot holds exactly one
+        size_t step = (handle->audio.hop_size > 0) ? handle->ring.frame_bytes : item.bytes_size;
+        for (size_t offset = 0; offset < item.bytes_size; offset += step) {
+            const void *frame = beat_detection_frame_push(handle, item.data + offset);
+            if (handle->status.pipeline) {
+                beat_detection_pipeline_transform(handle, frame, item.sample_index);
+                item.sample_index += handle->audio.frame_step;
+                // The decision stage only reads the spectrum, so the audio goes back right after the transform
+                if (offset + step >= item.bytes_size) {
+                    beat_detection_item_release(handle, &item);
+                }
+                continue;
+            }
+            handle->audio.sample_index = item.sample_index;
+            item.sample_index += handle->audio.frame_step;
+            memset(handle->profile.frame_cycles, 0, sizeof(handle->profile.frame_cycles));
+            beat_detection_event_t events[2] = { 0 };
+            int event_num = 0;
+            beat_detection_result_t result = beat_detection_analyze(handle, frame, events, &event_num);
+            beat_detection_profile_start(handle);
+            if (offset + step >= item.bytes_size) {
+                // Hand the audio back before the callbacks so the producer can reuse it right away
+                beat_detection_item_release(handle, &item);
+            }
+            beat_detection_deliver(handle, result, events, event_num);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t beat_detection_process(beat_detection_handle_t handle, beat_detection_audio_buffer_t buffer, beat_detection_event_t *event)
+{
+    if (handle == NULL || buffer.audio_buffer == NULL || ((uintptr_t)buffer.audio_buffer % handle->audio.sample_bytes) != 0) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!handle->status.synchronous) {
+        ESP_LOGE(TAG, "Detector runs its own task, use beat_detection_data_write()");
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Same framing as a lent buffer: whole hops when streaming, otherwise the first fft_size samples
+    if ((handle->audio.hop_size > 0) ? (buffer.bytes_size == 0 || buffer.bytes_size % handle->ring.frame_bytes != 0)
+                                     : (buffer.bytes_size < handle->ring.frame_bytes)) {
+        ESP_LOGE(TAG, "Audio buffer must hold a whole number of hops, or at least one FFT frame");
+        beat_detection_stats_drop(handle, BEAT_DETECTION_DROP_INVALID, 0);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint64_t frame_start = handle->ring.write_sample;
+    handle->ring.write_sample += buffer.bytes_size / (handle->audio.channel * handle->audio.sample_bytes);
+    size_t step = (handle->audio.hop_size > 0) ? handle->ring.frame_bytes : buffer.bytes_size;
+    beat_detection_stats_queued(handle, (uint32_t)(buffer.bytes_size / step));
+
+    beat_detection_event_t reported = { .result = BEAT_NOT_DETECTED };
+    bool failed = false;
+    for (size_t offset = 0; offset < buffer.bytes_size; offset += step) {
+        frame_start += handle->audio.frame_step;
+        handle->audio.sample_index = frame_start;
+        memset(handle->profile.frame_cycles, 0, sizeof(handle->profile.frame_cycles));
+        beat_detection_event_t events[2] = { 0 };
+        int event_num = 0;
+        const void *frame = beat_detection_frame_push(handle, buffer.audio_buffer + offset);
+        beat_detection_result_t result = beat_detection_analyze(handle, frame, events, &event_num);
+        beat_detection_profile_start(handle);
+        beat_detection_deliver(handle, result, events, event_num);
+
+        // The first beat of the buffer is reported, or the last frame when there is none
+        failed |= (result == BEAT_DETECTION_FAILED);
+        for (int e = 0; e < event_num && reported.result != BEAT_DETECTED; e++) {
+            reported = events[e];
+        }
+    }
+
+    if (event != NULL) {
+        *event = reported;
+    }
+    return failed ? ESP_FAIL : ESP_OK;
+}
+
+/**
+ * Allocate the handle and the analysis state shared by the task-driven and batch paths.
+ * No task, queue or ring buffer is created here.
+ */
+static esp_err_t beat_detection_create(const beat_detection_cfg_t *cfg, beat_detection_arena_t *arena, beat_detection_handle_t *handle)
+{
+    *handle = NULL;
+    uint32_t local_flags = (cfg->flags.enable_psram) ? MALLOC_CAP_SPIRAM: MALLOC_CAP_INTERNAL;
+
+    int fft_size = cfg->audio_cfg.fft_size;
+    if (fft_size < 8 || (fft_size & (fft_size - 1)) != 0) {
+        ESP_LOGE(TAG, "FFT size must be a power of two, at least 8");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cfg->audio_cfg.sample_rate == 0 || (unsigned)cfg->audio_cfg.format > BEAT_DETECTION_FORMAT_S32) {
+        ESP_LOGE(TAG, "Invalid sample rate or sample format");
+        return ESP_ERR_INVALID_ARG;
+    }
+#if CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+    if (fft_size != CONFIG_BEAT_DETECTION_FIXED_FFT_SIZE || cfg->audio_cfg.channel != CONFIG_BEAT_DETECTION_FIXED_CHANNEL) {
+        ESP_LOGE(TAG, "This build is fixed to FFT size %d and %d channel(s)", CONFIG_BEAT_DETECTION_FIXED_FFT_SIZE, CONFIG_BEAT_DETECTION_FIXED_CHANNEL);
+        return ESP_ERR_INVALID_ARG;
+    }
+#endif
+    // The float FFT tables are only needed by the float FFT engines and by the verification path
+    bool float_fft = (cfg->audio_cfg.engine == BEAT_DETECTION_ENGINE_COMPLEX_FFT || cfg->audio_cfg.engine == BEAT_DETECTION_ENGINE_REAL_FFT);
+
+    *handle = beat_detection_instance_alloc(arena, cfg->flags.enable_psram, local_flags);
+    if (*handle == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for Beat detection handle");
+        return ESP_ERR_NO_MEM;
+    }
+
+    (*handle)->audio.fft_size = cfg->audio_cfg.fft_size;
+    (*handle)->audio.hop_size = cfg->audio_cfg.hop_size;
+    (*handle)->audio.engine = cfg->audio_cfg.engine;
+    (*handle)->audio.sample_rate = cfg->audio_cfg.sample_rate;
+    (*handle)->audio.channel = cfg->audio_cfg.channel;
+    (*handle)->audio.format = cfg->audio_cfg.format;
+    (*handle)->audio.sample_bytes = beat_detection_sample_bytes(cfg);
+    (*handle)->audio.sample_shift = (cfg->audio_cfg.format == BEAT_DETECTION_FORMAT_S24_32) ? 8 : 0;
+    if ((unsigned)cfg->audio_cfg.channel_mode > BEAT_DETECTION_CHANNEL_DUAL) {
+        ESP_LOGE(TAG, "Invalid channel mode");
+        beat_detection_deinit(handle);
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Mono input has nothing to select; the two-detector modes analyze the left channel here, the right one in the peer
+    (*handle)->audio.channel_mode = (cfg->audio_cfg.channel == 2) ? cfg->audio_cfg.channel_mode : BEAT_DETECTION_CHANNEL_RIGHT;
+    (*handle)->audio.channel_offset = ((*handle)->audio.channel_mode == BEAT_DETECTION_CHANNEL_RIGHT) ? cfg->audio_cfg.channel - 1 : 0;
+    // Events report the detector, not the interleaved channel it reads; the dual peer sets its own
+    (*handle)->audio.detector = 0;
+    (*handle)->audio.channel_mix = ((*handle)->audio.channel_mode == BEAT_DETECTION_CHANNEL_MID);
+    // The decimator hands the analysis a float frame, which only the float FFT engines take
+    uint8_t decimation = beat_detection_decimation(cfg);
+    if (decimation > BEAT_DETECTION_MAX_DECIMATION
+        || (decimation > 1 && (!float_fft || (*handle)->audio.channel_mode == BEAT_DETECTION_CHANNEL_MAX
+                               || (*handle)->audio.channel_mode == BEAT_DETECTION_CHANNEL_DUAL))) {
+        ESP_LOGE(TAG, "Decimation must be at most %d and needs a float FFT engine and a single channel detector", BEAT_DETECTION_MAX_DECIMATION);
+        beat_detection_deinit(handle);
+        return ESP_ERR_INVALID_ARG;
+    }
+    (*handle)->decimator.factor = decimation;
+    (*handle)->audio.frame_step = beat_detection_frame_step(cfg);
+    (*handle)->audio.result_callback = cfg->result_callback;
+    (*handle)->audio.result_callback_ctx = cfg->result_callback_ctx;
+    (*handle)->audio.event_callback = cfg->event_callback;
+    (*handle)->status.enable_psram = cfg->flags.enable_psram;
+    (*handle)->status.write_blocking = cfg->flags.write_blocking;
+    (*handle)->status.verify_engine = cfg->flags.verify_engine;
+    portMUX_INITIALIZE(&(*handle)->profile.lock);
+    beat_detection_counters_reset(&(*handle)->profile.total);
+    beat_detection_counters_reset(&(*handle)->profile.window);
+
+    // Without a band array the single bass band of audio_cfg is band 0
+    beat_detection_band_cfg_t bass_band;
+    const beat_detection_band_cfg_t *band_cfg = beat_detection_band_cfg(cfg, &bass_band, &(*handle)->audio.band_num);
+    if (band_cfg == NULL) {
+        beat_detection_deinit(handle);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Only the bins between the lowest and the highest band edge are computed, at the decimated rate
+    uint32_t analysis_rate = (*handle)->audio.sample_rate / decimation;
+    uint16_t bin_low = fft_size / 2;
+    uint16_t bin_high = 0;
+    for (int b = 0; b < (*handle)->audio.band_num; b++) {
+        beat_detection_band_t *band = &(*handle)->audio.bands[b];
+        band->bin_start = beat_detection_hz_to_bin(band_cfg[b].freq_start, analysis_rate, fft_size);
+        band->bin_end = beat_detection_hz_to_bin(band_cfg[b].freq_end, analysis_rate, fft_size);
+        if (band->bin_end < band->bin_start) {
+            ESP_LOGE(TAG, "Band %d ends below its start", b);
+            beat_detection_deinit(handle);
+            return ESP_ERR_INVALID_ARG;
+        }
+        // Power is compared instead of magnitude by the Q15 engine, so its thresholds are squared
+        beat_detection_band_params(band, &band_cfg[b], (*handle)->audio.sample_rate, (*handle)->audio.engine == BEAT_DETECTION_ENGINE_FFT_Q15);
+        bin_low = (band->bin_start < bin_low) ? band->bin_start : bin_low;
+        bin_high = (band->bin_end > bin_high) ? band->bin_end : bin_high;
+        ESP_LOGI(TAG, "Band %d frequency range: %d-%d Hz, bins: %d-%d", b,
+                 (int)band_cfg[b].freq_start, (int)band_cfg[b].freq_end, band->bin_start, band->bin_end);
+    }
+    // Exported feature bands widen the computed range, in the right channel detector too so MAX can merge
+    if (cfg->feature_cfg.band_num > 0) {
+        uint16_t edges[BEAT_DETECTION_MAX_FEATURE_BANDS + 1];
+        if (beat_detection_feature_edges(cfg, edges) != ESP_OK) {
+            beat_detection_deinit(handle);
+            return ESP_ERR_INVALID_ARG;
+        }
+        bin_low = (edges[0] < bin_low) ? edges[0] : bin_low;
+        bin_high = (edges[cfg->feature_cfg.band_num] - 1 > bin_high) ? edges[cfg->feature_cfg.band_num] - 1 : bin_high;
+    }
+    (*handle)->audio.mag_bin_start = bin_low;
+    (*handle)->audio.mag_bin_count = bin_high - bin_low + 1;
+
+    if ((*handle)->audio.engine == BEAT_DETECTION_ENGINE_GOERTZEL) {
+        // The coefficients and the states of both frame halves
+        size_t goertzel_bytes = 5 * (*handle)->audio.mag_bin_count * sizeof(float);
+#if CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+        // Only bands far past the break-even overflow the FFT storage, those go to the heap
+        if (goertzel_bytes <= sizeof((*handle)->audio.fft_storage)) {
+            (*handle)->audio.goertzel_coeff = (*handle)->audio.fft_storage;
+        } else
+#endif
+        {
+            (*handle)->audio.goertzel_coeff = (float *)beat_detection_malloc(arena, goertzel_bytes, local_flags | MALLOC_CAP_8BIT);
+        }
+        if ((*handle)->audio.goertzel_coeff == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for Goertzel filters");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        (*handle)->audio.goertzel_state = (*handle)->audio.goertzel_coeff + (*handle)->audio.mag_bin_count;
+        if ((*handle)->audio.mag_bin_count > BEAT_DETECTION_GOERTZEL_MAX_BINS) {
+            ESP_LOGW(TAG, "Goertzel engine over %d bins, the real FFT engine is faster past %d", (*handle)->audio.mag_bin_count, BEAT_DETECTION_GOERTZEL_MAX_BINS);
+        }
+        for (int b = 0; b < (*handle)->audio.mag_bin_count; b++) {
+            float omega = 2.0f * (float)M_PI * (float)((*handle)->audio.mag_bin_start + b) / (float)(*handle)->audio.fft_size;
+            (*handle)->audio.goertzel_coeff[b] = 2.0f * cosf(omega);
+        }
+        (*handle)->audio.goertzel_window_rot[0] = cosf(2.0f * (float)M_PI / (float)((*handle)->audio.fft_size - 1));
+        (*handle)->audio.goertzel_window_rot[1] = sinf(2.0f * (float)M_PI / (float)((*handle)->audio.fft_size - 1));
+        (*handle)->audio.goertzel_window_rot[2] = cosf((float)M_PI * (float)(*handle)->audio.fft_size / (float)((*handle)->audio.fft_size - 1));
+        (*handle)->audio.goertzel_window_rot[3] = sinf((float)M_PI * (float)(*handle)->audio.fft_size / (float)((*handle)->audio.fft_size - 1));
+    } else if ((*handle)->audio.engine == BEAT_DETECTION_ENGINE_FFT_Q15) {
+#if CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+        (*handle)->audio.fft_buffer_sc16 = (int16_t *)(*handle)->audio.fft_storage;
+#else
+        (*handle)->audio.fft_buffer_sc16 = (int16_t *)beat_detection_malloc(arena, beat_detection_spectrum_bytes(BEAT_DETECTION_ENGINE_FFT_Q15, (*handle)->audio.fft_size, 0), local_flags | MALLOC_CAP_8BIT);
+#endif
+        (*handle)->audio.window_q15 = (int16_t *)beat_detection_table_get(arena, BEAT_DETECTION_TABLE_HANN_Q15, fft_size, local_flags);
+        (*handle)->audio.twiddle_sc16 = (int16_t *)beat_detection_table_get(arena, BEAT_DETECTION_TABLE_TWIDDLE_SC16, fft_size, local_flags);
+        if ((*handle)->audio.fft_buffer_sc16 == NULL || (*handle)->audio.window_q15 == NULL || (*handle)->audio.twiddle_sc16 == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for fixed-point FFT");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        memset((*handle)->audio.fft_buffer_sc16, 0, beat_detection_spectrum_bytes(BEAT_DETECTION_ENGINE_FFT_Q15, (*handle)->audio.fft_size, 0));
+        float scale = (float)(*handle)->audio.fft_size / 32768.0f;
+        (*handle)->audio.q15_power_scale = scale * scale;
+        // Power is compared instead of magnitude, the band thresholds were squared above
+        (*handle)->status.power_domain = true;
+    } else {
+        // The real-input engine runs an N/2 complex FFT, so it only needs half the buffer
+        size_t fft_buffer_len = ((*handle)->audio.engine == BEAT_DETECTION_ENGINE_REAL_FFT) ? (*handle)->audio.fft_size : 2 * (*handle)->audio.fft_size;
+#if CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+        (*handle)->audio.fft_buffer = (*handle)->audio.fft_storage;
+#else
+        (*handle)->audio.fft_buffer = (float *)beat_detection_malloc(arena, fft_buffer_len * sizeof(float), local_flags | MALLOC_CAP_8BIT);
+#endif
+        if ((*handle)->audio.fft_buffer == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for FFT buffer");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        memset((*handle)->audio.fft_buffer, 0, fft_buffer_len * sizeof(float));
+    }
+
+    if ((*handle)->audio.engine == BEAT_DETECTION_ENGINE_REAL_FFT) {
+        (*handle)->audio.rfft_twiddle = (float *)beat_detection_table_get(arena, BEAT_DETECTION_TABLE_RFFT_SPLIT, fft_size, local_flags);
+        if ((*handle)->audio.rfft_twiddle == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for real FFT twiddle table");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if ((*handle)->status.verify_engine) {
+        (*handle)->verify.fft_buffer = (float *)beat_detection_malloc(arena, 2 * (*handle)->audio.fft_size * sizeof(float), local_flags | MALLOC_CAP_8BIT);
+        (*handle)->verify.magnitude = (float *)beat_detection_malloc(arena, (*handle)->audio.mag_bin_count * sizeof(float), local_flags | MALLOC_CAP_8BIT);
+        if ((*handle)->verify.fft_buffer == NULL || (*handle)->verify.magnitude == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for engine verification");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (float_fft || (*handle)->status.verify_engine) {
+        // An N-point table also serves the N/2-point FFT of the real-input engine
+        (*handle)->audio.fft_twiddle = (float *)beat_detection_table_get(arena, BEAT_DETECTION_TABLE_TWIDDLE_FC32, fft_size, local_flags);
+        (*handle)->audio.window = (float *)beat_detection_table_get(arena, BEAT_DETECTION_TABLE_HANN_F32, fft_size, local_flags);
+        if ((*handle)->audio.fft_twiddle == NULL || (*handle)->audio.window == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for FFT tables");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+#if CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+    (*handle)->audio.magnitude = (*handle)->audio.magnitude_storage[0];
+#else
+    (*handle)->audio.magnitude = (float *)beat_detection_malloc(arena, (*handle)->audio.mag_bin_count * sizeof(float), local_flags | MALLOC_CAP_8BIT);
+#endif
+    if ((*handle)->audio.magnitude == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for magnitude");
+        beat_detection_deinit(handle);
+        return ESP_ERR_NO_MEM;
+    }
+    memset((*handle)->audio.magnitude, 0, (*handle)->audio.mag_bin_count * sizeof(float));
+
+#if CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+    (*handle)->audio.magnitude_prev = (*handle)->audio.magnitude_storage[1];
+#else
+    (*handle)->audio.magnitude_prev = (float *)beat_detection_malloc(arena, (*handle)->audio.mag_bin_count * sizeof(float), local_flags | MALLOC_CAP_8BIT);
+#endif
+    if ((*handle)->audio.magnitude_prev == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for magnitude previous");
+        beat_detection_deinit(handle);
+        return ESP_ERR_NO_MEM;
+    }
+    memset((*handle)->audio.magnitude_prev, 0, (*handle)->audio.mag_bin_count * sizeof(float));
+
+    if ((*handle)->audio.hop_size < 0 || (*handle)->audio.hop_size > (*handle)->audio.fft_size) {
+        ESP_LOGE(TAG, "Hop size must be between 0 and FFT size");
+        beat_detection_deinit(handle);
+        return ESP_ERR_INVALID_ARG;
+    }
+    // A decimating detector keeps its frame history as float in the decimator instead
+    if ((*handle)->audio.hop_size > 0 && decimation == 1) {
+#if CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+        (*handle)->audio.history = (uint8_t *)(*handle)->audio.history_storage;
+#else
+        (*handle)->audio.history = (uint8_t *)beat_detection_malloc(arena, (*handle)->audio.channel * (*handle)->audio.fft_size * (*handle)->audio.sample_bytes, local_flags | MALLOC_CAP_8BIT);
+#endif
+        if ((*handle)->audio.history == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for history buffer");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        memset((*handle)->audio.history, 0, (*handle)->audio.channel * (*handle)->audio.fft_size * (*handle)->audio.sample_bytes);
+    }
+
+    if (decimation > 1) {
+        int taps_len = BEAT_DETECTION_DECIMATOR_TAPS_PER_PHASE * decimation;
+        (*handle)->decimator.taps = (const float *)beat_detection_table_get(arena, BEAT_DETECTION_TABLE_DECIMATOR, taps_len, local_flags);
+        // The delay line is stored twice so the filter reads it without wrapping, the frame history follows it
+        (*handle)->decimator.delay = (float *)beat_detection_calloc(arena, 2 * taps_len + fft_size, sizeof(float), local_flags | MALLOC_CAP_8BIT);
+        if ((*handle)->decimator.taps == NULL || (*handle)->decimator.delay == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for the decimator");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        (*handle)->decimator.history = (*handle)->decimator.delay + 2 * taps_len;
+        (*handle)->decimator.taps_len = (uint16_t)taps_len;
+        (*handle)->decimator.pos = 0;
+        ESP_LOGI(TAG, "Decimation by %d to %d Hz, %d taps", decimation, analysis_rate, taps_len);
+    }
+
+    if ((*handle)->audio.channel_mode == BEAT_DETECTION_CHANNEL_MAX || (*handle)->audio.channel_mode == BEAT_DETECTION_CHANNEL_DUAL) {
+        // The peer shares the FFT tables through the table registry and only owns its buffers and band state
+        beat_detection_cfg_t peer_cfg;
+        beat_detection_peer_cfg(cfg, &peer_cfg);
+        esp_err_t ret = beat_detection_create(&peer_cfg, arena, &(*handle)->audio.peer);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create the right channel detector");
+            beat_detection_deinit(handle);
+            return ret;
+        }
+        (*handle)->audio.peer->audio.detector = ((*handle)->audio.channel_mode == BEAT_DETECTION_CHANNEL_DUAL) ? 1 : 0;
+    }
+
+    if (cfg->flags.tempo_tracking) {
+        uint32_t sample_rate = (*handle)->audio.sample_rate;
+        uint32_t frame_step = beat_detection_frame_step(cfg);
+        float frame_rate = (float)sample_rate / (float)frame_step;
+        int lag_min;
+        int lag_max;
+        if (beat_detection_tempo_lags(cfg, &lag_min, &lag_max) != ESP_OK) {
+            beat_detection_deinit(handle);
+            return ESP_ERR_INVALID_ARG;
+        }
+        int lag_count = lag_max - lag_min + 1;
+        // One allocation holds the onset history, the autocorrelation and the prior
+        (*handle)->tempo.history = (float *)beat_detection_calloc(arena, lag_max + 1 + 2 * lag_count, sizeof(float), local_flags | MALLOC_CAP_8BIT);
+        if ((*handle)->tempo.history == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for tempo tracker");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        (*handle)->tempo.acf = (*handle)->tempo.history + lag_max + 1;
+        (*handle)->tempo.prior = (*handle)->tempo.acf + lag_count;
+        for (int i = 0; i < lag_count; i++) {
+            float octaves = log2f(60.0f * frame_rate / (float)(lag_min + i) / 120.0f);
+            (*handle)->tempo.prior[i] = expf(-0.5f * octaves * octaves);
+        }
+        (*handle)->tempo.lag_min = (uint16_t)lag_min;
+        (*handle)->tempo.lag_max = (uint16_t)lag_max;
+        (*handle)->tempo.frame_step = frame_step;
+        // About 8 s of memory for the autocorrelation, 2 s for the onset mean
+        (*handle)->tempo.decay = expf(-1.0f / (8.0f * frame_rate));
+        (*handle)->tempo.mean_rate = 1.0f / (2.0f * frame_rate);
+        (*handle)->tempo.lead_samples = (uint64_t)cfg->tempo_cfg.lead_ms * sample_rate / 1000;
+        (*handle)->tempo.min_confidence = cfg->tempo_cfg.min_confidence;
+        (*handle)->tempo.callback = cfg->tempo_callback;
+        (*handle)->tempo.fired_number = UINT32_MAX;
+        portMUX_INITIALIZE(&(*handle)->tempo.lock);
+        (*handle)->status.tempo_tracking = true;
+    }
+
+    if (cfg->flags.adaptive_threshold) {
+        uint16_t window;
+        if (beat_detection_adaptive_window(cfg, &window) != ESP_OK) {
+            beat_detection_deinit(handle);
+            return ESP_ERR_INVALID_ARG;
+        }
+        (*handle)->adaptive.history = (float *)beat_detection_calloc(arena, (*handle)->audio.band_num * window, sizeof(float), local_flags | MALLOC_CAP_8BIT);
+        if ((*handle)->adaptive.history == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for flux history");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        (*handle)->adaptive.window = window;
+        // A quarter window of statistics is enough to start, so a stream does not stay deaf for a whole window
+        (*handle)->adaptive.warmup = (uint16_t)(window / 4);
+        (*handle)->adaptive.k = cfg->adaptive_cfg.k;
+        (*handle)->status.adaptive_threshold = true;
     }
-    if (bin >= handle->audio.fft_size / 2) {
-        return (handle->audio.fft_size / 2) - 1;
+
+    if (cfg->flags.silence_gate) {
+        if (!(cfg->gate_cfg.close_level >= 0.0f && cfg->gate_cfg.close_level <= cfg->gate_cfg.open_level)) {
+            ESP_LOGE(TAG, "Gate close level must be between 0 and the open level");
+            beat_detection_deinit(handle);
+            return ESP_ERR_INVALID_ARG;
+        }
+        (*handle)->gate.open_power = cfg->gate_cfg.open_level * cfg->gate_cfg.open_level;
+        (*handle)->gate.close_power = cfg->gate_cfg.close_level * cfg->gate_cfg.close_level;
+        // Start open, so the first frames of a stream are analyzed until they prove quiet
+        (*handle)->gate.open = true;
+        (*handle)->status.silence_gate = true;
     }
-    return (uint16_t)bin;
+
+    return ESP_OK;
 }
 
-static bool detect_bass_surge(float current_bass, float prev_bass, beat_detection_handle_t handle)
+/**
+ * Number of magnitude bins beat_detection_create() computes for a configuration with valid bands
+ */
+static size_t beat_detection_bin_count(const beat_detection_cfg_t *cfg, const beat_detection_band_cfg_t *band_cfg, uint8_t band_num)
 {
-    if (prev_bass <= 0.0f) {
-        return false;
+    int fft_size = cfg->audio_cfg.fft_size;
+    uint32_t analysis_rate = cfg->audio_cfg.sample_rate / beat_detection_decimation(cfg);
+    uint16_t bin_low = fft_size / 2;
+    uint16_t bin_high = 0;
+    for (int b = 0; b < band_num; b++) {
+        uint16_t bin_start = beat_detection_hz_to_bin(band_cfg[b].freq_start, analysis_rate, fft_size);
+        uint16_t bin_end = beat_detection_hz_to_bin(band_cfg[b].freq_end, analysis_rate, fft_size);
+        bin_low = (bin_start < bin_low) ? bin_start : bin_low;
+        bin_high = (bin_end > bin_high) ? bin_end : bin_high;
     }
-    float ratio = current_bass / prev_bass;
-    return (ratio >= handle->audio.threshold);
+    uint16_t edges[BEAT_DETECTION_MAX_FEATURE_BANDS + 1];
+    if (cfg->feature_cfg.band_num > 0 && beat_detection_feature_edges(cfg, edges) == ESP_OK) {
+        bin_low = (edges[0] < bin_low) ? edges[0] : bin_low;
+        bin_high = (edges[cfg->feature_cfg.band_num] - 1 > bin_high) ? edges[cfg->feature_cfg.band_num] - 1 : bin_high;
+    }
+    return (bin_high >= bin_low) ? (size_t)(bin_high - bin_low + 1) : 0;
 }
 
-static beat_detection_result_t beat_detection(beat_detection_handle_t handle, int16_t *audio_buffer)
+/**
+ * Workspace bytes taken by beat_detection_create(), in the order it allocates them
+ */
+static esp_err_t beat_detection_create_size(const beat_detection_cfg_t *cfg, size_t *size)
 {
-    if (handle == NULL) {
-        ESP_LOGE(TAG, "Invalid arguments");
-        return BEAT_DETECTION_FAILED;
+    int fft_size = cfg->audio_cfg.fft_size;
+    if (fft_size < 8 || (fft_size & (fft_size - 1)) != 0 || cfg->audio_cfg.hop_size < 0 || cfg->audio_cfg.hop_size > fft_size) {
+        ESP_LOGE(TAG, "FFT size must be a power of two, at least 8, and hop size between 0 and FFT size");
+        return ESP_ERR_INVALID_ARG;
     }
+    beat_detection_band_cfg_t bass_band;
+    uint8_t band_num;
+    const beat_detection_band_cfg_t *band_cfg = beat_detection_band_cfg(cfg, &bass_band, &band_num);
+    if (band_cfg == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint16_t edges[BEAT_DETECTION_MAX_FEATURE_BANDS + 1];
+    if (cfg->feature_cfg.band_num > 0 && beat_detection_feature_edges(cfg, edges) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t bins = beat_detection_bin_count(cfg, band_cfg, band_num);
+    beat_detection_engine_t engine = cfg->audio_cfg.engine;
+    bool float_fft = (engine == BEAT_DETECTION_ENGINE_COMPLEX_FFT || engine == BEAT_DETECTION_ENGINE_REAL_FFT);
 
-    if (handle->audio.channel == 1) {
-        for (int i = 0; i < handle->audio.fft_size; i++) {
-            handle->audio.fft_buffer[2 * i] = ((float)(audio_buffer[i]) / 32768.0f) * handle->audio.window[i];
-            handle->audio.fft_buffer[2 * i + 1] = 0.0f;
-        }
-    } else if (handle->audio.channel == 2) {
-        for (int i = 0; i < handle->audio.fft_size; i++) {
-            handle->audio.fft_buffer[2 * i] = ((float)(audio_buffer[2 * i + 1]) / 32768.0f) * handle->audio.window[i];
-            handle->audio.fft_buffer[2 * i + 1] = 0.0f;
-        }
+    size_t bytes = BEAT_DETECTION_ARENA_ROUND(sizeof(beat_detection_t));
+#if CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+    if (engine == BEAT_DETECTION_ENGINE_GOERTZEL && 5 * bins > 2 * CONFIG_BEAT_DETECTION_FIXED_FFT_SIZE) {
+        bytes += BEAT_DETECTION_ARENA_ROUND(5 * bins * sizeof(float));
+    }
+#else
+    if (engine == BEAT_DETECTION_ENGINE_GOERTZEL) {
+        bytes += BEAT_DETECTION_ARENA_ROUND(5 * bins * sizeof(float));
+    } else if (engine == BEAT_DETECTION_ENGINE_FFT_Q15) {
+        bytes += BEAT_DETECTION_ARENA_ROUND(beat_detection_spectrum_bytes(engine, fft_size, 0));
     } else {
-        ESP_LOGE(TAG, "Invalid channel");
-        return BEAT_DETECTION_FAILED;
+        bytes += BEAT_DETECTION_ARENA_ROUND(((engine == BEAT_DETECTION_ENGINE_REAL_FFT) ? 1 : 2) * fft_size * sizeof(float));
     }
-
-    dsps_fft2r_fc32(handle->audio.fft_buffer, handle->audio.fft_size);
-    dsps_bit_rev_fc32(handle->audio.fft_buffer, handle->audio.fft_size);
-
-    for (int i = 0; i < handle->audio.fft_size / 2; ++i) {
-        float real = handle->audio.fft_buffer[2 * i];
-        float imag = handle->audio.fft_buffer[2 * i + 1];
-        float a = 0.9f;
-        float magnitude = sqrtf(real * real + imag * imag);
-        handle->audio.magnitude[i] = a * magnitude + (1 - a) * handle->audio.magnitude_prev[i];
+#endif
+    if (engine == BEAT_DETECTION_ENGINE_FFT_Q15) {
+        bytes += BEAT_DETECTION_ARENA_ROUND(beat_detection_table_bytes(BEAT_DETECTION_TABLE_HANN_Q15, fft_size));
+        bytes += BEAT_DETECTION_ARENA_ROUND(beat_detection_table_bytes(BEAT_DETECTION_TABLE_TWIDDLE_SC16, fft_size));
     }
-
-    float current_bass = 0.0f;
-    float prev_bass = 0.0f;
-    float current_sum = 0.0f;
-    float prev_sum = 0.0f;
-    float average_ratio = 0.0f;
-    for (int bin = handle->audio.bass_bin_start; bin <= handle->audio.bass_bin_end && bin < handle->audio.fft_size / 2; ++bin) {
-        if (handle->audio.magnitude_prev[bin] > prev_bass) {
-            prev_bass = handle->audio.magnitude_prev[bin];
+    if (engine == BEAT_DETECTION_ENGINE_REAL_FFT) {
+        bytes += BEAT_DETECTION_ARENA_ROUND(beat_detection_table_bytes(BEAT_DETECTION_TABLE_RFFT_SPLIT, fft_size));
+    }
+    if (cfg->flags.verify_engine) {
+        bytes += BEAT_DETECTION_ARENA_ROUND(2 * fft_size * sizeof(float));
+        bytes += BEAT_DETECTION_ARENA_ROUND(bins * sizeof(float));
+    }
+    if (float_fft || cfg->flags.verify_engine) {
+        bytes += BEAT_DETECTION_ARENA_ROUND(beat_detection_table_bytes(BEAT_DETECTION_TABLE_TWIDDLE_FC32, fft_size));
+        bytes += BEAT_DETECTION_ARENA_ROUND(beat_detection_table_bytes(BEAT_DETECTION_TABLE_HANN_F32, fft_size));
+    }
+#if !CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+    bytes += 2 * BEAT_DETECTION_ARENA_ROUND(bins * sizeof(float));
+    if (cfg->audio_cfg.hop_size > 0 && beat_detection_decimation(cfg) == 1) {
+        bytes += BEAT_DETECTION_ARENA_ROUND(cfg->audio_cfg.channel * fft_size * beat_detection_sample_bytes(cfg));
+    }
+#endif
+    if (beat_detection_decimation(cfg) > 1) {
+        int taps_len = BEAT_DETECTION_DECIMATOR_TAPS_PER_PHASE * beat_detection_decimation(cfg);
+        bytes += BEAT_DETECTION_ARENA_ROUND(beat_detection_table_bytes(BEAT_DETECTION_TABLE_DECIMATOR, taps_len));
+        bytes += BEAT_DETECTION_ARENA_ROUND((2 * taps_len + fft_size) * sizeof(float));
+    }
+    if (cfg->audio_cfg.channel == 2 && (cfg->audio_cfg.channel_mode == BEAT_DETECTION_CHANNEL_MAX || cfg->audio_cfg.channel_mode == BEAT_DETECTION_CHANNEL_DUAL)) {
+        beat_detection_cfg_t peer_cfg;
+        beat_detection_peer_cfg(cfg, &peer_cfg);
+        size_t peer_bytes;
+        esp_err_t ret = beat_detection_create_size(&peer_cfg, &peer_bytes);
+        if (ret != ESP_OK) {
+            return ret;
         }
-        if (handle->audio.magnitude[bin] > current_bass) {
-            current_bass = handle->audio.magnitude[bin];
+        bytes += peer_bytes;
+    }
+    if (cfg->flags.tempo_tracking) {
+        int lag_min;
+        int lag_max;
+        if (beat_detection_tempo_lags(cfg, &lag_min, &lag_max) != ESP_OK) {
+            return ESP_ERR_INVALID_ARG;
         }
-        current_sum += handle->audio.magnitude[bin];
-        prev_sum += handle->audio.magnitude_prev[bin];
+        bytes += BEAT_DETECTION_ARENA_ROUND((lag_max + 1 + 2 * (lag_max - lag_min + 1)) * sizeof(float));
     }
-    average_ratio = current_sum / prev_sum;
-
-    memcpy(handle->audio.magnitude_prev, handle->audio.magnitude, sizeof(float) * handle->audio.fft_size / 2);
-
-    // detect bass drum
-    if ((detect_bass_surge(current_bass, prev_bass, handle) || average_ratio > handle->audio.average_ratio) 
-        && current_bass > handle->audio.min_energy 
-        && xTaskGetTickCount() - handle->audio.last_bass_detected_time > pdMS_TO_TICKS(handle->audio.time_interval)) {
-        // float surge_ratio = current_bass / prev_bass;
-        // ESP_LOGI(TAG, "🎵 Bass drum detected! Energy surge: %.2fx (current=%.3f, prev=%.3f)", 
-        //          surge_ratio, current_bass, prev_bass);
-        handle->audio.last_bass_detected_time = xTaskGetTickCount();
-        return BEAT_DETECTED;
+    if (cfg->flags.adaptive_threshold) {
+        uint16_t window;
+        if (beat_detection_adaptive_window(cfg, &window) != ESP_OK) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        bytes += BEAT_DETECTION_ARENA_ROUND(band_num * window * sizeof(float));
     }
-
-    return BEAT_NOT_DETECTED;
+    *size = bytes;
+    return ESP_OK;
 }
 
-esp_err_t beat_detection_data_write(beat_detection_handle_t handle, beat_detection_audio_buffer_t buffer)
+esp_err_t beat_detection_get_workspace_size(const beat_detection_cfg_t *cfg, size_t *size)
 {
-    if (handle == NULL) {
+    if (cfg == NULL || size == NULL) {
         ESP_LOGE(TAG, "Invalid arguments");
         return ESP_ERR_INVALID_ARG;
     }
-
-    if (buffer.bytes_size < handle->audio.channel * handle->audio.fft_size * sizeof(int16_t)) {
-        ESP_LOGE(TAG, "Audio buffer size is less than FFT size");
+    size_t bytes;
+    esp_err_t ret = beat_detection_create_size(cfg, &bytes);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if ((!cfg->flags.synchronous && cfg->buffer_cfg.frame_num == 0) || (cfg->event_queue_cfg.depth & (cfg->event_queue_cfg.depth - 1)) != 0
+        || (cfg->trace_cfg.depth & (cfg->trace_cfg.depth - 1)) != 0) {
+        ESP_LOGE(TAG, "Ring buffer needs at least 1 frame and the event queue and trace depths must be powers of two");
         return ESP_ERR_INVALID_ARG;
     }
-
-    if (handle->status.is_calculating) {
-        return ESP_ERR_INVALID_STATE;
+    if (cfg->event_queue_cfg.depth > 0) {
+        bytes += BEAT_DETECTION_ARENA_ROUND(cfg->event_queue_cfg.depth * sizeof(beat_detection_event_t));
     }
-
-    uint32_t loc = (handle->status.enable_psram) ? MALLOC_CAP_SPIRAM: MALLOC_CAP_INTERNAL;
-
-    uint8_t *audio_buffer = (uint8_t *)heap_caps_malloc(handle->audio.channel * handle->audio.fft_size * sizeof(int16_t), loc | MALLOC_CAP_8BIT);
-    if (audio_buffer == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for audio buffer");
-        return ESP_ERR_NO_MEM;
+    if (cfg->feature_cfg.band_num > 0) {
+        bytes += BEAT_DETECTION_ARENA_ROUND(BEAT_DETECTION_FEATURE_SLOTS * sizeof(beat_detection_feature_slot_t)
+                                            + cfg->feature_cfg.band_num * sizeof(beat_detection_feature_band_t));
     }
-    memcpy(audio_buffer, buffer.audio_buffer, handle->audio.channel * handle->audio.fft_size * sizeof(int16_t));
-
-    beat_detection_audio_buffer_t processed_buffer = {
-        .audio_buffer = audio_buffer,
-        .bytes_size = handle->audio.channel * handle->audio.fft_size * sizeof(int16_t),
-    };
-    if (xQueueSend(handle->task.audio_queue, &processed_buffer, pdMS_TO_TICKS(0)) != pdPASS) {
-        ESP_LOGE(TAG, "Failed to send audio buffer to queue");
-        heap_caps_free(audio_buffer);
-        return ESP_FAIL;
+    if (cfg->trace_cfg.depth > 0) {
+        bytes += BEAT_DETECTION_ARENA_ROUND(BEAT_DETECTION_ARENA_ROUND(sizeof(beat_detection_trace_header_t))
+                                            + cfg->trace_cfg.depth * sizeof(beat_detection_trace_record_t));
     }
+    if (cfg->flags.synchronous) {
+        *size = bytes;
+        return ESP_OK;
+    }
+    size_t frame_samples = beat_detection_frame_step(cfg);
+    bytes += BEAT_DETECTION_ARENA_ROUND(cfg->buffer_cfg.frame_num * cfg->audio_cfg.channel * frame_samples * beat_detection_sample_bytes(cfg));
+    bytes += 2 * BEAT_DETECTION_ARENA_ROUND(sizeof(StaticSemaphore_t));
+    bytes += BEAT_DETECTION_ARENA_ROUND(sizeof(StaticQueue_t));
+    bytes += BEAT_DETECTION_ARENA_ROUND(2 * cfg->buffer_cfg.frame_num * sizeof(beat_detection_queue_item_t));
+    int tasks = 1;
+    if (cfg->flags.pipeline) {
+        beat_detection_band_cfg_t bass_band;
+        uint8_t band_num = 0;
+        const beat_detection_band_cfg_t *band_cfg = beat_detection_band_cfg(cfg, &bass_band, &band_num);
+        size_t bins = beat_detection_bin_count(cfg, band_cfg, band_num);
+        bytes += BEAT_DETECTION_ARENA_ROUND(beat_detection_spectrum_bytes(cfg->audio_cfg.engine, cfg->audio_cfg.fft_size, bins));
+        tasks++;
+    }
+    bytes += tasks * BEAT_DETECTION_ARENA_ROUND(cfg->task_cfg.stack_size);
+    bytes += tasks * BEAT_DETECTION_ARENA_ROUND(sizeof(StaticTask_t));
+    *size = bytes;
     return ESP_OK;
 }
 
-static void beat_detection_task(void *arg)
+/**
+ * Create a detector task; its stack and TCB come from the workspace or PSRAM when either is used
+ */
+static esp_err_t beat_detection_task_create(const beat_detection_cfg_t *cfg, beat_detection_arena_t *arena, TaskFunction_t task_code,
+                                            const char *name, BaseType_t core_id, beat_detection_handle_t handle,
+                                            StackType_t **stack_buffer, StaticTask_t **tcb, TaskHandle_t *task)
 {
-    beat_detection_handle_t handle = (beat_detection_handle_t)arg;
-    while (true) {
-        beat_detection_audio_buffer_t received_buffer;
-        xQueueReceive(handle->task.audio_queue, &received_buffer, portMAX_DELAY);
-        handle->status.is_calculating = true;
-        if (received_buffer.bytes_size < handle->audio.channel * handle->audio.fft_size * sizeof(int16_t)) {
-            ESP_LOGE(TAG, "Audio buffer size is less than FFT size");
-            continue;
+    uint32_t local_flags = (cfg->flags.enable_psram) ? MALLOC_CAP_SPIRAM: MALLOC_CAP_INTERNAL;
+    if (cfg->flags.enable_psram || arena != NULL) {
+        *stack_buffer = (StackType_t *)beat_detection_malloc(arena, cfg->task_cfg.stack_size, local_flags | MALLOC_CAP_8BIT);
+        if (*stack_buffer == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for task stack");
+            return ESP_ERR_NO_MEM;
         }
-        beat_detection_result_t result = beat_detection(handle, (int16_t *)received_buffer.audio_buffer);
-        heap_caps_free(received_buffer.audio_buffer);
-        if (handle->audio.result_callback != NULL) {
-            handle->audio.result_callback(result, handle->audio.result_callback_ctx);
+        memset(*stack_buffer, 0, sizeof(StackType_t) * cfg->task_cfg.stack_size);
+
+        *tcb = (StaticTask_t *)beat_detection_malloc(arena, sizeof(StaticTask_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (*tcb == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for task TCB");
+            return ESP_ERR_NO_MEM;
         }
-        handle->status.is_calculating = false;
+        memset(*tcb, 0, sizeof(StaticTask_t));
+
+        *task = xTaskCreateStaticPinnedToCore(
+            task_code,
+            name,
+            cfg->task_cfg.stack_size, 
+            handle,
+            cfg->task_cfg.priority, 
+            *stack_buffer, 
+            *tcb, 
+            core_id
+        );
+    } else {
+        xTaskCreatePinnedToCore(
+            task_code,
+            name,
+            cfg->task_cfg.stack_size, 
+            handle,
+            cfg->task_cfg.priority, 
+            task, 
+            core_id
+        );
     }
-    vTaskDelete(NULL);
+    return (*task != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
 }
 
-esp_err_t beat_detection_init(beat_detection_cfg_t *cfg, beat_detection_handle_t *handle)
+/**
+ * Second spectrum slot and decision task of the two-stage pipeline. Only the single-detector modes
+ * without engine verification are split, since the peer of MAX and DUAL and the verification path
+ * read the audio after the transform.
+ */
+static esp_err_t beat_detection_pipeline_create(const beat_detection_cfg_t *cfg, beat_detection_arena_t *arena, beat_detection_handle_t handle)
 {
-    if (cfg == NULL || handle == NULL) {
-        ESP_LOGE(TAG, "Invalid arguments");
+    if (handle->audio.peer != NULL || handle->status.verify_engine) {
+        ESP_LOGE(TAG, "Pipeline does not support the MAX and DUAL channel modes or engine verification");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (beat_detection_check_channel(handle) != ESP_OK) {
         return ESP_ERR_INVALID_ARG;
     }
-
-    esp_err_t ret = ESP_OK;
-
-    *handle = NULL;
     uint32_t local_flags = (cfg->flags.enable_psram) ? MALLOC_CAP_SPIRAM: MALLOC_CAP_INTERNAL;
+    size_t bytes = beat_detection_spectrum_bytes(handle->audio.engine, handle->audio.fft_size, handle->audio.mag_bin_count);
+    handle->pipeline.spectrum[0] = beat_detection_spectrum(handle);
+    handle->pipeline.spectrum[1] = beat_detection_calloc(arena, 1, bytes, local_flags | MALLOC_CAP_8BIT);
+    if (handle->pipeline.spectrum[1] == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for pipeline spectrum");
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = beat_detection_task_create(cfg, arena, beat_detection_decision_task, "beat_decision_task", cfg->task_cfg.pipeline_core_id,
+                                               handle, &handle->pipeline.stack_buffer, &handle->pipeline.tcb, &handle->pipeline.decision_task);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    handle->status.pipeline = true;
+    return ESP_OK;
+}
 
-    dsps_fft2r_init_fc32(NULL, CONFIG_DSP_MAX_FFT_SIZE);
+static esp_err_t beat_detection_setup(beat_detection_cfg_t *cfg, beat_detection_arena_t *arena, beat_detection_handle_t *handle)
+{
+    esp_err_t ret = beat_detection_create(cfg, arena, handle);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize FFT");
         return ret;
     }
+    uint32_t local_flags = (cfg->flags.enable_psram) ? MALLOC_CAP_SPIRAM: MALLOC_CAP_INTERNAL;
 
-    *handle = (beat_detection_handle_t)heap_caps_malloc(sizeof(beat_detection_t), local_flags | MALLOC_CAP_8BIT);
-    if (*handle == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for Beat detection handle");
-        beat_detection_deinit(handle);
-        return ESP_ERR_NO_MEM;
+    // One hop in streaming mode, otherwise one frame, in input samples ahead of any decimation
+    (*handle)->ring.frame_bytes = (*handle)->audio.channel * (*handle)->audio.frame_step * (*handle)->audio.sample_bytes;
+
+    uint16_t event_depth = cfg->event_queue_cfg.depth;
+    if (event_depth > 0) {
+        if ((event_depth & (event_depth - 1)) != 0) {
+            ESP_LOGE(TAG, "Event queue depth must be a power of two");
+            beat_detection_deinit(handle);
+            return ESP_ERR_INVALID_ARG;
+        }
+        (*handle)->events.buffer = (beat_detection_event_t *)beat_detection_calloc(arena, event_depth, sizeof(beat_detection_event_t), local_flags | MALLOC_CAP_8BIT);
+        if ((*handle)->events.buffer == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for event queue");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        (*handle)->events.mask = event_depth - 1;
+        (*handle)->events.notify_count = (cfg->event_queue_cfg.notify_count > 0) ? cfg->event_queue_cfg.notify_count : 1;
+        (*handle)->events.notify_timeout = pdMS_TO_TICKS(cfg->event_queue_cfg.notify_timeout_ms);
+        (*handle)->events.notify_task = cfg->event_queue_cfg.notify_task;
     }
-    memset(*handle, 0, sizeof(beat_detection_t));
 
-    (*handle)->audio.fft_size = cfg->audio_cfg.fft_size;
-    (*handle)->audio.sample_rate = cfg->audio_cfg.sample_rate;
-    (*handle)->audio.channel = cfg->audio_cfg.channel;
-    (*handle)->audio.bass_bin_start = beat_detection_hz_to_bin(cfg->audio_cfg.bass_freq_start, *handle);
-    (*handle)->audio.bass_bin_end = beat_detection_hz_to_bin(cfg->audio_cfg.bass_freq_end, *handle);
-    (*handle)->audio.threshold = cfg->audio_cfg.threshold;
-    (*handle)->audio.average_ratio = cfg->audio_cfg.average_ratio;
-    (*handle)->audio.min_energy = cfg->audio_cfg.min_energy;
-    (*handle)->audio.time_interval = cfg->audio_cfg.time_interval;
-    (*handle)->audio.result_callback = cfg->result_callback;
-    (*handle)->audio.result_callback_ctx = cfg->result_callback_ctx;
-    (*handle)->status.is_calculating = false;
-    (*handle)->status.enable_psram = cfg->flags.enable_psram;
-    ESP_LOGI(TAG, "Bass frequency range: %d-%d Hz, bins: %d-%d", 
-             (int)cfg->audio_cfg.bass_freq_start, (int)cfg->audio_cfg.bass_freq_end, (*handle)->audio.bass_bin_start, (*handle)->audio.bass_bin_end);
+    uint8_t feature_num = cfg->feature_cfg.band_num;
+    if (feature_num > 0) {
+        // The band table follows the slots in one allocation, precomputed so a frame only sums bins
+        uint16_t edges[BEAT_DETECTION_MAX_FEATURE_BANDS + 1];
+        beat_detection_feature_edges(cfg, edges);
+        size_t slot_bytes = BEAT_DETECTION_FEATURE_SLOTS * sizeof(beat_detection_feature_slot_t);
+        uint8_t *block = (uint8_t *)beat_detection_calloc(arena, 1, slot_bytes + feature_num * sizeof(beat_detection_feature_band_t), local_flags | MALLOC_CAP_8BIT);
+        if (block == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for feature export");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        (*handle)->features.slots = (beat_detection_feature_slot_t *)block;
+        (*handle)->features.bands = (beat_detection_feature_band_t *)(block + slot_bytes);
+        for (int b = 0; b < feature_num; b++) {
+            beat_detection_feature_band_t *band = &(*handle)->features.bands[b];
+            band->bin_start = edges[b];
+            band->bin_count = edges[b + 1] - edges[b];
+            band->scale = 1.0f / (float)band->bin_count;
+        }
+        (*handle)->features.band_num = feature_num;
+    }
 
-    (*handle)->audio.fft_buffer = (float *)heap_caps_malloc( 2 * (*handle)->audio.fft_size * sizeof(float), local_flags | MALLOC_CAP_8BIT);
-    if ((*handle)->audio.fft_buffer == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for FFT buffer");
-        beat_detection_deinit(handle);
-        return ESP_ERR_NO_MEM;
+    uint16_t trace_depth = cfg->trace_cfg.depth;
+    if (trace_depth > 0) {
+        if ((trace_depth & (trace_depth - 1)) != 0) {
+            ESP_LOGE(TAG, "Trace depth must be a power of two");
+            beat_detection_deinit(handle);
+            return ESP_ERR_INVALID_ARG;
+        }
+        // The header a dump starts with is filled in once, the records follow it in one allocation
+        size_t header_bytes = BEAT_DETECTION_ARENA_ROUND(sizeof(beat_detection_trace_header_t));
+        uint8_t *block = (uint8_t *)beat_detection_calloc(arena, 1, header_bytes + trace_depth * sizeof(beat_detection_trace_record_t), local_flags | MALLOC_CAP_8BIT);
+        if (block == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for the trace ring");
+            beat_detection_deinit(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        beat_detection_trace_header_t *header = (beat_detection_trace_header_t *)block;
+        beat_detection_band_cfg_t bass_band;
+        const beat_detection_band_cfg_t *band_cfg = beat_detection_band_cfg(cfg, &bass_band, &header->band_num);
+        memcpy(header->bands, band_cfg, header->band_num * sizeof(beat_detection_band_cfg_t));
+        header->magic = BEAT_DETECTION_TRACE_MAGIC;
+        header->version = BEAT_DETECTION_TRACE_VERSION;
+        header->record_size = sizeof(beat_detection_trace_record_t);
+        header->sample_rate = (*handle)->audio.sample_rate;
+        header->frame_step = (*handle)->audio.frame_step;
+        header->power_domain = (*handle)->status.power_domain;
+        header->adaptive = (*handle)->status.adaptive_threshold;
+        (*handle)->trace.header = header;
+        (*handle)->trace.records = (beat_detection_trace_record_t *)(block + header_bytes);
+        (*handle)->trace.mask = trace_depth - 1;
+        // The right channel detector of DUAL mode records into the same ring, after the left one in each frame
+        (*handle)->trace.sink = *handle;
+        if ((*handle)->audio.peer != NULL) {
+            (*handle)->audio.peer->trace.sink = *handle;
+        }
     }
-    memset((*handle)->audio.fft_buffer, 0, 2 * (*handle)->audio.fft_size * sizeof(float));
 
-    (*handle)->audio.window = heap_caps_malloc((*handle)->audio.fft_size * sizeof(float), local_flags | MALLOC_CAP_8BIT);
-    if ((*handle)->audio.window == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for window");
+    // Synchronous mode analyzes on the caller's thread: no ring buffer, queue or task
+    if (cfg->flags.synchronous) {
+        (*handle)->status.synchronous = true;
+        return ESP_OK;
+    }
+
+    if (cfg->buffer_cfg.frame_num == 0) {
+        ESP_LOGE(TAG, "Ring buffer frame number must be at least 1");
+        beat_detection_deinit(handle);
+        return ESP_ERR_INVALID_ARG;
+    }
+    (*handle)->ring.frame_num = cfg->buffer_cfg.frame_num;
+    (*handle)->ring.write_timeout = pdMS_TO_TICKS(cfg->buffer_cfg.write_timeout_ms);
+    (*handle)->ring.buffer = (uint8_t *)beat_detection_malloc(arena, (*handle)->ring.frame_num * (*handle)->ring.frame_bytes, local_flags | MALLOC_CAP_8BIT);
+    if ((*handle)->ring.buffer == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for ring buffer");
         beat_detection_deinit(handle);
         return ESP_ERR_NO_MEM;
     }
-    memset((*handle)->audio.window, 0, (*handle)->audio.fft_size * sizeof(float));
-    dsps_wind_hann_f32((*handle)->audio.window, (*handle)->audio.fft_size);
 
-    (*handle)->audio.magnitude = (float *)heap_caps_malloc((*handle)->audio.fft_size / 2 * sizeof(float), local_flags | MALLOC_CAP_8BIT);
-    if ((*handle)->audio.magnitude == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for magnitude");
+    if (arena != NULL) {
+        StaticSemaphore_t *semaphore = (StaticSemaphore_t *)beat_detection_malloc(arena, sizeof(StaticSemaphore_t), local_flags);
+        if (semaphore != NULL) {
+            (*handle)->ring.free_frames = xSemaphoreCreateCountingStatic((*handle)->ring.frame_num, (*handle)->ring.frame_num, semaphore);
+        }
+    } else {
+        (*handle)->ring.free_frames = xSemaphoreCreateCounting((*handle)->ring.frame_num, (*handle)->ring.frame_num);
+    }
+    if ((*handle)->ring.free_frames == NULL) {
+        ESP_LOGE(TAG, "Failed to create ring buffer semaphore");
         beat_detection_deinit(handle);
         return ESP_ERR_NO_MEM;
     }
-    memset((*handle)->audio.magnitude, 0, (*handle)->audio.fft_size / 2 * sizeof(float));
 
-    (*handle)->audio.magnitude_prev = (float *)heap_caps_malloc((*handle)->audio.fft_size / 2 * sizeof(float), local_flags | MALLOC_CAP_8BIT);
-    if ((*handle)->audio.magnitude_prev == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for magnitude previous");
+    // Up to frame_num buffers may be lent on top of the ring frames
+    if (arena != NULL) {
+        StaticSemaphore_t *semaphore = (StaticSemaphore_t *)beat_detection_malloc(arena, sizeof(StaticSemaphore_t), local_flags);
+        if (semaphore != NULL) {
+            (*handle)->ring.free_lends = xSemaphoreCreateCountingStatic((*handle)->ring.frame_num, (*handle)->ring.frame_num, semaphore);
+        }
+    } else {
+        (*handle)->ring.free_lends = xSemaphoreCreateCounting((*handle)->ring.frame_num, (*handle)->ring.frame_num);
+    }
+    if ((*handle)->ring.free_lends == NULL) {
+        ESP_LOGE(TAG, "Failed to create lend semaphore");
         beat_detection_deinit(handle);
         return ESP_ERR_NO_MEM;
     }
-    memset((*handle)->audio.magnitude_prev, 0, (*handle)->audio.fft_size / 2 * sizeof(float));
 
-    (*handle)->task.audio_queue = xQueueCreate(1, sizeof(beat_detection_audio_buffer_t));
+    if (arena != NULL) {
+        StaticQueue_t *queue = (StaticQueue_t *)beat_detection_malloc(arena, sizeof(StaticQueue_t), local_flags);
+        uint8_t *storage = (uint8_t *)beat_detection_malloc(arena, 2 * (*handle)->ring.frame_num * sizeof(beat_detection_queue_item_t), local_flags);
+        if (queue != NULL && storage != NULL) {
+            (*handle)->task.audio_queue = xQueueCreateStatic(2 * (*handle)->ring.frame_num, sizeof(beat_detection_queue_item_t), storage, queue);
+        }
+    } else {
+        (*handle)->task.audio_queue = xQueueCreate(2 * (*handle)->ring.frame_num, sizeof(beat_detection_queue_item_t));
+    }
     if ((*handle)->task.audio_queue == NULL) {
         ESP_LOGE(TAG, "Failed to create audio queue");
         beat_detection_deinit(handle);
         return ESP_ERR_NO_MEM;
     }
 
-    if (cfg->flags.enable_psram) {
-        (*handle)->task.task_stack_buffer = (StackType_t *)heap_caps_malloc(cfg->task_cfg.stack_size, local_flags | MALLOC_CAP_8BIT);
-        if ((*handle)->task.task_stack_buffer == NULL) {
-            ESP_LOGE(TAG, "Failed to allocate memory for task stack");
-            beat_detection_deinit(handle);
-            return ESP_ERR_NO_MEM;
-        }
-        memset((*handle)->task.task_stack_buffer, 0, sizeof(StackType_t) * cfg->task_cfg.stack_size);
-
-        (*handle)->task.task_tcb = (StaticTask_t *)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-        if ((*handle)->task.task_tcb == NULL) {
-            ESP_LOGE(TAG, "Failed to allocate memory for task TCB");
+    if (cfg->flags.pipeline) {
+        ret = beat_detection_pipeline_create(cfg, arena, *handle);
+        if (ret != ESP_OK) {
             beat_detection_deinit(handle);
-            return ESP_ERR_NO_MEM;
+            return ret;
         }
-        memset((*handle)->task.task_tcb, 0, sizeof(StaticTask_t));
-
-        (*handle)->task.task_handle = xTaskCreateStaticPinnedToCore(
-            beat_detection_task,
-            "beat_detection_task",
-            cfg->task_cfg.stack_size, 
-            *handle,
-            cfg->task_cfg.priority, 
-            (*handle)->task.task_stack_buffer, 
-            (*handle)->task.task_tcb, 
-            cfg->task_cfg.core_id
-        );
-    } else {
-        xTaskCreatePinnedToCore(
-            beat_detection_task,
-            "beat_detection_task",
-            cfg->task_cfg.stack_size, 
-            *handle,
-            cfg->task_cfg.priority, 
-            &(*handle)->task.task_handle, 
-            cfg->task_cfg.core_id
-        );
     }
 
-    if((*handle)->task.task_handle == NULL) {
+    ret = beat_detection_task_create(cfg, arena, beat_detection_task, "beat_detection_task", cfg->task_cfg.core_id, *handle,
+                                     &(*handle)->task.task_stack_buffer, &(*handle)->task.task_tcb, &(*handle)->task.task_handle);
+    if (ret != ESP_OK) {
         beat_detection_deinit(handle);
-        return ESP_ERR_NO_MEM;
+        return ret;
     }
 
     return ESP_OK;
 }
 
-esp_err_t beat_detection_deinit(beat_detection_handle_t *handle)
+esp_err_t beat_detection_init(beat_detection_cfg_t *cfg, beat_detection_handle_t *handle)
 {
-    dsps_fft2r_deinit_fc32();
+    if (cfg == NULL || handle == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return beat_detection_setup(cfg, NULL, handle);
+}
 
-    if (*handle == NULL) {
+esp_err_t beat_detection_init_static(beat_detection_cfg_t *cfg, void *workspace, size_t workspace_size, beat_detection_handle_t *handle)
+{
+    if (cfg == NULL || workspace == NULL || handle == NULL) {
         ESP_LOGE(TAG, "Invalid arguments");
         return ESP_ERR_INVALID_ARG;
     }
+    if (((uintptr_t)workspace & (BEAT_DETECTION_WORKSPACE_ALIGN - 1)) != 0) {
+        ESP_LOGE(TAG, "Workspace must be aligned to %d bytes", BEAT_DETECTION_WORKSPACE_ALIGN);
+        return ESP_ERR_INVALID_ARG;
+    }
+    beat_detection_arena_t arena = {
+        .base = (uint8_t *)workspace,
+        .size = workspace_size,
+        .used = 0,
+    };
+    return beat_detection_setup(cfg, &arena, handle);
+}
 
-    if ((*handle)->audio.fft_buffer != NULL) {
-        heap_caps_free((*handle)->audio.fft_buffer);
+esp_err_t beat_detection_deinit(beat_detection_handle_t *handle)
+{
+    if (handle == NULL || *handle == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
     }
-    if ((*handle)->audio.window != NULL) {
-        heap_caps_free((*handle)->audio.window);
+
+    // Stop the task before releasing anything it may still be using
+    if ((*handle)->task.task_handle != NULL) {
+        vTaskDelete((*handle)->task.task_handle);
     }
-    if ((*handle)->audio.magnitude != NULL) {
-        heap_caps_free((*handle)->audio.magnitude);
+    if ((*handle)->pipeline.decision_task != NULL) {
+        vTaskDelete((*handle)->pipeline.decision_task);
     }
-    if ((*handle)->audio.magnitude_prev != NULL) {
-        heap_caps_free((*handle)->audio.magnitude_prev);
+    beat_detection_buffer_free(*handle, (*handle)->audio.fft_buffer);
+    beat_detection_table_release((*handle)->audio.fft_twiddle);
+    beat_detection_table_release((*handle)->audio.rfft_twiddle);
+    beat_detection_table_release((*handle)->audio.twiddle_sc16);
+    beat_detection_table_release((*handle)->audio.window_q15);
+    beat_detection_table_release((*handle)->audio.window);
+    beat_detection_table_release((*handle)->decimator.taps);
+    beat_detection_buffer_free(*handle, (*handle)->audio.goertzel_coeff);
+    beat_detection_buffer_free(*handle, (*handle)->audio.fft_buffer_sc16);
+    beat_detection_buffer_free(*handle, (*handle)->verify.fft_buffer);
+    beat_detection_buffer_free(*handle, (*handle)->verify.magnitude);
+    beat_detection_buffer_free(*handle, (*handle)->audio.magnitude);
+    beat_detection_buffer_free(*handle, (*handle)->audio.magnitude_prev);
+    beat_detection_buffer_free(*handle, (*handle)->audio.history);
+    beat_detection_buffer_free(*handle, (*handle)->decimator.delay);
+    beat_detection_buffer_free(*handle, (*handle)->tempo.history);
+    beat_detection_buffer_free(*handle, (*handle)->adaptive.history);
+    if ((*handle)->audio.peer != NULL) {
+        beat_detection_deinit(&(*handle)->audio.peer);
     }
     if ((*handle)->task.audio_queue != NULL) {
+        // Lent buffers still waiting in the queue go back to their owners
+        beat_detection_queue_item_t item;
+        while (xQueueReceive((*handle)->task.audio_queue, &item, 0) == pdTRUE) {
+            if (item.release_cb != NULL) {
+                item.release_cb(item.data, item.release_ctx);
+            }
+        }
         vQueueDelete((*handle)->task.audio_queue);
     }
-    if ((*handle)->task.task_stack_buffer != NULL) {
-        heap_caps_free((*handle)->task.task_stack_buffer);
+    if ((*handle)->ring.free_frames != NULL) {
+        vSemaphoreDelete((*handle)->ring.free_frames);
     }
-    if ((*handle)->task.task_tcb != NULL) {
-        heap_caps_free((*handle)->task.task_tcb);
+    if ((*handle)->ring.free_lends != NULL) {
+        vSemaphoreDelete((*handle)->ring.free_lends);
     }
-    if ((*handle)->task.task_handle != NULL) {
-        vTaskDelete((*handle)->task.task_handle);
+    beat_detection_buffer_free(*handle, (*handle)->ring.buffer);
+    beat_detection_buffer_free(*handle, (*handle)->events.buffer);
+    beat_detection_buffer_free(*handle, (*handle)->features.slots);
+    beat_detection_buffer_free(*handle, (*handle)->trace.header);
+    beat_detection_buffer_free(*handle, (*handle)->task.task_stack_buffer);
+    beat_detection_buffer_free(*handle, (*handle)->task.task_tcb);
+    beat_detection_buffer_free(*handle, (*handle)->pipeline.spectrum[1]);
+    beat_detection_buffer_free(*handle, (*handle)->pipeline.stack_buffer);
+    beat_detection_buffer_free(*handle, (*handle)->pipeline.tcb);
+    beat_detection_instance_free(*handle);
+    *handle = NULL;
+    return ESP_OK;
+}
+
+static inline uint16_t beat_detection_read_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t beat_detection_read_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+esp_err_t beat_detection_wav_parse(const void *data, size_t size, beat_detection_wav_info_t *info)
+{
+    if (data == NULL || info == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
     }
-    if (*handle != NULL) {
-        heap_caps_free(*handle);
+
+    const uint8_t *bytes = (const uint8_t *)data;
+    if (size < 12 || memcmp(bytes, "RIFF", 4) != 0 || memcmp(bytes + 8, "WAVE", 4) != 0) {
+        ESP_LOGE(TAG, "Not a RIFF/WAVE file");
+        return ESP_ERR_INVALID_ARG;
     }
-    *handle = NULL;
+
+    memset(info, 0, sizeof(beat_detection_wav_info_t));
+    bool have_fmt = false;
+    size_t sample_bytes = 0;
+    size_t pos = 12;
+    while (pos + 8 <= size) {
+        uint32_t chunk_size = beat_detection_read_le32(bytes + pos + 4);
+        const uint8_t *chunk = bytes + pos + 8;
+        if (memcmp(bytes + pos, "fmt ", 4) == 0 && chunk_size >= 16 && chunk_size <= size - (pos + 8)) {
+            uint16_t format_tag = beat_detection_read_le16(chunk);
+            uint16_t bits = beat_detection_read_le16(chunk + 14);
+            // WAVE_FORMAT_EXTENSIBLE names the actual format in the first two bytes of its sub-format GUID
+            if (format_tag == 0xFFFE && chunk_size >= 40) {
+                format_tag = beat_detection_read_le16(chunk + 24);
+            }
+            if (format_tag != 1 || (bits != 16 && bits != 32)) {
+                ESP_LOGE(TAG, "Only 16-bit and 32-bit PCM WAV files are supported");
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+            sample_bytes = bits / 8;
+            info->format = (bits == 32) ? BEAT_DETECTION_FORMAT_S32 : BEAT_DETECTION_FORMAT_S16;
+            info->channel = (uint8_t)beat_detection_read_le16(chunk + 2);
+            info->sample_rate = beat_detection_read_le32(chunk + 4);
+            have_fmt = true;
+        } else if (memcmp(bytes + pos, "data", 4) == 0 && have_fmt) {
+            if (info->channel == 0 || ((uintptr_t)chunk % sample_bytes) != 0) {
+                ESP_LOGE(TAG, "Unsupported WAV data layout");
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+            // A truncated file (e.g. still being recorded) yields the samples that are present
+            size_t data_bytes = chunk_size;
+            if (data_bytes > size - (pos + 8)) {
+                data_bytes = size - (pos + 8);
+            }
+            info->samples = chunk;
+            info->sample_count = data_bytes / (info->channel * sample_bytes);
+            return ESP_OK;
+        }
+        // Checked before advancing, a bogus size would wrap pos where size_t is 32 bits
+        if (chunk_size > size - (pos + 8)) {
+            ESP_LOGE(TAG, "WAV chunk runs past the end of the file");
+            return ESP_ERR_INVALID_SIZE;
+        }
+        pos += 8 + (size_t)chunk_size + (chunk_size & 1);
+    }
+
+    ESP_LOGE(TAG, "WAV file has no fmt or data chunk");
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t beat_detection_batch_detect(beat_detection_cfg_t *cfg, const void *samples, size_t sample_count,
+                                      uint64_t *beats, size_t max_beats, size_t *beat_count)
+{
+    if (cfg == NULL || samples == NULL || beat_count == NULL || (beats == NULL && max_beats > 0)) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    *beat_count = 0;
+
+    beat_detection_handle_t handle = NULL;
+    esp_err_t ret = beat_detection_create(cfg, NULL, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (beat_detection_check_channel(handle) != ESP_OK) {
+        beat_detection_deinit(&handle);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Same frame grid as the task-driven path, one frame ends at every multiple of the hop, so the
+    // timestamps match the sample_index of its events. Frames are analyzed in place, except the
+    // first few of streaming mode, which start before the buffer and are zero-padded in the history.
+    // A decimating detector filters every step once, in order, so its frames are never in place
+    size_t fft_size = (size_t)handle->audio.fft_size;
+    size_t hop = handle->audio.frame_step;
+    size_t sample_bytes = handle->audio.channel * handle->audio.sample_bytes;
+    const uint8_t *input = (const uint8_t *)samples;
+    size_t count = 0;
+    for (size_t end = hop; end <= sample_count; end += hop) {
+        const void *frame = handle->audio.history;
+        if (handle->decimator.factor > 1) {
+            frame = beat_detection_frame_push(handle, input + (end - hop) * sample_bytes);
+        } else if (end >= fft_size) {
+            frame = input + (end - fft_size) * sample_bytes;
+        } else {
+            memcpy(handle->audio.history + (fft_size - end) * sample_bytes, input, end * sample_bytes);
+        }
+        beat_detection_event_t events[2];
+        int event_num = 0;
+        handle->audio.sample_index = end;
+        beat_detection_result_t result = beat_detection_analyze(handle, frame, events, &event_num);
+        if (result == BEAT_DETECTED) {
+            if (count < max_beats) {
+                beats[count] = end;
+            }
+            count++;
+        } else if (result == BEAT_DETECTION_FAILED) {
+            ret = ESP_FAIL;
+            break;
+        }
+    }
+
+    *beat_count = count;
+    beat_detection_deinit(&handle);
+    return ret;
+}
+
+esp_err_t beat_detection_trace_replay(const beat_detection_trace_header_t *header, const beat_detection_trace_record_t *records, size_t record_count,
+                                      const beat_detection_band_cfg_t *bands, uint64_t *beats, size_t max_beats, size_t *beat_count)
+{
+    if (header == NULL || (records == NULL && record_count > 0) || (beats == NULL && max_beats > 0) || beat_count == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (header->magic != BEAT_DETECTION_TRACE_MAGIC || header->version != BEAT_DETECTION_TRACE_VERSION
+        || header->record_size != sizeof(beat_detection_trace_record_t) || header->band_num == 0 || header->band_num > BEAT_DETECTION_MAX_BANDS) {
+        ESP_LOGE(TAG, "Not a version %d trace", BEAT_DETECTION_TRACE_VERSION);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (header->adaptive) {
+        ESP_LOGE(TAG, "Replay of adaptive threshold traces is not supported");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Every channel keeps its own refractory state, as the right channel detector of DUAL mode does
+    bands = (bands != NULL) ? bands : header->bands;
+    beat_detection_band_t state[2][BEAT_DETECTION_MAX_BANDS];
+    for (int channel = 0; channel < 2; channel++) {
+        for (int b = 0; b < header->band_num; b++) {
+            beat_detection_band_params(&state[channel][b], &bands[b], header->sample_rate, header->power_domain);
+        }
+    }
+
+    // The bands of one frame and channel are consecutive records, the first triggered one makes the beat
+    size_t count = 0;
+    uint64_t beat_sample = UINT64_MAX;
+    uint8_t beat_channel = 0;
+    for (size_t i = 0; i < record_count; i++) {
+        const beat_detection_trace_record_t *record = &records[i];
+        if (record->band >= header->band_num || record->channel > 1) {
+            ESP_LOGE(TAG, "Trace record %u is out of range", (unsigned)i);
+            return ESP_ERR_INVALID_ARG;
+        }
+        beat_detection_band_t *band = &state[record->channel][record->band];
+        bool onset_test = beat_detection_fixed_onset(band, record->current_peak, record->prev_peak, record->current_sum, record->prev_sum);
+        if (!beat_detection_band_trigger(band, onset_test, record->current_peak, record->sample_index)
+            || (record->sample_index == beat_sample && record->channel == beat_channel)) {
+            continue;
+        }
+        if (count < max_beats) {
+            beats[count] = record->sample_index;
+        }
+        count++;
+        beat_sample = record->sample_index;
+        beat_channel = record->channel;
+    }
+    *beat_count = count;
     return ESP_OK;
 }
 
@@ -33,6 +33,7 @@ static const char *TAG = "BEAT_DETECTION_I2S_EXAMPLE";
 #define I2S_BUFFER_SIZE         2048
 
 #define FFT_SIZE                512
+#define HOP_SIZE                128
 
 static beat_detection_handle_t g_beat_detection_handle = NULL;
 
@@ -67,6 +68,10 @@ static esp_err_t beat_detection_init_example(void)
     // 配置 Beat Detection
     beat_detection_cfg_t cfg = BEAT_DETECTION_DEFAULT_CFG();
     cfg.audio_cfg.channel = I2S_CHANNELS;
+    cfg.audio_cfg.fft_size = FFT_SIZE;
+    cfg.audio_cfg.hop_size = HOP_SIZE;
+    cfg.buffer_cfg.frame_num = I2S_BUFFER_SIZE / HOP_SIZE;
+    cfg.flags.write_blocking = true;
     cfg.result_callback = beat_detection_result_callback;
     cfg.result_callback_ctx = NULL;
     cfg.flags.enable_psram = false;
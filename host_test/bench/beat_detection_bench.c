@@ -0,0 +1,930 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file beat_detection_bench.c
+ * @brief Host benchmark for the beat detection component
+ *
+ * Feeds a WAV file, a raw s16le PCM file or a synthetic kick pattern through
+ * beat_detection_data_write() and reports:
+ * 1. Throughput in frames/s and as a multiple of real time
+ * 2. Average and worst time per frame for each processing stage from
+ *    beat_detection_get_stats() (needs CONFIG_BEAT_DETECTION_PROFILE)
+ * 3. End-to-end latency percentiles from data_write() to the result callback
+ * 4. Throughput of the synchronous beat_detection_batch_detect() path
+ * With -i several detectors run concurrently on the same input, all of them
+ * sharing the FFT tables of their common fft_size. With -T the tempo tracker
+ * runs too and its predicted beats are compared with the detected ones.
+ * -w selects how the throughput pass hands audio over: copied by
+ * beat_detection_data_write(), filled in place between
+ * beat_detection_frame_acquire() and beat_detection_frame_commit(), or lent
+ * with beat_detection_data_lend(), or analyzed inline without a task by
+ * beat_detection_process(). -E adds a consumer task that drains the
+ * event ring when notified and checks that it saw every beat. -P splits
+ * every detector into a transform and a decision task on both cores. -D
+ * decimates the input before the analysis, so -n and -p count decimated samples.
+ * -g gates quiet frames past the FFT and reports how many were skipped.
+ * -f widens 16-bit input to 24-in-32 or 32-bit samples before it is fed.
+ * -F exports log-spaced band energies, snapshotted by a reader task on the
+ * other core while the detector runs. -R dumps the decision trace to a file
+ * for host_test/replay while the detector runs.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "esp_err.h"
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "beat_detection.h"
+#include "beat_detection_config.h"
+
+#define BENCH_DEFAULT_LATENCY_FRAMES    2000
+#define BENCH_DEFAULT_SYNTH_SECONDS     60
+#define BENCH_WRITE_CHUNK_SAMPLES       1024
+#define BENCH_EVENT_BATCH               16
+#define BENCH_TRACE_DEPTH               4096
+
+typedef struct {
+    uint8_t     *samples;       // interleaved, in format
+    size_t      frame_count;    // samples per channel
+    uint32_t    sample_rate;
+    uint8_t     channel;
+    beat_detection_sample_format_t format;
+} bench_audio_t;
+
+typedef struct {
+    volatile uint32_t   frames;
+    volatile uint32_t   beats;
+    uint64_t            callback_ns;
+    SemaphoreHandle_t   done;
+    uint64_t            *beat_samples;      // sample_index of the first beat_capacity beats
+    size_t              beat_capacity;
+    uint32_t            band_beats[BEAT_DETECTION_MAX_BANDS];
+    uint64_t            *predictions;       // next_beat_sample of the first beat_capacity predictive callbacks
+    uint32_t            prediction_count;
+    volatile uint32_t   released;           // lent buffers returned by the task
+    uint32_t            channel_beats[2];   // beats per channel in BEAT_DETECTION_CHANNEL_DUAL
+    beat_detection_handle_t handle;         // drained by the consumer task
+    volatile bool       consumer_stop;
+    volatile bool       consumer_done;
+    uint32_t            drained_events;
+    uint32_t            drain_batches;
+    volatile bool       reader_stop;
+    volatile bool       reader_done;
+    uint32_t            snapshots;          // successful beat_detection_get_features() calls
+    uint32_t            feature_frames;     // distinct frames seen by the reader
+    uint32_t            feature_errors;     // snapshots older than the previous one or with a wrong band count
+    FILE                *trace_file;        // written by the trace task
+    volatile bool       tracer_stop;
+    volatile bool       tracer_done;
+    uint32_t            trace_blocks;
+    uint32_t            trace_records;
+} bench_ctx_t;
+
+typedef enum {
+    BENCH_WRITE_COPY = 0,
+    BENCH_WRITE_ACQUIRE,
+    BENCH_WRITE_LEND,
+    BENCH_WRITE_PROCESS,
+} bench_write_mode_t;
+
+/* Kick, snare and hi-hat bands for -m, the kick band is the default bass band */
+static const beat_detection_band_cfg_t bench_bands[] = {
+    { .freq_start = 200, .freq_end = 300, .threshold = 6.0f, .average_ratio = 5.0f, .min_energy = 0.01f, .time_interval = 100 },
+    { .freq_start = 1000, .freq_end = 2000, .threshold = 6.0f, .average_ratio = 5.0f, .min_energy = 0.01f, .time_interval = 100 },
+    { .freq_start = 4000, .freq_end = 7000, .threshold = 6.0f, .average_ratio = 5.0f, .min_energy = 0.01f, .time_interval = 50 },
+};
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void bench_result_callback(beat_detection_result_t result, void *ctx)
+{
+    bench_ctx_t *bench = (bench_ctx_t *)ctx;
+    bench->callback_ns = bench_now_ns();
+    if (result == BEAT_DETECTED) {
+        bench->beats++;
+    }
+    bench->frames++;
+    if (bench->done != NULL) {
+        xSemaphoreGive(bench->done);
+    }
+}
+
+static void bench_event_callback(const beat_detection_event_t *event, void *ctx)
+{
+    bench_ctx_t *bench = (bench_ctx_t *)ctx;
+    for (int b = 0; b < BEAT_DETECTION_MAX_BANDS; b++) {
+        bench->band_beats[b] += (event->band_mask >> b) & 1;
+    }
+    bench->channel_beats[event->channel & 1] += (event->result == BEAT_DETECTED);
+    // Called right after the result callback, which has already counted this beat
+    if (event->result == BEAT_DETECTED && bench->beats <= bench->beat_capacity) {
+        bench->beat_samples[bench->beats - 1] = event->sample_index;
+    }
+}
+
+static void bench_tempo_callback(const beat_detection_tempo_t *tempo, void *ctx)
+{
+    bench_ctx_t *bench = (bench_ctx_t *)ctx;
+    if (bench->prediction_count < bench->beat_capacity) {
+        bench->predictions[bench->prediction_count] = tempo->next_beat_sample;
+    }
+    bench->prediction_count++;
+}
+
+static void bench_release_callback(const uint8_t *audio_buffer, void *ctx)
+{
+    (void)audio_buffer;
+    ((bench_ctx_t *)ctx)->released++;
+}
+
+/* Helper tasks wait here once done, so main can delete and reclaim them before exit */
+static void bench_park(void)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+static void bench_consumer_task(void *arg)
+{
+    bench_ctx_t *bench = (bench_ctx_t *)arg;
+    beat_detection_event_t events[BENCH_EVENT_BATCH];
+    while (!bench->consumer_stop) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+        size_t count = BENCH_EVENT_BATCH;
+        while (bench->handle != NULL && count == BENCH_EVENT_BATCH
+               && beat_detection_event_drain(bench->handle, events, BENCH_EVENT_BATCH, &count) == ESP_OK && count > 0) {
+            bench->drained_events += count;
+            bench->drain_batches++;
+        }
+    }
+    bench->consumer_done = true;
+    bench_park();
+}
+
+/* Stands in for a visualizer on the other core, snapshotting the features as fast as it can */
+static void bench_feature_task(void *arg)
+{
+    bench_ctx_t *bench = (bench_ctx_t *)arg;
+    uint32_t last_sequence = 0;
+    uint64_t last_sample = 0;
+    beat_detection_features_t features;
+    while (!bench->reader_stop) {
+        if (beat_detection_get_features(bench->handle, &features) == ESP_OK) {
+            bench->snapshots++;
+            if (features.sequence < last_sequence || features.sample_index < last_sample
+                || (features.sequence == last_sequence && features.sample_index != last_sample)) {
+                bench->feature_errors++;
+            }
+            bench->feature_frames += (features.sequence != last_sequence);
+            last_sequence = features.sequence;
+            last_sample = features.sample_index;
+        }
+        vTaskDelay(0);
+    }
+    bench->reader_done = true;
+    bench_park();
+}
+
+static esp_err_t bench_trace_write(const void *data, size_t bytes, void *ctx)
+{
+    return (fwrite(data, 1, bytes, (FILE *)ctx) == bytes) ? ESP_OK : ESP_FAIL;
+}
+
+/* Stands in for a UART logger, dumping whatever the trace ring holds every tick */
+static void bench_trace_task(void *arg)
+{
+    bench_ctx_t *bench = (bench_ctx_t *)arg;
+    bool stop = false;
+    while (!stop) {
+        // Read before the dump, so the last pass drains the records of the final frames
+        stop = bench->tracer_stop;
+        size_t count = 0;
+        if (beat_detection_trace_dump(bench->handle, bench_trace_write, bench->trace_file, &count) == ESP_OK && count > 0) {
+            bench->trace_blocks++;
+            bench->trace_records += count;
+        }
+        vTaskDelay(1);
+    }
+    bench->tracer_done = true;
+    bench_park();
+}
+
+static size_t bench_sample_bytes(beat_detection_sample_format_t format)
+{
+    return (format == BEAT_DETECTION_FORMAT_S16) ? sizeof(int16_t) : sizeof(int32_t);
+}
+
+static int bench_load_wav(const uint8_t *data, size_t size, bench_audio_t *audio)
+{
+    beat_detection_wav_info_t info;
+    if (beat_detection_wav_parse(data, size, &info) != ESP_OK) {
+        return -1;
+    }
+    audio->channel = info.channel;
+    audio->sample_rate = info.sample_rate;
+    audio->frame_count = info.sample_count;
+    audio->format = info.format;
+    size_t bytes = info.sample_count * info.channel * bench_sample_bytes(info.format);
+    audio->samples = (uint8_t *)malloc(bytes);
+    if (audio->samples == NULL) {
+        return -1;
+    }
+    memcpy(audio->samples, info.samples, bytes);
+    return 0;
+}
+
+static int bench_load_file(const char *path, bench_audio_t *audio)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = (uint8_t *)malloc(size > 0 ? size : 1);
+    if (data == NULL || fread(data, 1, size, file) != (size_t)size) {
+        fclose(file);
+        free(data);
+        return -1;
+    }
+    fclose(file);
+
+    int ret = 0;
+    if (size >= 12 && memcmp(data, "RIFF", 4) == 0) {
+        ret = bench_load_wav(data, size, audio);
+        free(data);
+    } else {
+        // Raw s16le PCM, format given on the command line
+        audio->samples = data;
+        audio->frame_count = size / (audio->channel * sizeof(int16_t));
+    }
+    return ret;
+}
+
+/* Kick-like 60 ms bursts at 250 Hz on a 120 BPM grid over low-level noise, 30 ms 5 kHz hi-hat ticks on the off-beats */
+static int bench_synthesize(bench_audio_t *audio, int seconds)
+{
+    audio->frame_count = (size_t)audio->sample_rate * seconds;
+    audio->samples = (uint8_t *)malloc(audio->frame_count * audio->channel * sizeof(int16_t));
+    if (audio->samples == NULL) {
+        return -1;
+    }
+    int16_t *samples = (int16_t *)audio->samples;
+    size_t beat_period = audio->sample_rate / 2;
+    size_t burst_len = audio->sample_rate * 60 / 1000;
+    uint32_t seed = 1;
+    for (size_t n = 0; n < audio->frame_count; n++) {
+        seed = seed * 1103515245u + 12345u;
+        float sample = ((float)((seed >> 16) & 0x7fff) / 32768.0f - 0.5f) * 200.0f;
+        float kick = 0.0f;
+        size_t phase = n % beat_period;
+        if (phase < burst_len) {
+            float envelope = expf(-(float)phase / (float)(burst_len / 4));
+            kick = 12000.0f * envelope * sinf(2.0f * (float)M_PI * 250.0f * (float)n / (float)audio->sample_rate);
+        }
+        // In stereo every second kick is panned hard left
+        bool left_only = (n / beat_period) % 2 == 1;
+        size_t hat_phase = (n + beat_period / 2) % beat_period;
+        if (hat_phase < burst_len / 2 && audio->sample_rate > 10000) {
+            float envelope = expf(-(float)hat_phase / (float)(burst_len / 8));
+            sample += 3000.0f * envelope * sinf(2.0f * (float)M_PI * 5000.0f * (float)n / (float)audio->sample_rate);
+        }
+        for (int c = 0; c < audio->channel; c++) {
+            samples[n * audio->channel + c] = (int16_t)(sample + ((c == 0 || !left_only) ? kick : 0.0f));
+        }
+    }
+    return 0;
+}
+
+/*
+ * Widen 16-bit input to a 32-bit word format. 24-in-32 words get a zero upper byte, so the
+ * detector has to ignore it rather than rely on sign extension.
+ */
+static int bench_widen(bench_audio_t *audio, beat_detection_sample_format_t format)
+{
+    if (format == audio->format) {
+        return 0;
+    }
+    if (audio->format != BEAT_DETECTION_FORMAT_S16 || format == BEAT_DETECTION_FORMAT_S16) {
+        fprintf(stderr, "only 16-bit input can be converted\n");
+        return -1;
+    }
+    size_t count = audio->frame_count * audio->channel;
+    int32_t *wide = (int32_t *)malloc(count * sizeof(int32_t));
+    if (wide == NULL) {
+        return -1;
+    }
+    const int16_t *samples = (const int16_t *)audio->samples;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t word = (uint32_t)(int32_t)samples[i];
+        wide[i] = (int32_t)((format == BEAT_DETECTION_FORMAT_S32) ? word << 16 : (word << 8) & 0x00ffffffu);
+    }
+    free(audio->samples);
+    audio->samples = (uint8_t *)wide;
+    audio->format = format;
+    return 0;
+}
+
+static const char *bench_format_names[] = { "s16", "s24", "s32" };
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static const char *bench_engine_name(beat_detection_engine_t engine)
+{
+    switch (engine) {
+    case BEAT_DETECTION_ENGINE_COMPLEX_FFT:
+        return "complex";
+    case BEAT_DETECTION_ENGINE_REAL_FFT:
+        return "real";
+    case BEAT_DETECTION_ENGINE_GOERTZEL:
+        return "goertzel";
+    case BEAT_DETECTION_ENGINE_FFT_Q15:
+        return "q15";
+    default:
+        return "unknown";
+    }
+}
+
+static int bench_parse_engine(const char *name, beat_detection_engine_t *engine)
+{
+    for (int e = BEAT_DETECTION_ENGINE_COMPLEX_FFT; e <= BEAT_DETECTION_ENGINE_FFT_Q15; e++) {
+        if (strcmp(name, bench_engine_name((beat_detection_engine_t)e)) == 0) {
+            *engine = (beat_detection_engine_t)e;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static const char *bench_channel_mode_names[] = { "right", "left", "mid", "max", "dual" };
+
+static int bench_parse_channel_mode(const char *name, beat_detection_channel_mode_t *mode)
+{
+    for (int m = BEAT_DETECTION_CHANNEL_RIGHT; m <= BEAT_DETECTION_CHANNEL_DUAL; m++) {
+        if (strcmp(name, bench_channel_mode_names[m]) == 0) {
+            *mode = (beat_detection_channel_mode_t)m;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void bench_usage(const char *prog)
+{
+    printf("Usage: %s [options] [input.wav|input.pcm]\n"
+           "  -e ENGINE   complex | real | goertzel | q15 (default complex)\n"
+           "  -n SIZE     FFT size (default %d)\n"
+           "  -p HOP      hop size, 0 = one frame per write (default fft/4)\n"
+           "  -r RATE     sample rate of raw PCM / synthetic input (default %d)\n"
+           "  -c CH       channels of raw PCM / synthetic input (default 1)\n"
+           "  -l LOOPS    times to replay the input (default 1)\n"
+           "  -s SECONDS  length of the synthetic input (default %d)\n"
+           "  -q FRAMES   frames used for the latency measurement (default %d)\n"
+           "  -v          verify the engine against the complex FFT path\n"
+           "  -t          print the beat timestamps found by the batch path\n"
+           "  -i COUNT    detectors running concurrently on the input (default 1)\n"
+           "  -m          detect kick, snare and hi-hat bands instead of the bass band\n"
+           "  -T          track the tempo and report the predicted beats\n"
+           "  -w MODE     copy | acquire | lend | process, how audio is handed over (default copy)\n"
+           "  -x MODE     right | left | mid | max | dual, stereo channel mode (default right)\n"
+           "  -E DEPTH    deliver beats through an event ring of DEPTH entries to a consumer task\n"
+           "  -a K        adaptive spectral flux threshold at mean + K * sigma\n"
+           "  -W          run the measured detector from a caller workspace instead of the heap\n"
+           "  -P          pipeline convert + FFT and magnitude + decision on two cores\n"
+           "  -D FACTOR   low-pass and decimate the input by FACTOR before the analysis\n"
+           "  -g LEVEL    skip the FFT of frames below LEVEL RMS, reopening above twice the level\n"
+           "  -f FORMAT   s16 | s24 | s32, sample format fed to the detector (default that of the input)\n"
+           "  -F BANDS    export BANDS log-spaced band energies to a reader task on the other core\n"
+           "  -R FILE     dump the decision trace to FILE for beat_detection_replay\n",
+           prog, BEAT_DETECTION_DEFAULT_FFT_SIZE, BEAT_DETECTION_DEFAULT_SAMPLE_RATE,
+           BENCH_DEFAULT_SYNTH_SECONDS, BENCH_DEFAULT_LATENCY_FRAMES);
+}
+
+int main(int argc, char **argv)
+{
+    beat_detection_cfg_t cfg = BEAT_DETECTION_DEFAULT_CFG();
+    bench_audio_t audio = {
+        .sample_rate = BEAT_DETECTION_DEFAULT_SAMPLE_RATE,
+        .channel = 1,
+    };
+    int hop_size = -1;
+    int loops = 1;
+    int synth_seconds = BENCH_DEFAULT_SYNTH_SECONDS;
+    int latency_frames = BENCH_DEFAULT_LATENCY_FRAMES;
+    bool print_beats = false;
+    int instances = 1;
+    bench_write_mode_t write_mode = BENCH_WRITE_COPY;
+    bool use_workspace = false;
+    int format = -1;
+    const char *trace_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "e:n:p:r:c:l:s:q:vti:mTw:x:E:a:WPD:g:f:F:R:h")) != -1) {
+        switch (opt) {
+        case 'e':
+            if (bench_parse_engine(optarg, &cfg.audio_cfg.engine) != 0) {
+                fprintf(stderr, "unknown engine '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            cfg.audio_cfg.fft_size = (int16_t)atoi(optarg);
+            break;
+        case 'p':
+            hop_size = atoi(optarg);
+            break;
+        case 'r':
+            audio.sample_rate = (uint32_t)atoi(optarg);
+            break;
+        case 'c':
+            audio.channel = (uint8_t)atoi(optarg);
+            break;
+        case 'l':
+            loops = atoi(optarg);
+            break;
+        case 's':
+            synth_seconds = atoi(optarg);
+            break;
+        case 'q':
+            latency_frames = atoi(optarg);
+            break;
+        case 'v':
+            cfg.flags.verify_engine = true;
+            break;
+        case 't':
+            print_beats = true;
+            break;
+        case 'i':
+            instances = atoi(optarg);
+            break;
+        case 'm':
+            cfg.audio_cfg.band_num = sizeof(bench_bands) / sizeof(bench_bands[0]);
+            cfg.audio_cfg.bands = bench_bands;
+            break;
+        case 'T':
+            cfg.flags.tempo_tracking = true;
+            break;
+        case 'W':
+            use_workspace = true;
+            break;
+        case 'P':
+            cfg.flags.pipeline = true;
+            break;
+        case 'D':
+            cfg.audio_cfg.decimation = (uint8_t)atoi(optarg);
+            break;
+        case 'g':
+            cfg.flags.silence_gate = true;
+            cfg.gate_cfg.close_level = (float)atof(optarg);
+            cfg.gate_cfg.open_level = 2.0f * cfg.gate_cfg.close_level;
+            break;
+        case 'f':
+            for (int f = BEAT_DETECTION_FORMAT_S16; f <= BEAT_DETECTION_FORMAT_S32; f++) {
+                format = (strcmp(optarg, bench_format_names[f]) == 0) ? f : format;
+            }
+            if (format < 0) {
+                fprintf(stderr, "unknown sample format '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'F':
+            cfg.feature_cfg.band_num = (uint8_t)atoi(optarg);
+            break;
+        case 'R':
+            trace_path = optarg;
+            cfg.trace_cfg.depth = BENCH_TRACE_DEPTH;
+            break;
+        case 'a':
+            cfg.flags.adaptive_threshold = true;
+            cfg.adaptive_cfg.k = (float)atof(optarg);
+            break;
+        case 'w':
+            if (strcmp(optarg, "copy") == 0) {
+                write_mode = BENCH_WRITE_COPY;
+            } else if (strcmp(optarg, "acquire") == 0) {
+                write_mode = BENCH_WRITE_ACQUIRE;
+            } else if (strcmp(optarg, "lend") == 0) {
+                write_mode = BENCH_WRITE_LEND;
+            } else if (strcmp(optarg, "process") == 0) {
+                write_mode = BENCH_WRITE_PROCESS;
+            } else {
+                fprintf(stderr, "unknown write mode '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'E':
+            cfg.event_queue_cfg.depth = (uint16_t)atoi(optarg);
+            break;
+        case 'x':
+            if (bench_parse_channel_mode(optarg, &cfg.audio_cfg.channel_mode) != 0) {
+                fprintf(stderr, "unknown channel mode '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            bench_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    const char *input = (optind < argc) ? argv[optind] : NULL;
+    if ((input != NULL ? bench_load_file(input, &audio) : bench_synthesize(&audio, synth_seconds)) != 0) {
+        fprintf(stderr, "failed to load input\n");
+        return 1;
+    }
+    if (format >= 0 && bench_widen(&audio, (beat_detection_sample_format_t)format) != 0) {
+        return 1;
+    }
+
+    cfg.audio_cfg.sample_rate = audio.sample_rate;
+    cfg.audio_cfg.channel = audio.channel;
+    cfg.audio_cfg.format = audio.format;
+    cfg.audio_cfg.hop_size = (int16_t)((hop_size < 0) ? cfg.audio_cfg.fft_size / 4 : hop_size);
+    cfg.buffer_cfg.frame_num = 16;
+    cfg.flags.write_blocking = true;
+    cfg.buffer_cfg.write_timeout_ms = 1000;
+    cfg.flags.synchronous = (write_mode == BENCH_WRITE_PROCESS);
+    // Input samples per channel of one hop, or of one frame with hop 0
+    size_t step = (size_t)(cfg.audio_cfg.hop_size > 0 ? cfg.audio_cfg.hop_size : cfg.audio_cfg.fft_size)
+                  * (cfg.audio_cfg.decimation > 1 ? cfg.audio_cfg.decimation : 1);
+
+    printf("input      : %s, %u Hz, %s, %u ch (%s), %.1f s\n", input != NULL ? input : "synthetic",
+           (unsigned)audio.sample_rate, bench_format_names[audio.format], audio.channel, audio.channel == 2 ? bench_channel_mode_names[cfg.audio_cfg.channel_mode] : "mono",
+           (double)audio.frame_count / audio.sample_rate);
+    static const char *write_mode_names[] = { "copy", "acquire", "lend", "process" };
+    printf("detector   : engine %s, fft %d, hop %d, decimation %d, write %s, layout %s%s\n", bench_engine_name(cfg.audio_cfg.engine),
+           cfg.audio_cfg.fft_size, cfg.audio_cfg.hop_size, cfg.audio_cfg.decimation > 1 ? cfg.audio_cfg.decimation : 1, write_mode_names[write_mode],
+           CONFIG_BEAT_DETECTION_FIXED_LAYOUT ? "fixed" : "runtime", cfg.flags.pipeline ? ", pipeline" : "");
+
+    /* Throughput: stream the whole input as fast as the detector accepts it */
+    bench_ctx_t bench = { 0 };
+    bench.beat_capacity = audio.frame_count / step + 1;
+    bench.beat_samples = (uint64_t *)calloc(bench.beat_capacity, sizeof(uint64_t));
+    bench.predictions = (uint64_t *)calloc(bench.beat_capacity, sizeof(uint64_t));
+    if (bench.beat_samples == NULL || bench.predictions == NULL) {
+        return 1;
+    }
+    cfg.result_callback = bench_result_callback;
+    cfg.result_callback_ctx = &bench;
+    cfg.event_callback = bench_event_callback;
+    cfg.tempo_callback = bench_tempo_callback;
+    TaskHandle_t consumer = NULL;
+    if (cfg.event_queue_cfg.depth > 0) {
+        // Woken after 4 beats or 100 ms, whichever comes first
+        xTaskCreatePinnedToCore(bench_consumer_task, "bench_consumer", 4096, &bench, 2, &consumer, 0);
+        cfg.event_queue_cfg.notify_task = consumer;
+        cfg.event_queue_cfg.notify_count = 4;
+        cfg.event_queue_cfg.notify_timeout_ms = 100;
+    }
+    beat_detection_handle_t handle = NULL;
+    void *workspace = NULL;
+    if (use_workspace) {
+        size_t workspace_size = 0;
+        if (beat_detection_get_workspace_size(&cfg, &workspace_size) != ESP_OK) {
+            fprintf(stderr, "beat_detection_get_workspace_size failed\n");
+            return 1;
+        }
+        workspace = aligned_alloc(BEAT_DETECTION_WORKSPACE_ALIGN, (workspace_size + BEAT_DETECTION_WORKSPACE_ALIGN - 1) & ~(size_t)(BEAT_DETECTION_WORKSPACE_ALIGN - 1));
+        if (workspace == NULL) {
+            return 1;
+        }
+        // One byte less must not fit, otherwise the reported size is larger than needed
+        bool exact = beat_detection_init_static(&cfg, workspace, workspace_size - 1, &handle) == ESP_ERR_NO_MEM;
+        if (beat_detection_init_static(&cfg, workspace, workspace_size, &handle) != ESP_OK) {
+            fprintf(stderr, "beat_detection_init_static failed\n");
+            return 1;
+        }
+        printf("workspace  : %u bytes, %s\n", (unsigned)workspace_size, exact ? "exact" : "oversized");
+    } else if (beat_detection_init(&cfg, &handle) != ESP_OK) {
+        fprintf(stderr, "beat_detection_init failed\n");
+        return 1;
+    }
+    bench.handle = handle;
+    TaskHandle_t reader = NULL;
+    if (cfg.feature_cfg.band_num > 0) {
+        xTaskCreatePinnedToCore(bench_feature_task, "bench_features", 4096, &bench, 2, &reader, 1 % CONFIG_FREERTOS_NUMBER_OF_CORES);
+    }
+    TaskHandle_t tracer = NULL;
+    if (trace_path != NULL) {
+        bench.trace_file = fopen(trace_path, "wb");
+        if (bench.trace_file == NULL) {
+            fprintf(stderr, "cannot create %s\n", trace_path);
+            return 1;
+        }
+        xTaskCreatePinnedToCore(bench_trace_task, "bench_trace", 4096, &bench, 2, &tracer, 1 % CONFIG_FREERTOS_NUMBER_OF_CORES);
+    }
+
+    /* Extra detectors only count frames and beats, the first one is measured in detail */
+    int extra_count = (instances > 1) ? instances - 1 : 0;
+    beat_detection_handle_t *extra = (beat_detection_handle_t *)calloc(extra_count + 1, sizeof(beat_detection_handle_t));
+    bench_ctx_t *extra_bench = (bench_ctx_t *)calloc(extra_count + 1, sizeof(bench_ctx_t));
+    if (extra == NULL || extra_bench == NULL) {
+        return 1;
+    }
+    for (int i = 0; i < extra_count; i++) {
+        beat_detection_cfg_t extra_cfg = cfg;
+        extra_cfg.result_callback_ctx = &extra_bench[i];
+        extra_cfg.event_callback = NULL;
+        extra_cfg.tempo_callback = NULL;
+        extra_cfg.event_queue_cfg.depth = 0;
+        extra_cfg.trace_cfg.depth = 0;
+        extra_cfg.flags.synchronous = false;
+        extra_cfg.task_cfg.core_id = i % CONFIG_FREERTOS_NUMBER_OF_CORES;
+        if (beat_detection_init(&extra_cfg, &extra[i]) != ESP_OK) {
+            fprintf(stderr, "beat_detection_init failed for detector %d\n", i + 2);
+            return 1;
+        }
+    }
+
+    size_t sample_bytes = audio.channel * bench_sample_bytes(audio.format);
+    size_t chunk = (cfg.audio_cfg.hop_size > 0) ? BENCH_WRITE_CHUNK_SAMPLES : step;
+    if (write_mode == BENCH_WRITE_ACQUIRE && cfg.audio_cfg.hop_size > 0) {
+        // An acquired frame is exactly one hop
+        chunk = step;
+    } else if ((write_mode == BENCH_WRITE_LEND || write_mode == BENCH_WRITE_PROCESS) && cfg.audio_cfg.hop_size > 0) {
+        chunk -= chunk % step;
+        chunk = (chunk > 0) ? chunk : step;
+    }
+    uint32_t expected = 0;
+    uint64_t start_ns = bench_now_ns();
+    for (int loop = 0; loop < loops; loop++) {
+        for (size_t pos = 0; pos + chunk <= audio.frame_count; pos += chunk) {
+            beat_detection_audio_buffer_t buffer = {
+                .audio_buffer = audio.samples + pos * sample_bytes,
+                .bytes_size = chunk * sample_bytes,
+            };
+            esp_err_t err = ESP_OK;
+            if (write_mode == BENCH_WRITE_ACQUIRE) {
+                // Stands in for an I2S read straight into the ring frame
+                uint8_t *frame = NULL;
+                size_t frame_bytes = 0;
+                err = beat_detection_frame_acquire(handle, &frame, &frame_bytes);
+                if (err == ESP_OK) {
+                    memcpy(frame, buffer.audio_buffer, frame_bytes);
+                    err = beat_detection_frame_commit(handle, frame);
+                }
+            } else if (write_mode == BENCH_WRITE_LEND) {
+                err = beat_detection_data_lend(handle, buffer, bench_release_callback, &bench);
+            } else if (write_mode == BENCH_WRITE_PROCESS) {
+                err = beat_detection_process(handle, buffer, NULL);
+            } else {
+                err = beat_detection_data_write(handle, buffer);
+            }
+            if (err == ESP_OK) {
+                expected = (cfg.audio_cfg.hop_size > 0) ? expected : expected + 1;
+            }
+            for (int i = 0; i < extra_count; i++) {
+                beat_detection_data_write(extra[i], buffer);
+            }
+        }
+    }
+    if (cfg.audio_cfg.hop_size > 0) {
+        expected = (uint32_t)((audio.frame_count / chunk) * chunk * loops / step);
+    }
+    while (bench.frames < expected) {
+        vTaskDelay(1);
+    }
+    uint64_t end_ns = bench.callback_ns;
+    uint32_t beats_mismatch = 0;
+    for (int i = 0; i < extra_count; i++) {
+        while (extra_bench[i].frames < expected) {
+            vTaskDelay(1);
+        }
+        end_ns = (extra_bench[i].callback_ns > end_ns) ? extra_bench[i].callback_ns : end_ns;
+        beats_mismatch += (extra_bench[i].beats != bench.beats);
+        beat_detection_deinit(&extra[i]);
+    }
+    uint64_t elapsed_ns = end_ns - start_ns;
+
+    uint32_t overruns = 0;
+    beat_detection_get_overrun_count(handle, &overruns);
+    double seconds = (double)elapsed_ns / 1e9;
+    double audio_seconds = (double)expected * step / audio.sample_rate;
+    printf("frames     : %u analyzed, %u beats, %u overruns\n", (unsigned)bench.frames, (unsigned)bench.beats, (unsigned)overruns);
+    if (write_mode == BENCH_WRITE_LEND) {
+        printf("lend       : %u buffers returned\n", (unsigned)bench.released);
+    }
+    if (consumer != NULL) {
+        bench.consumer_stop = true;
+        while (!bench.consumer_done) {
+            vTaskDelay(1);
+        }
+        beat_detection_stats_t event_stats;
+        beat_detection_get_stats(handle, &event_stats, NULL);
+        printf("events     : %u drained in %u batches, %u dropped\n", (unsigned)bench.drained_events,
+               (unsigned)bench.drain_batches, (unsigned)event_stats.events_dropped);
+    }
+    if (reader != NULL) {
+        bench.reader_stop = true;
+        while (!bench.reader_done) {
+            vTaskDelay(1);
+        }
+        beat_detection_features_t features;
+        if (beat_detection_get_features(handle, &features) == ESP_OK) {
+            printf("features   : %u bands, %u snapshots of %u distinct frames out of %u published, %u inconsistent\n",
+                   features.band_num, (unsigned)bench.snapshots, (unsigned)bench.feature_frames, (unsigned)features.sequence,
+                   (unsigned)bench.feature_errors);
+            // Last frame of the input, in dB below its loudest band
+            float peak = 1e-12f;
+            for (int b = 0; b < features.band_num; b++) {
+                peak = fmaxf(peak, features.bands[b]);
+            }
+            printf("spectrum   :");
+            for (int b = 0; b < features.band_num; b++) {
+                printf(" %ld", lrint(20.0 * log10((features.bands[b] + 1e-12f) / peak)));
+            }
+            printf(" dB\n");
+        }
+    }
+    if (tracer != NULL) {
+        bench.tracer_stop = true;
+        while (!bench.tracer_done) {
+            vTaskDelay(1);
+        }
+        fclose(bench.trace_file);
+        // One record per band of every frame, per channel in dual mode
+        uint32_t produced = bench.frames * (cfg.audio_cfg.band_num > 0 ? cfg.audio_cfg.band_num : 1)
+                            * (audio.channel == 2 && cfg.audio_cfg.channel_mode == BEAT_DETECTION_CHANNEL_DUAL ? 2 : 1);
+        printf("trace      : %u records in %u blocks written to %s, %u dropped\n", (unsigned)bench.trace_records,
+               (unsigned)bench.trace_blocks, trace_path, (unsigned)(produced - bench.trace_records));
+    }
+    if (audio.channel == 2 && cfg.audio_cfg.channel_mode == BEAT_DETECTION_CHANNEL_DUAL) {
+        printf("channels   : left %u, right %u beats\n", (unsigned)bench.channel_beats[0], (unsigned)bench.channel_beats[1]);
+    }
+    if (cfg.audio_cfg.band_num > 0) {
+        printf("bands      :");
+        for (int b = 0; b < cfg.audio_cfg.band_num; b++) {
+            printf(" %u-%u Hz %u,", cfg.audio_cfg.bands[b].freq_start, cfg.audio_cfg.bands[b].freq_end, (unsigned)bench.band_beats[b]);
+        }
+        printf(" onsets\n");
+    }
+    printf("throughput : %.0f frames/s, %.1fx real time\n", bench.frames * instances / seconds, audio_seconds * instances / seconds);
+    if (extra_count > 0) {
+        printf("instances  : %d detectors, %u disagree with the first on the beat count\n", instances, (unsigned)beats_mismatch);
+    }
+    free(extra);
+    free(extra_bench);
+
+    beat_detection_stats_t stats;
+    beat_detection_get_stats(handle, &stats, NULL);
+    printf("stats      : %u frames in, %u processed, dropped %u ring full / %u lend full / %u invalid, queue high water %u\n",
+           (unsigned)stats.frames_in, (unsigned)stats.frames_processed, (unsigned)stats.dropped[BEAT_DETECTION_DROP_RING_FULL],
+           (unsigned)stats.dropped[BEAT_DETECTION_DROP_LEND_FULL], (unsigned)stats.dropped[BEAT_DETECTION_DROP_INVALID],
+           (unsigned)stats.queue_high_water);
+    if (cfg.flags.silence_gate) {
+        printf("gate       : %u of %u frames skipped the FFT\n", (unsigned)stats.frames_gated, (unsigned)stats.frames_processed);
+    }
+#if CONFIG_BEAT_DETECTION_PROFILE
+    static const char *stage_names[BEAT_DETECTION_STAGE_MAX] = { "convert", "fft", "magnitude", "decision", "callback" };
+    uint64_t total = 0;
+    printf("stage      :");
+    for (int stage = 0; stage < BEAT_DETECTION_STAGE_MAX; stage++) {
+        total += stats.cycles[stage].avg;
+        printf(" %s %u ns,", stage_names[stage], (unsigned)stats.cycles[stage].avg);
+    }
+    printf(" total %u ns per frame\n", (unsigned)total);
+    printf("stage max  :");
+    for (int stage = 0; stage < BEAT_DETECTION_STAGE_MAX; stage++) {
+        printf(" %s %u ns%s", stage_names[stage], (unsigned)stats.cycles[stage].max, stage + 1 < BEAT_DETECTION_STAGE_MAX ? "," : "\n");
+    }
+#endif
+
+    if (cfg.flags.verify_engine) {
+        beat_detection_verify_result_t verify;
+        beat_detection_get_verify_result(handle, &verify);
+        printf("verify     : %u frames, %u exact, max abs error %g, max rel error %g\n", (unsigned)verify.frame_count,
+               (unsigned)verify.exact_frame_count, verify.max_abs_error, verify.max_rel_error);
+    }
+    if (cfg.flags.tempo_tracking) {
+        beat_detection_tempo_t tempo;
+        beat_detection_get_tempo(handle, &tempo);
+        // Distance of every prediction to the closest detected beat
+        double error_sum = 0.0;
+        size_t stored = (bench.beats < bench.beat_capacity) ? bench.beats : bench.beat_capacity;
+        size_t predictions = (bench.prediction_count < bench.beat_capacity) ? bench.prediction_count : bench.beat_capacity;
+        for (size_t p = 0; p < predictions && stored > 0; p++) {
+            double best = INFINITY;
+            for (size_t i = 0; i < stored; i++) {
+                double error = fabs((double)bench.predictions[p] - (double)bench.beat_samples[i]);
+                best = (error < best) ? error : best;
+            }
+            error_sum += best;
+        }
+        printf("tempo      : %.1f BPM, confidence %.2f, %u predicted beats, mean error %.1f ms\n",
+               tempo.bpm, tempo.confidence, (unsigned)bench.prediction_count,
+               predictions > 0 ? error_sum / predictions * 1000.0 / audio.sample_rate : 0.0);
+    }
+    beat_detection_deinit(&handle);
+    free(workspace);
+    // After deinit, so the detection task can no longer notify the consumer
+    TaskHandle_t helpers[] = { consumer, reader, tracer };
+    for (size_t i = 0; i < sizeof(helpers) / sizeof(helpers[0]); i++) {
+        if (helpers[i] != NULL) {
+            vTaskDelete(helpers[i]);
+        }
+    }
+
+    /* Batch: the whole input in one synchronous call, first pass only sizes the result */
+    size_t beat_count = 0;
+    cfg.flags.verify_engine = false;
+    uint64_t batch_start_ns = bench_now_ns();
+    if (beat_detection_batch_detect(&cfg, audio.samples, audio.frame_count, NULL, 0, &beat_count) != ESP_OK) {
+        fprintf(stderr, "beat_detection_batch_detect failed\n");
+        return 1;
+    }
+    double batch_seconds = (double)(bench_now_ns() - batch_start_ns) / 1e9;
+    printf("batch      : %u beats, %.1fx real time\n", (unsigned)beat_count,
+           (double)audio.frame_count / audio.sample_rate / batch_seconds);
+    if (beat_count > 0) {
+        uint64_t *beats = (uint64_t *)malloc(beat_count * sizeof(uint64_t));
+        if (beats != NULL && beat_detection_batch_detect(&cfg, audio.samples, audio.frame_count, beats, beat_count, &beat_count) == ESP_OK) {
+            // The streamed pass skipped the tail that did not fill a write chunk, so compare the first loop up to there
+            uint64_t streamed = (uint64_t)(audio.frame_count / chunk) * chunk;
+            size_t compared = 0;
+            size_t matched = 0;
+            for (size_t i = 0; i < beat_count && beats[i] <= streamed; i++) {
+                compared++;
+                matched += (i < bench.beats && i < bench.beat_capacity && bench.beat_samples[i] == beats[i]);
+            }
+            printf("timestamps : %u of %u batch beats match the streamed events\n", (unsigned)matched, (unsigned)compared);
+            for (size_t i = 0; print_beats && i < beat_count; i++) {
+                printf("beat       : %llu samples, %.3f s\n", (unsigned long long)beats[i], (double)beats[i] / audio.sample_rate);
+            }
+        }
+        free(beats);
+    }
+
+    /* Latency: write one hop at a time and wait for its callback, which process() runs before returning */
+    size_t latency_chunk = step;
+    if ((size_t)latency_frames > audio.frame_count / latency_chunk) {
+        latency_frames = (int)(audio.frame_count / latency_chunk);
+    }
+    if (latency_frames <= 0) {
+        free(bench.beat_samples);
+        free(bench.predictions);
+        free(audio.samples);
+        return 0;
+    }
+    bench_ctx_t latency_bench = { 0 };
+    latency_bench.done = xSemaphoreCreateBinary();
+    cfg.result_callback_ctx = &latency_bench;
+    cfg.event_callback = NULL;
+    cfg.tempo_callback = NULL;
+    cfg.event_queue_cfg.depth = 0;
+    cfg.trace_cfg.depth = 0;
+    if (beat_detection_init(&cfg, &handle) != ESP_OK) {
+        fprintf(stderr, "beat_detection_init failed\n");
+        return 1;
+    }
+    uint64_t *latency = (uint64_t *)malloc(latency_frames * sizeof(uint64_t));
+    for (int i = 0; i < latency_frames; i++) {
+        beat_detection_audio_buffer_t buffer = {
+            .audio_buffer = audio.samples + i * latency_chunk * sample_bytes,
+            .bytes_size = latency_chunk * sample_bytes,
+        };
+        uint64_t write_ns = bench_now_ns();
+        if (write_mode == BENCH_WRITE_PROCESS) {
+            beat_detection_process(handle, buffer, NULL);
+        } else {
+            beat_detection_data_write(handle, buffer);
+        }
+        xSemaphoreTake(latency_bench.done, portMAX_DELAY);
+        latency[i] = latency_bench.callback_ns - write_ns;
+    }
+    beat_detection_deinit(&handle);
+    vSemaphoreDelete(latency_bench.done);
+
+    qsort(latency, latency_frames, sizeof(uint64_t), bench_compare_u64);
+    printf("latency    : n %d, p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n", latency_frames,
+           latency[latency_frames / 2] / 1e3, latency[latency_frames * 9 / 10] / 1e3,
+           latency[latency_frames * 99 / 100] / 1e3, latency[latency_frames - 1] / 1e3);
+
+    free(latency);
+    free(bench.beat_samples);
+    free(bench.predictions);
+    free(audio.samples);
+    return 0;
+}
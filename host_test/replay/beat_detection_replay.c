@@ -0,0 +1,373 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file beat_detection_replay.c
+ * @brief Host replay of a beat detection decision trace
+ *
+ * Loads a trace written by beat_detection_trace_dump() (over a UART, to a
+ * file, or by the bench with -R) and re-runs the band decision over it with
+ * beat_detection_trace_replay(), without any spectral analysis:
+ * 1. The captured settings are replayed first and the beats compared with the
+ *    decisions the detector recorded, which must agree when nothing was dropped
+ * 2. -t, -a, -m and -i sweep threshold, average_ratio, min_energy and
+ *    time_interval of one band over MIN:MAX:STEP ranges, every combination is
+ *    replayed and the best sets are listed by F-measure
+ * The reference beats are read from a label file with -l (one time in seconds
+ * per line, Audacity label exports work as they are), otherwise the captured
+ * decisions serve as the reference and the score shows how far a set moves
+ * away from them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "esp_err.h"
+#include "beat_detection.h"
+
+#define REPLAY_DEFAULT_TOLERANCE_MS     50
+#define REPLAY_DEFAULT_TOP              10
+
+typedef struct {
+    beat_detection_trace_header_t   header;         // first block's, the settings of the capture
+    beat_detection_trace_record_t   *records;       // records of all blocks in stream order
+    size_t                          record_count;
+    uint32_t                        blocks;
+    uint32_t                        gaps;           // records missing according to the sequence numbers
+} replay_trace_t;
+
+typedef struct {
+    float       min;
+    float       max;
+    float       step;
+    bool        set;
+} replay_range_t;
+
+typedef struct {
+    beat_detection_band_cfg_t   band;
+    size_t                      beats;
+    size_t                      matched;
+    float                       f_measure;
+} replay_result_t;
+
+static uint64_t replay_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Concatenates the records of every block, the blocks must come from one detector */
+static int replay_load_trace(const char *path, replay_trace_t *trace)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    beat_detection_trace_header_t header;
+    size_t capacity = 0;
+    uint32_t next_sequence = 0;
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        if (header.magic != BEAT_DETECTION_TRACE_MAGIC || header.version != BEAT_DETECTION_TRACE_VERSION
+            || header.record_size != sizeof(beat_detection_trace_record_t)) {
+            fprintf(stderr, "%s: block %u is not a version %d trace block\n", path, (unsigned)trace->blocks, BEAT_DETECTION_TRACE_VERSION);
+            fclose(file);
+            return -1;
+        }
+        if (trace->blocks == 0) {
+            trace->header = header;
+        } else if (header.sample_rate != trace->header.sample_rate || header.band_num != trace->header.band_num
+                   || header.power_domain != trace->header.power_domain || header.adaptive != trace->header.adaptive) {
+            fprintf(stderr, "%s: block %u comes from another detector\n", path, (unsigned)trace->blocks);
+            fclose(file);
+            return -1;
+        }
+        if (trace->record_count + header.record_count > capacity) {
+            capacity = (trace->record_count + header.record_count) * 2;
+            beat_detection_trace_record_t *records = (beat_detection_trace_record_t *)realloc(trace->records, capacity * sizeof(beat_detection_trace_record_t));
+            if (records == NULL) {
+                fclose(file);
+                return -1;
+            }
+            trace->records = records;
+        }
+        beat_detection_trace_record_t *block = trace->records + trace->record_count;
+        if (fread(block, sizeof(beat_detection_trace_record_t), header.record_count, file) != header.record_count) {
+            fprintf(stderr, "%s: block %u is truncated\n", path, (unsigned)trace->blocks);
+            fclose(file);
+            return -1;
+        }
+        for (uint32_t i = 0; i < header.record_count; i++) {
+            trace->gaps += block[i].sequence - next_sequence;
+            next_sequence = block[i].sequence + 1;
+        }
+        trace->record_count += header.record_count;
+        trace->blocks++;
+    }
+    fclose(file);
+    if (trace->blocks == 0) {
+        fprintf(stderr, "%s: no trace blocks\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/* First number of every line in seconds, lines without one are skipped */
+static int replay_load_labels(const char *path, uint32_t sample_rate, uint64_t **labels, size_t *count)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    size_t capacity = 0;
+    char line[256];
+    *count = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *end = NULL;
+        double seconds = strtod(line, &end);
+        if (end == line || seconds < 0.0) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity = (capacity > 0) ? capacity * 2 : 256;
+            uint64_t *grown = (uint64_t *)realloc(*labels, capacity * sizeof(uint64_t));
+            if (grown == NULL) {
+                fclose(file);
+                return -1;
+            }
+            *labels = grown;
+        }
+        (*labels)[(*count)++] = (uint64_t)(seconds * sample_rate + 0.5);
+    }
+    fclose(file);
+    return 0;
+}
+
+static int replay_parse_range(const char *arg, replay_range_t *range)
+{
+    if (sscanf(arg, "%f:%f:%f", &range->min, &range->max, &range->step) != 3 || range->step <= 0.0f || range->max < range->min) {
+        return -1;
+    }
+    range->set = true;
+    return 0;
+}
+
+/* Number of values of a range, the captured value alone when it was not given */
+static int replay_range_count(const replay_range_t *range)
+{
+    return range->set ? (int)((range->max - range->min) / range->step + 1.0001f) : 1;
+}
+
+static float replay_range_value(const replay_range_t *range, int index, float captured)
+{
+    return range->set ? range->min + range->step * (float)index : captured;
+}
+
+/* Greedy matching of two sorted beat lists, each reference beat matches at most one detected beat */
+static size_t replay_match(const uint64_t *beats, size_t beat_count, const uint64_t *reference, size_t reference_count, uint64_t tolerance)
+{
+    size_t matched = 0;
+    size_t r = 0;
+    for (size_t i = 0; i < beat_count && r < reference_count; i++) {
+        while (r < reference_count && reference[r] + tolerance < beats[i]) {
+            r++;
+        }
+        if (r < reference_count && beats[i] + tolerance >= reference[r]) {
+            matched++;
+            r++;
+        }
+    }
+    return matched;
+}
+
+static int replay_compare_result(const void *a, const void *b)
+{
+    float x = ((const replay_result_t *)a)->f_measure;
+    float y = ((const replay_result_t *)b)->f_measure;
+    return (x < y) - (x > y);
+}
+
+static void replay_usage(const char *prog)
+{
+    printf("Usage: %s [options] trace.bin\n"
+           "  -b BAND           band whose settings are swept (default 0)\n"
+           "  -t MIN:MAX:STEP   threshold values\n"
+           "  -a MIN:MAX:STEP   average_ratio values\n"
+           "  -m MIN:MAX:STEP   min_energy values\n"
+           "  -i MIN:MAX:STEP   time_interval values in ms\n"
+           "  -l LABELS         reference beat times in seconds, one per line (default the captured decisions)\n"
+           "  -w MS             tolerance when matching reference beats (default %d)\n"
+           "  -k COUNT          best settings listed (default %d)\n",
+           prog, REPLAY_DEFAULT_TOLERANCE_MS, REPLAY_DEFAULT_TOP);
+}
+
+int main(int argc, char **argv)
+{
+    int band = 0;
+    replay_range_t threshold = { 0 };
+    replay_range_t average_ratio = { 0 };
+    replay_range_t min_energy = { 0 };
+    replay_range_t time_interval = { 0 };
+    const char *label_path = NULL;
+    int tolerance_ms = REPLAY_DEFAULT_TOLERANCE_MS;
+    int top = REPLAY_DEFAULT_TOP;
+
+    int opt;
+    int bad = 0;
+    while ((opt = getopt(argc, argv, "b:t:a:m:i:l:w:k:h")) != -1) {
+        switch (opt) {
+        case 'b':
+            band = atoi(optarg);
+            break;
+        case 't':
+            bad |= replay_parse_range(optarg, &threshold);
+            break;
+        case 'a':
+            bad |= replay_parse_range(optarg, &average_ratio);
+            break;
+        case 'm':
+            bad |= replay_parse_range(optarg, &min_energy);
+            break;
+        case 'i':
+            bad |= replay_parse_range(optarg, &time_interval);
+            break;
+        case 'l':
+            label_path = optarg;
+            break;
+        case 'w':
+            tolerance_ms = atoi(optarg);
+            break;
+        case 'k':
+            top = atoi(optarg);
+            break;
+        default:
+            replay_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (bad || optind >= argc) {
+        replay_usage(argv[0]);
+        return 1;
+    }
+
+    replay_trace_t trace = { 0 };
+    if (replay_load_trace(argv[optind], &trace) != 0) {
+        return 1;
+    }
+    const beat_detection_trace_header_t *header = &trace.header;
+    if (band < 0 || band >= header->band_num) {
+        fprintf(stderr, "the trace has %u bands\n", header->band_num);
+        return 1;
+    }
+    printf("trace      : %s, %u records in %u blocks, %u Hz, %u bands, %s, %u missing\n", argv[optind],
+           (unsigned)trace.record_count, (unsigned)trace.blocks, (unsigned)header->sample_rate, header->band_num,
+           header->power_domain ? "power" : "magnitude", (unsigned)trace.gaps);
+    for (int b = 0; b < header->band_num; b++) {
+        const beat_detection_band_cfg_t *cfg = &header->bands[b];
+        printf("band %d     : %u-%u Hz, threshold %g, average_ratio %g, min_energy %g, time_interval %u ms\n", b,
+               cfg->freq_start, cfg->freq_end, cfg->threshold, cfg->average_ratio, cfg->min_energy, (unsigned)cfg->time_interval);
+    }
+
+    /* Baseline: the captured settings must reproduce the recorded decisions */
+    size_t capacity = trace.record_count;
+    uint64_t *beats = (uint64_t *)malloc((capacity + 1) * sizeof(uint64_t));
+    uint64_t *recorded = (uint64_t *)malloc((capacity + 1) * sizeof(uint64_t));
+    if (beats == NULL || recorded == NULL) {
+        return 1;
+    }
+    // One beat per frame and channel, however many of its bands triggered
+    size_t recorded_count = 0;
+    uint64_t beat_sample = UINT64_MAX;
+    uint8_t beat_channel = 0;
+    for (size_t i = 0; i < trace.record_count; i++) {
+        const beat_detection_trace_record_t *record = &trace.records[i];
+        if ((record->flags & BEAT_DETECTION_TRACE_TRIGGERED) && !(record->sample_index == beat_sample && record->channel == beat_channel)) {
+            recorded[recorded_count++] = record->sample_index;
+            beat_sample = record->sample_index;
+            beat_channel = record->channel;
+        }
+    }
+    size_t beat_count = 0;
+    esp_err_t err = beat_detection_trace_replay(header, trace.records, trace.record_count, NULL, beats, capacity, &beat_count);
+    if (err != ESP_OK) {
+        fprintf(stderr, "beat_detection_trace_replay failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    size_t identical = 0;
+    for (size_t i = 0; i < beat_count && i < recorded_count; i++) {
+        identical += (beats[i] == recorded[i]);
+    }
+    printf("baseline   : %u beats, %u of %u recorded beats reproduced\n", (unsigned)beat_count, (unsigned)identical, (unsigned)recorded_count);
+
+    uint64_t *reference = recorded;
+    size_t reference_count = recorded_count;
+    uint64_t *labels = NULL;
+    if (label_path != NULL) {
+        if (replay_load_labels(label_path, header->sample_rate, &labels, &reference_count) != 0) {
+            return 1;
+        }
+        reference = labels;
+        size_t matched = replay_match(beats, beat_count, reference, reference_count, (uint64_t)tolerance_ms * header->sample_rate / 1000);
+        printf("labels     : %s, %u beats, %u matched by the baseline\n", label_path, (unsigned)reference_count, (unsigned)matched);
+    }
+
+    /* Sweep: every combination of the given ranges on the selected band */
+    int counts[4] = { replay_range_count(&threshold), replay_range_count(&average_ratio),
+                      replay_range_count(&min_energy), replay_range_count(&time_interval) };
+    size_t set_count = (size_t)counts[0] * counts[1] * counts[2] * counts[3];
+    if (set_count <= 1) {
+        return 0;
+    }
+    replay_result_t *results = (replay_result_t *)calloc(set_count, sizeof(replay_result_t));
+    if (results == NULL) {
+        return 1;
+    }
+    beat_detection_band_cfg_t bands[BEAT_DETECTION_MAX_BANDS];
+    memcpy(bands, header->bands, sizeof(bands));
+    const beat_detection_band_cfg_t *captured = &header->bands[band];
+    uint64_t tolerance = (uint64_t)tolerance_ms * header->sample_rate / 1000;
+    size_t n = 0;
+    uint64_t start_ns = replay_now_ns();
+    for (int t = 0; t < counts[0]; t++) {
+        for (int a = 0; a < counts[1]; a++) {
+            for (int m = 0; m < counts[2]; m++) {
+                for (int i = 0; i < counts[3]; i++) {
+                    beat_detection_band_cfg_t *cfg = &bands[band];
+                    cfg->threshold = replay_range_value(&threshold, t, captured->threshold);
+                    cfg->average_ratio = replay_range_value(&average_ratio, a, captured->average_ratio);
+                    cfg->min_energy = replay_range_value(&min_energy, m, captured->min_energy);
+                    cfg->time_interval = (uint32_t)(replay_range_value(&time_interval, i, (float)captured->time_interval) + 0.5f);
+                    replay_result_t *result = &results[n++];
+                    beat_detection_trace_replay(header, trace.records, trace.record_count, bands, beats, capacity, &result->beats);
+                    result->band = *cfg;
+                    result->matched = replay_match(beats, result->beats, reference, reference_count, tolerance);
+                    result->f_measure = (result->beats + reference_count > 0) ? 2.0f * result->matched / (float)(result->beats + reference_count) : 0.0f;
+                }
+            }
+        }
+    }
+    double seconds = (double)(replay_now_ns() - start_ns) / 1e9;
+    printf("sweep      : %u settings of band %d in %.3f s, %.0f settings/s\n", (unsigned)set_count, band, seconds, set_count / seconds);
+
+    qsort(results, set_count, sizeof(replay_result_t), replay_compare_result);
+    for (size_t r = 0; r < set_count && r < (size_t)top; r++) {
+        const replay_result_t *result = &results[r];
+        printf("best %-2u    : threshold %g, average_ratio %g, min_energy %g, time_interval %u ms: %u beats, %u matched, F %.3f\n",
+               (unsigned)(r + 1), result->band.threshold, result->band.average_ratio, result->band.min_energy,
+               (unsigned)result->band.time_interval, (unsigned)result->beats, (unsigned)result->matched, result->f_measure);
+    }
+
+    free(results);
+    free(labels);
+    free(recorded);
+    free(beats);
+    free(trace.records);
+    return 0;
+}
@@ -0,0 +1,260 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "esp_dsp.h"
+
+float *dsps_fft_w_table_fc32 = NULL;
+int dsps_fft_w_table_size = 0;
+uint8_t dsps_fft2r_initialized = 0;
+
+int16_t *dsps_fft_w_table_sc16 = NULL;
+int dsps_fft_w_table_sc16_size = 0;
+uint8_t dsps_fft2r_sc16_initialized = 0;
+
+static uint8_t dsps_fft2r_mem_allocated = 0;
+static uint8_t dsps_fft2r_sc16_mem_allocated = 0;
+
+static inline int dsp_is_power_of_two(int x)
+{
+    return (x > 0) && ((x & (x - 1)) == 0);
+}
+
+esp_err_t dsps_fft2r_init_fc32(float *fft_table_buff, int table_size)
+{
+    if (dsps_fft2r_initialized != 0) {
+        return ESP_OK;
+    }
+    if (!dsp_is_power_of_two(table_size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (fft_table_buff != NULL) {
+        dsps_fft_w_table_fc32 = fft_table_buff;
+        dsps_fft2r_mem_allocated = 0;
+    } else {
+        dsps_fft_w_table_fc32 = (float *)calloc(table_size, sizeof(float));
+        if (dsps_fft_w_table_fc32 == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        dsps_fft2r_mem_allocated = 1;
+    }
+    dsps_fft_w_table_size = table_size;
+    dsps_gen_w_r2_fc32(dsps_fft_w_table_fc32, table_size);
+    dsps_bit_rev_fc32_ansi(dsps_fft_w_table_fc32, table_size >> 1);
+    dsps_fft2r_initialized = 1;
+    return ESP_OK;
+}
+
+void dsps_fft2r_deinit_fc32(void)
+{
+    if (dsps_fft2r_mem_allocated) {
+        free(dsps_fft_w_table_fc32);
+    }
+    dsps_fft_w_table_fc32 = NULL;
+    dsps_fft_w_table_size = 0;
+    dsps_fft2r_mem_allocated = 0;
+    dsps_fft2r_initialized = 0;
+}
+
+esp_err_t dsps_fft2r_fc32_ansi_(float *data, int N, float *w)
+{
+    if (!dsp_is_power_of_two(N) || w == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int ie = 1;
+    for (int N2 = N / 2; N2 > 0; N2 >>= 1) {
+        int ia = 0;
+        for (int j = 0; j < ie; j++) {
+            float c = w[2 * j];
+            float s = w[2 * j + 1];
+            for (int i = 0; i < N2; i++) {
+                int m = ia + N2;
+                float re_temp = c * data[2 * m] + s * data[2 * m + 1];
+                float im_temp = c * data[2 * m + 1] - s * data[2 * m];
+                data[2 * m] = data[2 * ia] - re_temp;
+                data[2 * m + 1] = data[2 * ia + 1] - im_temp;
+                data[2 * ia] = data[2 * ia] + re_temp;
+                data[2 * ia + 1] = data[2 * ia + 1] + im_temp;
+                ia++;
+            }
+            ia += N2;
+        }
+        ie <<= 1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t dsps_bit_rev_fc32_ansi(float *data, int N)
+{
+    if (!dsp_is_power_of_two(N)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int j = 0;
+    for (int i = 1; i < (N - 1); i++) {
+        int k = N >> 1;
+        while (k <= j) {
+            j -= k;
+            k >>= 1;
+        }
+        j += k;
+        if (i < j) {
+            float r_temp = data[j * 2];
+            float i_temp = data[j * 2 + 1];
+            data[j * 2] = data[i * 2];
+            data[j * 2 + 1] = data[i * 2 + 1];
+            data[i * 2] = r_temp;
+            data[i * 2 + 1] = i_temp;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t dsps_gen_w_r2_fc32(float *w, int N)
+{
+    if (!dsp_is_power_of_two(N)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    float e = M_PI * 2.0 / N;
+    for (int i = 0; i < (N >> 1); i++) {
+        w[2 * i] = cosf(i * e);
+        w[2 * i + 1] = sinf(i * e);
+    }
+    return ESP_OK;
+}
+
+esp_err_t dsps_fft2r_init_sc16(int16_t *fft_table_buff, int table_size)
+{
+    if (dsps_fft2r_sc16_initialized != 0) {
+        return ESP_OK;
+    }
+    if (!dsp_is_power_of_two(table_size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (fft_table_buff != NULL) {
+        dsps_fft_w_table_sc16 = fft_table_buff;
+        dsps_fft2r_sc16_mem_allocated = 0;
+    } else {
+        dsps_fft_w_table_sc16 = (int16_t *)calloc(table_size, sizeof(int16_t));
+        if (dsps_fft_w_table_sc16 == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        dsps_fft2r_sc16_mem_allocated = 1;
+    }
+    dsps_fft_w_table_sc16_size = table_size;
+    dsps_gen_w_r2_sc16(dsps_fft_w_table_sc16, table_size);
+    dsps_bit_rev_sc16_ansi(dsps_fft_w_table_sc16, table_size >> 1);
+    dsps_fft2r_sc16_initialized = 1;
+    return ESP_OK;
+}
+
+void dsps_fft2r_deinit_sc16(void)
+{
+    if (dsps_fft2r_sc16_mem_allocated) {
+        free(dsps_fft_w_table_sc16);
+    }
+    dsps_fft_w_table_sc16 = NULL;
+    dsps_fft_w_table_sc16_size = 0;
+    dsps_fft2r_sc16_mem_allocated = 0;
+    dsps_fft2r_sc16_initialized = 0;
+}
+
+/* Each butterfly stage scales by 1/2, so the output is DFT(x) / N as on the target. */
+esp_err_t dsps_fft2r_sc16_ansi_(int16_t *data, int N, int16_t *w)
+{
+    if (!dsp_is_power_of_two(N) || w == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int ie = 1;
+    for (int N2 = N / 2; N2 > 0; N2 >>= 1) {
+        int ia = 0;
+        for (int j = 0; j < ie; j++) {
+            int32_t c = w[2 * j];
+            int32_t s = w[2 * j + 1];
+            for (int i = 0; i < N2; i++) {
+                int m = ia + N2;
+                int32_t re_temp = (c * data[2 * m] + s * data[2 * m + 1]) >> 15;
+                int32_t im_temp = (c * data[2 * m + 1] - s * data[2 * m]) >> 15;
+                int32_t a_re = data[2 * ia];
+                int32_t a_im = data[2 * ia + 1];
+                data[2 * m] = (int16_t)((a_re - re_temp) >> 1);
+                data[2 * m + 1] = (int16_t)((a_im - im_temp) >> 1);
+                data[2 * ia] = (int16_t)((a_re + re_temp) >> 1);
+                data[2 * ia + 1] = (int16_t)((a_im + im_temp) >> 1);
+                ia++;
+            }
+            ia += N2;
+        }
+        ie <<= 1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t dsps_bit_rev_sc16_ansi(int16_t *data, int N)
+{
+    if (!dsp_is_power_of_two(N)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t *in_data = (uint32_t *)data;
+    int j = 0;
+    for (int i = 1; i < (N - 1); i++) {
+        int k = N >> 1;
+        while (k <= j) {
+            j -= k;
+            k >>= 1;
+        }
+        j += k;
+        if (i < j) {
+            uint32_t temp = in_data[j];
+            in_data[j] = in_data[i];
+            in_data[i] = temp;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t dsps_gen_w_r2_sc16(int16_t *w, int N)
+{
+    if (!dsp_is_power_of_two(N)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    float e = M_PI * 2.0 / N;
+    for (int i = 0; i < (N >> 1); i++) {
+        w[2 * i] = (int16_t)(INT16_MAX * cosf(i * e));
+        w[2 * i + 1] = (int16_t)(INT16_MAX * sinf(i * e));
+    }
+    return ESP_OK;
+}
+
+void dsps_wind_hann_f32(float *window, int len)
+{
+    float len_mult = 1 / (float)(len - 1);
+    for (int i = 0; i < len; i++) {
+        window[i] = 0.5 * (1 - cosf(i * 2 * M_PI * len_mult));
+    }
+}
+
+esp_err_t dsps_mul_f32_ansi(const float *input1, const float *input2, float *output, int len, int step1, int step2, int step_out)
+{
+    if (input1 == NULL || input2 == NULL || output == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < len; i++) {
+        output[i * step_out] = input1[i * step1] * input2[i * step2];
+    }
+    return ESP_OK;
+}
+
+esp_err_t dsps_mulc_f32_ansi(const float *input, float *output, int len, float C, int step_in, int step_out)
+{
+    if (input == NULL || output == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < len; i++) {
+        output[i * step_out] = input[i * step_in] * C;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,365 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+struct shim_queue {
+    pthread_mutex_t     lock;
+    pthread_cond_t      not_empty;
+    pthread_cond_t      not_full;
+    UBaseType_t         length;
+    UBaseType_t         item_size;
+    UBaseType_t         count;
+    UBaseType_t         head;
+    uint8_t*            storage;
+    bool                is_static;
+};
+
+struct shim_task {
+    pthread_t           thread;
+    TaskFunction_t      task_code;
+    void*               params;
+    uint32_t            stack_depth;
+    pthread_mutex_t     notify_lock;
+    pthread_cond_t      notify_cond;
+    uint32_t            notify_value;
+};
+
+static __thread struct shim_task *s_current_task = NULL;
+
+static void shim_deadline(TickType_t ticks, struct timespec *ts)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ticks / configTICK_RATE_HZ;
+    ts->tv_nsec += (long)(ticks % configTICK_RATE_HZ) * (1000000000L / configTICK_RATE_HZ);
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec += 1;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void shim_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void shim_unlock(void *arg)
+{
+    pthread_mutex_unlock((pthread_mutex_t *)arg);
+}
+
+/* Returns false when the wait timed out. Must be called with the mutex held. */
+static bool shim_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline)
+{
+    int ret = 0;
+    pthread_cleanup_push(shim_unlock, lock);
+    if (ticks == portMAX_DELAY) {
+        ret = pthread_cond_wait(cond, lock);
+    } else {
+        ret = pthread_cond_timedwait(cond, lock, deadline);
+    }
+    pthread_cleanup_pop(0);
+    return ret != ETIMEDOUT;
+}
+
+static void *shim_task_entry(void *arg)
+{
+    struct shim_task *task = (struct shim_task *)arg;
+    s_current_task = task;
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+    task->task_code(task->params);
+    return NULL;
+}
+
+static struct shim_task *shim_task_create(TaskFunction_t task_code, void *params, uint32_t stack_depth)
+{
+    struct shim_task *task = (struct shim_task *)calloc(1, sizeof(struct shim_task));
+    if (task == NULL) {
+        return NULL;
+    }
+    task->task_code = task_code;
+    task->params = params;
+    task->stack_depth = stack_depth;
+    pthread_mutex_init(&task->notify_lock, NULL);
+    shim_cond_init(&task->notify_cond);
+    if (pthread_create(&task->thread, NULL, shim_task_entry, task) != 0) {
+        free(task);
+        return NULL;
+    }
+    return task;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+                                   void *params, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id)
+{
+    (void)name;
+    (void)priority;
+    (void)core_id;
+    struct shim_task *task = shim_task_create(task_code, params, stack_depth);
+    if (created_task != NULL) {
+        *created_task = task;
+    }
+    return (task != NULL) ? pdPASS : pdFAIL;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+                                           void *params, UBaseType_t priority, StackType_t *stack_buffer,
+                                           StaticTask_t *task_buffer, BaseType_t core_id)
+{
+    (void)name;
+    (void)priority;
+    (void)stack_buffer;
+    (void)task_buffer;
+    (void)core_id;
+    return shim_task_create(task_code, params, stack_depth);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == s_current_task) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+    pthread_join(task->thread, NULL);
+    pthread_mutex_destroy(&task->notify_lock);
+    pthread_cond_destroy(&task->notify_cond);
+    free(task);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep((useconds_t)ticks * (1000000U / configTICK_RATE_HZ));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * configTICK_RATE_HZ + ts.tv_nsec / (1000000000L / configTICK_RATE_HZ));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_current_task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    /* Host threads have no bounded FreeRTOS stack; report the configured depth as untouched. */
+    return (task != NULL) ? task->stack_depth : 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->notify_lock);
+    task->notify_value++;
+    pthread_cond_signal(&task->notify_cond);
+    pthread_mutex_unlock(&task->notify_lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    struct shim_task *task = s_current_task;
+    if (task == NULL) {
+        return 0;
+    }
+    struct timespec deadline;
+    shim_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&task->notify_lock);
+    while (task->notify_value == 0 && ticks_to_wait != 0) {
+        if (!shim_wait(&task->notify_cond, &task->notify_lock, ticks_to_wait, &deadline)) {
+            break;
+        }
+    }
+    uint32_t value = task->notify_value;
+    if (value != 0) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->notify_lock);
+    return value;
+}
+
+static void shim_queue_setup(struct shim_queue *queue, UBaseType_t length, UBaseType_t item_size)
+{
+    pthread_mutex_init(&queue->lock, NULL);
+    shim_cond_init(&queue->not_empty);
+    shim_cond_init(&queue->not_full);
+    queue->length = length;
+    queue->item_size = item_size;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    if (length == 0) {
+        return NULL;
+    }
+    struct shim_queue *queue = (struct shim_queue *)calloc(1, sizeof(struct shim_queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    if (item_size > 0) {
+        queue->storage = (uint8_t *)calloc(length, item_size);
+        if (queue->storage == NULL) {
+            free(queue);
+            return NULL;
+        }
+    }
+    shim_queue_setup(queue, length, item_size);
+    return queue;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *queue_buffer)
+{
+    _Static_assert(sizeof(StaticQueue_t) >= sizeof(struct shim_queue), "StaticQueue_t too small for host queue");
+    if (length == 0 || queue_buffer == NULL || (item_size > 0 && storage == NULL)) {
+        return NULL;
+    }
+    struct shim_queue *queue = (struct shim_queue *)queue_buffer;
+    memset(queue, 0, sizeof(struct shim_queue));
+    queue->storage = storage;
+    queue->is_static = true;
+    shim_queue_setup(queue, length, item_size);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    if (!queue->is_static) {
+        free(queue->storage);
+        free(queue);
+    }
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    shim_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (ticks_to_wait == 0 || !shim_wait(&queue->not_full, &queue->lock, ticks_to_wait, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    if (queue->item_size > 0) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->storage + tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    shim_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (ticks_to_wait == 0 || !shim_wait(&queue->not_empty, &queue->lock, ticks_to_wait, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    if (queue->item_size > 0) {
+        memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->count = 0;
+    queue->head = 0;
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max_count, 0);
+    if (sem != NULL) {
+        sem->count = initial_count;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCountingStatic(UBaseType_t max_count, UBaseType_t initial_count, StaticSemaphore_t *buffer)
+{
+    SemaphoreHandle_t sem = xQueueCreateStatic(max_count, 0, NULL, buffer);
+    if (sem != NULL) {
+        sem->count = initial_count;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer)
+{
+    return xQueueCreateStatic(1, 0, NULL, buffer);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+    return xQueueReceive(sem, NULL, ticks_to_wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueSend(sem, NULL, 0);
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem)
+{
+    return uxQueueMessagesWaiting(sem);
+}
@@ -0,0 +1,64 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Host subset of the esp-dsp API used by the beat detection component.
+ * Only the ANSI C implementations exist on the host; names, argument order,
+ * twiddle table layout and scaling follow esp-dsp so the component code is
+ * compiled unchanged.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define dsps_fft2r_fc32_ae32_enabled    0
+#define dsps_fft2r_fc32_aes3_enabled    0
+#define dsps_fft2r_sc16_ae32_enabled    0
+#define dsps_fft2r_sc16_aes3_enabled    0
+
+extern float *dsps_fft_w_table_fc32;
+extern int dsps_fft_w_table_size;
+extern uint8_t dsps_fft2r_initialized;
+
+extern int16_t *dsps_fft_w_table_sc16;
+extern int dsps_fft_w_table_sc16_size;
+extern uint8_t dsps_fft2r_sc16_initialized;
+
+esp_err_t dsps_fft2r_init_fc32(float *fft_table_buff, int table_size);
+void dsps_fft2r_deinit_fc32(void);
+esp_err_t dsps_fft2r_fc32_ansi_(float *data, int N, float *w);
+esp_err_t dsps_bit_rev_fc32_ansi(float *data, int N);
+esp_err_t dsps_gen_w_r2_fc32(float *w, int N);
+
+esp_err_t dsps_fft2r_init_sc16(int16_t *fft_table_buff, int table_size);
+void dsps_fft2r_deinit_sc16(void);
+esp_err_t dsps_fft2r_sc16_ansi_(int16_t *data, int N, int16_t *w);
+esp_err_t dsps_bit_rev_sc16_ansi(int16_t *data, int N);
+esp_err_t dsps_gen_w_r2_sc16(int16_t *w, int N);
+
+void dsps_wind_hann_f32(float *window, int len);
+
+esp_err_t dsps_mul_f32_ansi(const float *input1, const float *input2, float *output, int len, int step1, int step2, int step_out);
+esp_err_t dsps_mulc_f32_ansi(const float *input, float *output, int len, float C, int step_in, int step_out);
+
+#define dsps_fft2r_fc32_ansi(data, N)   dsps_fft2r_fc32_ansi_(data, N, dsps_fft_w_table_fc32)
+#define dsps_fft2r_fc32(data, N)        dsps_fft2r_fc32_ansi_(data, N, dsps_fft_w_table_fc32)
+#define dsps_bit_rev_fc32               dsps_bit_rev_fc32_ansi
+#define dsps_fft2r_sc16_ansi(data, N)   dsps_fft2r_sc16_ansi_(data, N, dsps_fft_w_table_sc16)
+#define dsps_fft2r_sc16(data, N)        dsps_fft2r_sc16_ansi_(data, N, dsps_fft_w_table_sc16)
+#define dsps_mul_f32                    dsps_mul_f32_ansi
+#define dsps_mulc_f32                   dsps_mulc_f32_ansi
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,33 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef HOST_LOG_LEVEL
+#define HOST_LOG_LEVEL  3
+#endif
+
+#define HOST_LOG(level, letter, tag, format, ...) do {                             \
+        if ((level) <= HOST_LOG_LEVEL) {                                            \
+            fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__);      \
+        }                                                                           \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...)  HOST_LOG(1, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  HOST_LOG(2, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  HOST_LOG(3, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  HOST_LOG(4, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)  HOST_LOG(5, "V", tag, format, ##__VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,61 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Minimal FreeRTOS shim for building the beat detection component on a Linux host.
+ * Tasks are backed by pthreads, queues and semaphores by a mutex/condvar pair.
+ * The tick rate is fixed at 1 kHz.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef long            BaseType_t;
+typedef unsigned long   UBaseType_t;
+typedef uint32_t        TickType_t;
+typedef uint8_t         StackType_t;
+
+#define pdFALSE                 ((BaseType_t)0)
+#define pdTRUE                  ((BaseType_t)1)
+#define pdPASS                  (pdTRUE)
+#define pdFAIL                  (pdFALSE)
+
+#define configTICK_RATE_HZ      (1000)
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define tskNO_AFFINITY          ((BaseType_t)0x7FFFFFFF)
+
+typedef struct {
+    uint8_t dummy[64];
+} StaticTask_t;
+
+typedef struct {
+    uint8_t dummy[256];
+} StaticQueue_t;
+
+typedef StaticQueue_t StaticSemaphore_t;
+
+/* Critical sections only exclude other tasks on the host, interrupts do not exist */
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    PTHREAD_MUTEX_INITIALIZER
+#define portMUX_INITIALIZE(mux)         pthread_mutex_init((mux), NULL)
+
+typedef struct shim_queue *QueueHandle_t;
+typedef struct shim_task *TaskHandle_t;
+
+#ifdef __cplusplus
+}
+#endif
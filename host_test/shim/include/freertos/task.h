@@ -0,0 +1,44 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*TaskFunction_t)(void *);
+
+#define taskENTER_CRITICAL(mux)     pthread_mutex_lock(mux)
+#define taskEXIT_CRITICAL(mux)      pthread_mutex_unlock(mux)
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+                                   void *params, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id);
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+                                           void *params, UBaseType_t priority, StackType_t *stack_buffer,
+                                           StaticTask_t *task_buffer, BaseType_t core_id);
+
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+TickType_t xTaskGetTickCount(void);
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,32 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * Host stand-in for the generated sdkconfig.h. Values may be overridden from the
+ * CMake command line (e.g. -DCONFIG_DSP_MAX_FFT_SIZE=8192).
+ */
+
+#pragma once
+
+#ifndef CONFIG_DSP_MAX_FFT_SIZE
+#define CONFIG_DSP_MAX_FFT_SIZE         4096
+#endif
+
+#ifndef CONFIG_FREERTOS_NUMBER_OF_CORES
+#define CONFIG_FREERTOS_NUMBER_OF_CORES 2
+#endif
+
+#ifndef CONFIG_BEAT_DETECTION_PROFILE
+#define CONFIG_BEAT_DETECTION_PROFILE   1
+#endif
+
+#ifndef CONFIG_BEAT_DETECTION_INSTANCE_POOL_SIZE
+#define CONFIG_BEAT_DETECTION_INSTANCE_POOL_SIZE    4
+#endif
+
+#ifndef CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+#define CONFIG_BEAT_DETECTION_FIXED_LAYOUT          0
+#endif
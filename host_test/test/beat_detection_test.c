@@ -0,0 +1,709 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file beat_detection_test.c
+ * @brief Host regression tests for the beat detection component
+ *
+ * Runs a synthetic kick pattern with known kick positions through every
+ * engine, channel mode and sample format and checks that:
+ * 1. Each kick is reported once, within one frame and one hop after it
+ * 2. beat_detection_batch_detect(), beat_detection_process() and the task fed
+ *    by beat_detection_data_lend() report exactly the same timestamps
+ * 3. No path reads past the input: every buffer ends at an inaccessible page,
+ *    so an overread crashes the test even without a sanitizer
+ * It also checks that the Goertzel and Q15 engines stay within their tolerance
+ * of the complex FFT reference, and that beat_detection_wav_parse() rejects
+ * chunk sizes that run past the image.
+ * Exits with a non-zero status when a check fails; run through ctest.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "beat_detection.h"
+
+#define TEST_SAMPLE_RATE        (16000)
+#define TEST_SECONDS            (8)
+#define TEST_KICK_PERIOD        (TEST_SAMPLE_RATE / 2)
+#define TEST_KICK_COUNT         (TEST_SECONDS * TEST_SAMPLE_RATE / TEST_KICK_PERIOD)
+#define TEST_MAX_BEATS          (64)
+#define TEST_TASK_TIMEOUT_MS    (5000)
+#define TEST_Q15_TOLERANCE      (0.1f)
+
+#define TEST_CHECK(cond, ...) do {                                              \
+    s_checks++;                                                                 \
+    if (!(cond)) {                                                              \
+        s_failures++;                                                           \
+        printf("%s:%d: %s: ", __FILE__, __LINE__, s_case);                      \
+        printf(__VA_ARGS__);                                                    \
+        printf("\n");                                                           \
+    }                                                                           \
+} while (0)
+
+typedef enum {
+    TEST_PATH_BATCH = 0,
+    TEST_PATH_PROCESS,
+    TEST_PATH_LEND,
+} test_path_t;
+
+/* Input placed so that its last byte is followed by an inaccessible page */
+typedef struct {
+    uint8_t *map;
+    size_t   map_size;
+    uint8_t *samples;
+    size_t   bytes;
+} test_buffer_t;
+
+typedef struct {
+    volatile uint32_t frames;
+    volatile uint32_t beat_count;
+    volatile uint32_t channels;     // Bit per event channel that reported a beat
+    uint64_t          beats[TEST_MAX_BEATS];
+} test_result_t;
+
+static uint32_t s_checks;
+static uint32_t s_failures;
+static char     s_case[128];
+
+static const char *s_path_names[] = { "batch", "process", "lend" };
+
+static size_t test_sample_bytes(beat_detection_sample_format_t format)
+{
+    return (format == BEAT_DETECTION_FORMAT_S16) ? sizeof(int16_t) : sizeof(int32_t);
+}
+
+static int test_buffer_alloc(test_buffer_t *buffer, size_t bytes)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t data_pages = (bytes + page - 1) / page;
+    buffer->map_size = (data_pages + 1) * page;
+    buffer->map = (uint8_t *)mmap(NULL, buffer->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer->map == MAP_FAILED) {
+        return -1;
+    }
+    if (mprotect(buffer->map + data_pages * page, page, PROT_NONE) != 0) {
+        munmap(buffer->map, buffer->map_size);
+        return -1;
+    }
+    buffer->samples = buffer->map + data_pages * page - bytes;
+    buffer->bytes = bytes;
+    return 0;
+}
+
+static void test_buffer_free(test_buffer_t *buffer)
+{
+    munmap(buffer->map, buffer->map_size);
+}
+
+/*
+ * 60 ms kick bursts at 250 Hz on a 120 BPM grid over low-level noise, with 30 ms 5 kHz hi-hat ticks
+ * on the off-beats, like the bench input.
+ * With left_only_odd every second kick is in the left channel only, so the channel modes
+ * can be told apart. Samples are widened to the requested format, 24-in-32 with a zero upper byte.
+ */
+static int test_synthesize(test_buffer_t *buffer, uint8_t channel, beat_detection_sample_format_t format, bool left_only_odd)
+{
+    size_t count = (size_t)TEST_SECONDS * TEST_SAMPLE_RATE;
+    if (test_buffer_alloc(buffer, count * channel * test_sample_bytes(format)) != 0) {
+        return -1;
+    }
+    size_t burst_len = TEST_SAMPLE_RATE * 60 / 1000;
+    uint32_t seed = 1;
+    for (size_t n = 0; n < count; n++) {
+        seed = seed * 1103515245u + 12345u;
+        float noise = ((float)((seed >> 16) & 0x7fff) / 32768.0f - 0.5f) * 200.0f;
+        float kick = 0.0f;
+        size_t phase = n % TEST_KICK_PERIOD;
+        if (phase < burst_len) {
+            float envelope = expf(-(float)phase / (float)(burst_len / 4));
+            kick = 12000.0f * envelope * sinf(2.0f * (float)M_PI * 250.0f * (float)n / (float)TEST_SAMPLE_RATE);
+        }
+        bool left_only = left_only_odd && (n / TEST_KICK_PERIOD) % 2 == 1;
+        size_t hat_phase = (n + TEST_KICK_PERIOD / 2) % TEST_KICK_PERIOD;
+        if (hat_phase < burst_len / 2) {
+            float envelope = expf(-(float)hat_phase / (float)(burst_len / 8));
+            noise += 3000.0f * envelope * sinf(2.0f * (float)M_PI * 5000.0f * (float)n / (float)TEST_SAMPLE_RATE);
+        }
+        for (int c = 0; c < channel; c++) {
+            int16_t sample = (int16_t)(noise + ((c == 0 || !left_only) ? kick : 0.0f));
+            size_t i = n * channel + c;
+            uint32_t word = (uint32_t)(int32_t)sample;
+            if (format == BEAT_DETECTION_FORMAT_S16) {
+                ((int16_t *)buffer->samples)[i] = sample;
+            } else {
+                ((int32_t *)buffer->samples)[i] = (int32_t)((format == BEAT_DETECTION_FORMAT_S32) ? word << 16 : (word << 8) & 0x00ffffffu);
+            }
+        }
+    }
+    return 0;
+}
+
+static void test_result_callback(beat_detection_result_t result, void *ctx)
+{
+    ((test_result_t *)ctx)->frames++;
+}
+
+static void test_event_callback(const beat_detection_event_t *event, void *ctx)
+{
+    test_result_t *result = (test_result_t *)ctx;
+    // Dual mode reports both channels of a frame, the batch path counts the frame once
+    bool repeated = result->beat_count > 0 && result->beat_count <= TEST_MAX_BEATS
+                    && result->beats[result->beat_count - 1] == event->sample_index;
+    if (event->result == BEAT_DETECTED) {
+        result->channels |= 1u << (event->channel & 31);
+    }
+    if (event->result == BEAT_DETECTED && !repeated) {
+        if (result->beat_count < TEST_MAX_BEATS) {
+            result->beats[result->beat_count] = event->sample_index;
+        }
+        result->beat_count++;
+    }
+}
+
+static void test_release_callback(const uint8_t *audio_buffer, void *ctx)
+{
+    (void)audio_buffer;
+    (void)ctx;
+}
+
+/* Input samples per analysis frame and per hop */
+static size_t test_step(const beat_detection_cfg_t *cfg)
+{
+    size_t decimation = (cfg->audio_cfg.decimation > 1) ? cfg->audio_cfg.decimation : 1;
+    return (size_t)(cfg->audio_cfg.hop_size > 0 ? cfg->audio_cfg.hop_size : cfg->audio_cfg.fft_size) * decimation;
+}
+
+static esp_err_t test_run(beat_detection_cfg_t cfg, const test_buffer_t *buffer, test_path_t path, test_result_t *result)
+{
+    memset(result, 0, sizeof(*result));
+    size_t frame_bytes = cfg.audio_cfg.channel * test_sample_bytes(cfg.audio_cfg.format);
+    size_t sample_count = buffer->bytes / frame_bytes;
+    if (path == TEST_PATH_BATCH) {
+        size_t beat_count = 0;
+        esp_err_t ret = beat_detection_batch_detect(&cfg, buffer->samples, sample_count, result->beats, TEST_MAX_BEATS, &beat_count);
+        result->beat_count = (uint32_t)beat_count;
+        return ret;
+    }
+
+    cfg.result_callback = test_result_callback;
+    cfg.event_callback = test_event_callback;
+    cfg.result_callback_ctx = result;
+    cfg.flags.synchronous = (path == TEST_PATH_PROCESS);
+    cfg.flags.write_blocking = true;
+    cfg.buffer_cfg.write_timeout_ms = TEST_TASK_TIMEOUT_MS;
+    beat_detection_handle_t handle = NULL;
+    esp_err_t ret = beat_detection_init(&cfg, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    // One frame per call, the last call ending right at the guard page
+    size_t step = test_step(&cfg);
+    size_t calls = sample_count / step;
+    size_t skip = sample_count - calls * step;
+    for (size_t i = 0; i < calls && ret == ESP_OK; i++) {
+        beat_detection_audio_buffer_t audio = {
+            .audio_buffer = buffer->samples + (skip + i * step) * frame_bytes,
+            .bytes_size = step * frame_bytes,
+        };
+        if (path == TEST_PATH_PROCESS) {
+            ret = beat_detection_process(handle, audio, NULL);
+        } else {
+            ret = beat_detection_data_lend(handle, audio, test_release_callback, NULL);
+        }
+    }
+    for (int waited = 0; ret == ESP_OK && result->frames < calls; waited++) {
+        if (waited > TEST_TASK_TIMEOUT_MS) {
+            ret = ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    beat_detection_deinit(&handle);
+    // Timestamps count from the first fed sample
+    for (uint32_t i = 0; i < result->beat_count && i < TEST_MAX_BEATS; i++) {
+        result->beats[i] += skip;
+    }
+    return ret;
+}
+
+/* Every kick in kick_mask reported once and no other beat, each within one frame and one hop of its kick */
+static void test_check_kicks(const beat_detection_cfg_t *cfg, const test_result_t *result, uint32_t kick_mask)
+{
+    size_t decimation = (cfg->audio_cfg.decimation > 1) ? cfg->audio_cfg.decimation : 1;
+    uint64_t latency = (uint64_t)cfg->audio_cfg.fft_size * decimation + test_step(cfg);
+    uint32_t expected = (uint32_t)__builtin_popcount(kick_mask);
+    TEST_CHECK(result->beat_count == expected, "%u beats, expected %u", (unsigned)result->beat_count, (unsigned)expected);
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < result->beat_count && i < TEST_MAX_BEATS; i++) {
+        uint64_t kick = result->beats[i] / TEST_KICK_PERIOD;
+        uint64_t offset = result->beats[i] % TEST_KICK_PERIOD;
+        bool near = kick < TEST_KICK_COUNT && offset <= latency && ((kick_mask >> kick) & 1) && !((seen >> kick) & 1);
+        TEST_CHECK(near, "beat at sample %llu is %llu samples past kick %llu", (unsigned long long)result->beats[i],
+                   (unsigned long long)offset, (unsigned long long)kick);
+        seen |= near ? 1u << kick : 0;
+    }
+}
+
+/* Runs cfg on every path, checks the kicks and that all paths agree with the batch timestamps */
+static void test_paths(const char *name, const beat_detection_cfg_t *cfg, const test_buffer_t *buffer, uint32_t kick_mask)
+{
+    test_result_t batch;
+    for (int path = TEST_PATH_BATCH; path <= TEST_PATH_LEND; path++) {
+        test_result_t result;
+        snprintf(s_case, sizeof(s_case), "%s, %s", name, s_path_names[path]);
+        esp_err_t ret = test_run(*cfg, buffer, (test_path_t)path, &result);
+        TEST_CHECK(ret == ESP_OK, "run failed: %s", esp_err_to_name(ret));
+        if (ret != ESP_OK) {
+            continue;
+        }
+        test_check_kicks(cfg, &result, kick_mask);
+        if (path == TEST_PATH_BATCH) {
+            batch = result;
+            continue;
+        }
+        bool same = result.beat_count == batch.beat_count
+                    && memcmp(result.beats, batch.beats, sizeof(uint64_t) * (batch.beat_count < TEST_MAX_BEATS ? batch.beat_count : TEST_MAX_BEATS)) == 0;
+        TEST_CHECK(same, "timestamps differ from the batch path");
+    }
+}
+
+static beat_detection_cfg_t test_default_cfg(uint8_t channel, beat_detection_sample_format_t format)
+{
+    beat_detection_cfg_t cfg = BEAT_DETECTION_DEFAULT_CFG();
+    cfg.audio_cfg.sample_rate = TEST_SAMPLE_RATE;
+    cfg.audio_cfg.channel = channel;
+    cfg.audio_cfg.format = format;
+    cfg.buffer_cfg.frame_num = 16;
+    return cfg;
+}
+
+static void test_engines(void)
+{
+    static const struct {
+        beat_detection_engine_t engine;
+        const char *name;
+    } engines[] = {
+        { BEAT_DETECTION_ENGINE_COMPLEX_FFT, "complex" },
+        { BEAT_DETECTION_ENGINE_REAL_FFT, "real" },
+        { BEAT_DETECTION_ENGINE_GOERTZEL, "goertzel" },
+        { BEAT_DETECTION_ENGINE_FFT_Q15, "q15" },
+    };
+    test_buffer_t buffer;
+    if (test_synthesize(&buffer, 1, BEAT_DETECTION_FORMAT_S16, false) != 0) {
+        TEST_CHECK(false, "out of memory");
+        return;
+    }
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        for (int hop = 0; hop <= 128; hop += 128) {
+            beat_detection_cfg_t cfg = test_default_cfg(1, BEAT_DETECTION_FORMAT_S16);
+            cfg.audio_cfg.engine = engines[e].engine;
+            cfg.audio_cfg.hop_size = (int16_t)hop;
+            char name[64];
+            snprintf(name, sizeof(name), "%s mono, hop %d", engines[e].name, hop);
+            test_paths(name, &cfg, &buffer, (1u << TEST_KICK_COUNT) - 1);
+        }
+    }
+    test_buffer_free(&buffer);
+}
+
+static void test_channel_modes(void)
+{
+    static const struct {
+        beat_detection_channel_mode_t mode;
+        const char *name;
+        uint32_t kick_mask;
+        uint32_t channels;
+    } modes[] = {
+        // Odd kicks are in the left channel only; only the dual peer reports channel 1
+        { BEAT_DETECTION_CHANNEL_RIGHT, "right", 0x5555u, 0x1u },
+        { BEAT_DETECTION_CHANNEL_LEFT, "left", 0xffffu, 0x1u },
+        { BEAT_DETECTION_CHANNEL_MID, "mid", 0xffffu, 0x1u },
+        { BEAT_DETECTION_CHANNEL_MAX, "max", 0xffffu, 0x1u },
+        { BEAT_DETECTION_CHANNEL_DUAL, "dual", 0xffffu, 0x3u },
+    };
+    test_buffer_t buffer;
+    if (test_synthesize(&buffer, 2, BEAT_DETECTION_FORMAT_S16, true) != 0) {
+        TEST_CHECK(false, "out of memory");
+        return;
+    }
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        for (int engine = BEAT_DETECTION_ENGINE_COMPLEX_FFT; engine <= BEAT_DETECTION_ENGINE_GOERTZEL; engine += BEAT_DETECTION_ENGINE_GOERTZEL) {
+            beat_detection_cfg_t cfg = test_default_cfg(2, BEAT_DETECTION_FORMAT_S16);
+            cfg.audio_cfg.channel_mode = modes[m].mode;
+            cfg.audio_cfg.engine = (beat_detection_engine_t)engine;
+            char name[64];
+            snprintf(name, sizeof(name), "stereo %s, engine %d", modes[m].name, engine);
+            test_paths(name, &cfg, &buffer, modes[m].kick_mask);
+            test_result_t result;
+            snprintf(s_case, sizeof(s_case), "%s, event channels", name);
+            esp_err_t ret = test_run(cfg, &buffer, TEST_PATH_PROCESS, &result);
+            TEST_CHECK(ret == ESP_OK && result.channels == modes[m].channels, "beats on channels 0x%x, expected 0x%x",
+                       (unsigned)result.channels, (unsigned)modes[m].channels);
+        }
+    }
+    test_buffer_free(&buffer);
+}
+
+static void test_formats(void)
+{
+    static const char *names[] = { "s16", "s24", "s32" };
+    for (int format = BEAT_DETECTION_FORMAT_S16; format <= BEAT_DETECTION_FORMAT_S32; format++) {
+        for (uint8_t channel = 1; channel <= 2; channel++) {
+            test_buffer_t buffer;
+            if (test_synthesize(&buffer, channel, (beat_detection_sample_format_t)format, false) != 0) {
+                TEST_CHECK(false, "out of memory");
+                return;
+            }
+            beat_detection_cfg_t cfg = test_default_cfg(channel, (beat_detection_sample_format_t)format);
+            cfg.audio_cfg.channel_mode = BEAT_DETECTION_CHANNEL_MID;
+            cfg.audio_cfg.hop_size = 128;
+            char name[64];
+            snprintf(name, sizeof(name), "%s, %u channels", names[format], channel);
+            test_paths(name, &cfg, &buffer, (1u << TEST_KICK_COUNT) - 1);
+            test_buffer_free(&buffer);
+        }
+    }
+}
+
+/* The decimator reads the input itself, in mono and in the mid downmix */
+static void test_decimation(void)
+{
+    for (uint8_t channel = 1; channel <= 2; channel++) {
+        test_buffer_t buffer;
+        if (test_synthesize(&buffer, channel, BEAT_DETECTION_FORMAT_S16, false) != 0) {
+            TEST_CHECK(false, "out of memory");
+            return;
+        }
+        for (int engine = BEAT_DETECTION_ENGINE_COMPLEX_FFT; engine <= BEAT_DETECTION_ENGINE_REAL_FFT; engine++) {
+            for (int hop = 0; hop <= 32; hop += 32) {
+                beat_detection_cfg_t cfg = test_default_cfg(channel, BEAT_DETECTION_FORMAT_S16);
+                cfg.audio_cfg.channel_mode = BEAT_DETECTION_CHANNEL_MID;
+                cfg.audio_cfg.engine = (beat_detection_engine_t)engine;
+                cfg.audio_cfg.fft_size = 128;
+                cfg.audio_cfg.hop_size = (int16_t)hop;
+                cfg.audio_cfg.decimation = 4;
+                char name[64];
+                snprintf(name, sizeof(name), "decimation 4, %u channels, engine %d, hop %d", channel, engine, hop);
+                test_paths(name, &cfg, &buffer, (1u << TEST_KICK_COUNT) - 1);
+            }
+        }
+        test_buffer_free(&buffer);
+    }
+}
+
+/*
+ * The gate may only skip work: with the noise gated and the kicks above it, every path must report the
+ * timestamps of the ungated detector. The hi-hats sit between the two levels, so they are gated frames
+ * with energy in them.
+ */
+static void test_gate(void)
+{
+    static const beat_detection_channel_mode_t modes[] = { BEAT_DETECTION_CHANNEL_MID, BEAT_DETECTION_CHANNEL_MAX, BEAT_DETECTION_CHANNEL_DUAL };
+    for (uint8_t channel = 1; channel <= 2; channel++) {
+        test_buffer_t buffer;
+        if (test_synthesize(&buffer, channel, BEAT_DETECTION_FORMAT_S16, false) != 0) {
+            TEST_CHECK(false, "out of memory");
+            return;
+        }
+        for (size_t m = 0; m < (channel == 2 ? sizeof(modes) / sizeof(modes[0]) : 1); m++) {
+            for (int engine = BEAT_DETECTION_ENGINE_COMPLEX_FFT; engine <= BEAT_DETECTION_ENGINE_FFT_Q15; engine++) {
+                beat_detection_cfg_t cfg = test_default_cfg(channel, BEAT_DETECTION_FORMAT_S16);
+                cfg.audio_cfg.channel_mode = modes[m];
+                cfg.audio_cfg.engine = (beat_detection_engine_t)engine;
+                cfg.audio_cfg.hop_size = 128;
+                test_result_t ungated;
+                snprintf(s_case, sizeof(s_case), "gate, %u channels, mode %d, engine %d, ungated", channel, modes[m], engine);
+                TEST_CHECK(test_run(cfg, &buffer, TEST_PATH_BATCH, &ungated) == ESP_OK, "run failed");
+                // The pipeline takes a single detector, so not MAX or DUAL
+                for (int pipeline = 0; pipeline <= (modes[m] == BEAT_DETECTION_CHANNEL_MID); pipeline++) {
+                    cfg.flags.silence_gate = true;
+                    cfg.flags.pipeline = pipeline;
+                    cfg.gate_cfg.close_level = 0.01f;
+                    cfg.gate_cfg.open_level = 0.02f;
+                    char name[96];
+                    snprintf(name, sizeof(name), "gate, %u channels, mode %d, engine %d%s", channel, modes[m], engine, pipeline ? ", pipeline" : "");
+                    for (int path = TEST_PATH_BATCH; path <= TEST_PATH_LEND; path++) {
+                        test_result_t result;
+                        snprintf(s_case, sizeof(s_case), "%s, %s", name, s_path_names[path]);
+                        esp_err_t ret = test_run(cfg, &buffer, (test_path_t)path, &result);
+                        TEST_CHECK(ret == ESP_OK, "run failed: %s", esp_err_to_name(ret));
+                        bool same = result.beat_count == ungated.beat_count
+                                    && memcmp(result.beats, ungated.beats, sizeof(uint64_t) * (ungated.beat_count < TEST_MAX_BEATS ? ungated.beat_count : TEST_MAX_BEATS)) == 0;
+                        TEST_CHECK(same, "%u beats, %u without the gate, or other timestamps", (unsigned)result.beat_count, (unsigned)ungated.beat_count);
+                    }
+                }
+            }
+        }
+        test_buffer_free(&buffer);
+    }
+}
+
+/* Negative full scale on both channels is the largest mid sample; its power must keep the gate open */
+static void test_gate_full_scale(void)
+{
+    const size_t frames = 8;
+    for (int format = BEAT_DETECTION_FORMAT_S16; format <= BEAT_DETECTION_FORMAT_S32; format++) {
+        for (uint8_t channel = 1; channel <= 2; channel++) {
+            for (int engine = BEAT_DETECTION_ENGINE_COMPLEX_FFT; engine <= BEAT_DETECTION_ENGINE_FFT_Q15; engine++) {
+                beat_detection_cfg_t cfg = test_default_cfg(channel, (beat_detection_sample_format_t)format);
+                cfg.audio_cfg.channel_mode = BEAT_DETECTION_CHANNEL_MID;
+                cfg.audio_cfg.engine = (beat_detection_engine_t)engine;
+                cfg.flags.synchronous = true;
+                cfg.flags.silence_gate = true;
+                cfg.gate_cfg.open_level = 0.5f;
+                cfg.gate_cfg.close_level = 0.5f;
+                snprintf(s_case, sizeof(s_case), "gate at full scale, format %d, %u channels, engine %d", format, channel, engine);
+                size_t count = frames * cfg.audio_cfg.fft_size * channel;
+                test_buffer_t buffer;
+                if (test_buffer_alloc(&buffer, count * test_sample_bytes(cfg.audio_cfg.format)) != 0) {
+                    TEST_CHECK(false, "out of memory");
+                    return;
+                }
+                for (size_t i = 0; i < count; i++) {
+                    if (format == BEAT_DETECTION_FORMAT_S16) {
+                        ((int16_t *)buffer.samples)[i] = INT16_MIN;
+                    } else {
+                        ((int32_t *)buffer.samples)[i] = (format == BEAT_DETECTION_FORMAT_S32) ? INT32_MIN : 0x00800000;
+                    }
+                }
+                beat_detection_handle_t handle = NULL;
+                beat_detection_stats_t stats = { 0 };
+                esp_err_t ret = beat_detection_init(&cfg, &handle);
+                for (size_t f = 0; f < frames && ret == ESP_OK; f++) {
+                    size_t frame_bytes = buffer.bytes / frames;
+                    beat_detection_audio_buffer_t audio = { .audio_buffer = buffer.samples + f * frame_bytes, .bytes_size = frame_bytes };
+                    ret = beat_detection_process(handle, audio, NULL);
+                }
+                if (ret == ESP_OK) {
+                    ret = beat_detection_get_stats(handle, &stats, NULL);
+                }
+                TEST_CHECK(ret == ESP_OK, "run failed: %s", esp_err_to_name(ret));
+                TEST_CHECK(stats.frames_gated == 0, "%u of %u frames gated", (unsigned)stats.frames_gated, (unsigned)frames);
+                if (handle != NULL) {
+                    beat_detection_deinit(&handle);
+                }
+                test_buffer_free(&buffer);
+            }
+        }
+    }
+}
+
+/*
+ * Goertzel magnitudes against the complex FFT reference. The filters run the two frame halves separately
+ * and merge them with a sign that alternates with the bin, so one band spans every bin of the FFT.
+ */
+static void test_goertzel_merge(void)
+{
+    test_buffer_t buffer;
+    if (test_synthesize(&buffer, 2, BEAT_DETECTION_FORMAT_S16, false) != 0) {
+        TEST_CHECK(false, "out of memory");
+        return;
+    }
+    for (int wide = 0; wide <= 1; wide++) {
+        beat_detection_cfg_t cfg = test_default_cfg(2, BEAT_DETECTION_FORMAT_S16);
+        cfg.audio_cfg.engine = BEAT_DETECTION_ENGINE_GOERTZEL;
+        cfg.audio_cfg.channel_mode = BEAT_DETECTION_CHANNEL_MID;
+        cfg.audio_cfg.hop_size = 128;
+        cfg.audio_cfg.bass_freq_start = wide ? 0 : 200;
+        cfg.audio_cfg.bass_freq_end = wide ? TEST_SAMPLE_RATE / 2 : 300;
+        cfg.flags.synchronous = true;
+        cfg.flags.verify_engine = true;
+        snprintf(s_case, sizeof(s_case), "goertzel merge, %d-%d Hz", cfg.audio_cfg.bass_freq_start, cfg.audio_cfg.bass_freq_end);
+        beat_detection_handle_t handle = NULL;
+        beat_detection_verify_result_t verify = { 0 };
+        esp_err_t ret = beat_detection_init(&cfg, &handle);
+        size_t step = test_step(&cfg);
+        size_t frame_bytes = 2 * sizeof(int16_t);
+        for (size_t i = 0; (i + step) * frame_bytes <= buffer.bytes && ret == ESP_OK; i += step) {
+            beat_detection_audio_buffer_t audio = { .audio_buffer = buffer.samples + i * frame_bytes, .bytes_size = step * frame_bytes };
+            ret = beat_detection_process(handle, audio, NULL);
+        }
+        if (ret == ESP_OK) {
+            ret = beat_detection_get_verify_result(handle, &verify);
+        }
+        TEST_CHECK(ret == ESP_OK, "run failed: %s", esp_err_to_name(ret));
+        TEST_CHECK(verify.frame_count > 0 && verify.max_rel_error <= 1e-3f, "max rel error %g over %u frames",
+                   (double)verify.max_rel_error, (unsigned)verify.frame_count);
+        if (handle != NULL) {
+            beat_detection_deinit(&handle);
+        }
+    }
+    test_buffer_free(&buffer);
+}
+
+/* Kicks after digital silence: the previous band sum is exactly zero, the average ratio must still fire */
+static void test_silence_onset(void)
+{
+    const size_t count = (size_t)TEST_SECONDS * TEST_SAMPLE_RATE;
+    test_buffer_t buffer;
+    if (test_buffer_alloc(&buffer, count * sizeof(int16_t)) != 0) {
+        TEST_CHECK(false, "out of memory");
+        return;
+    }
+    size_t burst_len = TEST_SAMPLE_RATE * 60 / 1000;
+    for (size_t n = 0; n < count; n++) {
+        size_t phase = n % TEST_KICK_PERIOD;
+        float envelope = (phase < burst_len) ? expf(-(float)phase / (float)(burst_len / 4)) : 0.0f;
+        ((int16_t *)buffer.samples)[n] = (int16_t)(12000.0f * envelope * sinf(2.0f * (float)M_PI * 250.0f * (float)n / (float)TEST_SAMPLE_RATE));
+    }
+    for (int engine = BEAT_DETECTION_ENGINE_COMPLEX_FFT; engine <= BEAT_DETECTION_ENGINE_FFT_Q15; engine++) {
+        beat_detection_cfg_t cfg = test_default_cfg(1, BEAT_DETECTION_FORMAT_S16);
+        cfg.audio_cfg.engine = (beat_detection_engine_t)engine;
+        cfg.audio_cfg.hop_size = 128;
+        char name[64];
+        snprintf(name, sizeof(name), "kicks after silence, engine %d", engine);
+        test_paths(name, &cfg, &buffer, 0xffff);
+    }
+    test_buffer_free(&buffer);
+}
+
+/*
+ * Q15 magnitudes against the complex FFT reference on kick bursts over noise at full, -24 dB and
+ * -48 dB level. Block scaling keeps the error at a few LSB of the frame's own peak, so it must not
+ * grow as the level drops; without it a -48 dB frame is buried in the FFT rounding noise.
+ */
+static void test_q15_precision(void)
+{
+    static const float levels[] = { 1.0f, 1.0f / 16.0f, 1.0f / 256.0f };
+    const float tolerance = TEST_Q15_TOLERANCE;
+    const size_t count = (size_t)TEST_SECONDS * TEST_SAMPLE_RATE;
+    for (int format = BEAT_DETECTION_FORMAT_S16; format <= BEAT_DETECTION_FORMAT_S32; format += BEAT_DETECTION_FORMAT_S32 - BEAT_DETECTION_FORMAT_S16) {
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+            beat_detection_cfg_t cfg = test_default_cfg(1, (beat_detection_sample_format_t)format);
+            cfg.audio_cfg.engine = BEAT_DETECTION_ENGINE_FFT_Q15;
+            cfg.audio_cfg.hop_size = 128;
+            cfg.flags.synchronous = true;
+            cfg.flags.verify_engine = true;
+            snprintf(s_case, sizeof(s_case), "q15 precision, format %d, level 1/%d", format, (int)(1.0f / levels[l]));
+            test_buffer_t buffer;
+            if (test_buffer_alloc(&buffer, count * test_sample_bytes(cfg.audio_cfg.format)) != 0) {
+                TEST_CHECK(false, "out of memory");
+                return;
+            }
+            size_t burst_len = TEST_SAMPLE_RATE * 60 / 1000;
+            uint32_t seed = 1;
+            for (size_t n = 0; n < count; n++) {
+                seed = seed * 1103515245u + 12345u;
+                float x = ((float)((seed >> 16) & 0x7fff) / 32768.0f - 0.5f) * 200.0f;
+                size_t phase = n % TEST_KICK_PERIOD;
+                if (phase < burst_len) {
+                    float envelope = expf(-(float)phase / (float)(burst_len / 4));
+                    x += 30000.0f * envelope * sinf(2.0f * (float)M_PI * 250.0f * (float)n / (float)TEST_SAMPLE_RATE);
+                }
+                x *= levels[l];
+                if (format == BEAT_DETECTION_FORMAT_S16) {
+                    ((int16_t *)buffer.samples)[n] = (int16_t)lrintf(x);
+                } else {
+                    ((int32_t *)buffer.samples)[n] = (int32_t)lrintf(x * 65536.0f);
+                }
+            }
+            beat_detection_handle_t handle = NULL;
+            beat_detection_verify_result_t verify = { 0 };
+            esp_err_t ret = beat_detection_init(&cfg, &handle);
+            size_t step = test_step(&cfg);
+            for (size_t i = 0; i + step <= count && ret == ESP_OK; i += step) {
+                beat_detection_audio_buffer_t audio = {
+                    .audio_buffer = buffer.samples + i * test_sample_bytes(cfg.audio_cfg.format),
+                    .bytes_size = step * test_sample_bytes(cfg.audio_cfg.format),
+                };
+                ret = beat_detection_process(handle, audio, NULL);
+            }
+            if (ret == ESP_OK) {
+                ret = beat_detection_get_verify_result(handle, &verify);
+            }
+            TEST_CHECK(ret == ESP_OK, "run failed: %s", esp_err_to_name(ret));
+            TEST_CHECK(verify.frame_count > 0 && verify.max_rel_error <= tolerance, "max rel error %g over %u frames, tolerance %g",
+                       (double)verify.max_rel_error, (unsigned)verify.frame_count, (double)tolerance);
+            if (handle != NULL) {
+                beat_detection_deinit(&handle);
+            }
+            test_buffer_free(&buffer);
+        }
+    }
+}
+
+static void test_le32(uint8_t *p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+/*
+ * 16 kHz mono WAV images ending at the guard page, with a 20-byte chunk between fmt and data whose size
+ * field is under test. A size past the image must be rejected before the parser advances by it, also
+ * when it would wrap a 32-bit size_t. A data chunk longer than the image still yields what is present.
+ */
+static void test_wav_parse(void)
+{
+    static const struct {
+        uint32_t  junk_size;
+        uint32_t  data_size;
+        esp_err_t expected;
+    } cases[] = {
+        { 20, 128, ESP_OK },
+        { 20, 0xffffffffu, ESP_OK },
+        { 0x7fffffffu, 128, ESP_ERR_INVALID_SIZE },
+        { 0xfffffff0u, 128, ESP_ERR_INVALID_SIZE },
+        { 0xffffffffu, 128, ESP_ERR_INVALID_SIZE },
+    };
+    const size_t sample_count = 64;
+    const size_t size = 12 + 8 + 16 + 8 + 20 + 8 + sample_count * sizeof(int16_t);
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        snprintf(s_case, sizeof(s_case), "wav parse, chunk of 0x%x bytes, data of 0x%x bytes",
+                 (unsigned)cases[c].junk_size, (unsigned)cases[c].data_size);
+        test_buffer_t buffer;
+        if (test_buffer_alloc(&buffer, size) != 0) {
+            TEST_CHECK(false, "out of memory");
+            return;
+        }
+        uint8_t *p = buffer.samples;
+        memset(p, 0, size);
+        memcpy(p, "RIFF", 4);
+        test_le32(p + 4, (uint32_t)(size - 8));
+        memcpy(p + 8, "WAVEfmt ", 8);
+        test_le32(p + 16, 16);
+        p[20] = 1;                                  // PCM
+        p[22] = 1;                                  // Mono
+        test_le32(p + 24, TEST_SAMPLE_RATE);
+        p[34] = 16;                                 // Bits per sample
+        memcpy(p + 36, "junk", 4);
+        test_le32(p + 40, cases[c].junk_size);
+        memcpy(p + 64, "data", 4);
+        test_le32(p + 68, cases[c].data_size);
+
+        beat_detection_wav_info_t info;
+        esp_err_t ret = beat_detection_wav_parse(buffer.samples, size, &info);
+        TEST_CHECK(ret == cases[c].expected, "returned %s, expected %s", esp_err_to_name(ret), esp_err_to_name(cases[c].expected));
+        if (ret == ESP_OK) {
+            TEST_CHECK(info.samples == p + 72 && info.sample_count == sample_count && info.sample_rate == TEST_SAMPLE_RATE
+                       && info.channel == 1 && info.format == BEAT_DETECTION_FORMAT_S16, "%u samples at offset %d",
+                       (unsigned)info.sample_count, (int)((const uint8_t *)info.samples - p));
+        }
+        test_buffer_free(&buffer);
+    }
+}
+
+int main(void)
+{
+    test_engines();
+    test_channel_modes();
+    test_formats();
+    test_decimation();
+    test_gate();
+    test_gate_full_scale();
+    test_goertzel_merge();
+    test_silence_onset();
+    test_q15_precision();
+    test_wav_parse();
+    printf("%u checks, %u failed\n", (unsigned)s_checks, (unsigned)s_failures);
+    return (s_failures == 0) ? 0 : 1;
+}
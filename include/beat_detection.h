@@ -6,9 +6,12 @@
 
 #pragma once
 
+#include "sdkconfig.h"
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "beat_detection_config.h"
 #include <stdbool.h>
 
@@ -22,37 +25,332 @@ typedef enum {
     BEAT_DETECTION_FAILED = 2,
 } beat_detection_result_t;
 
+typedef enum {
+    BEAT_DETECTION_ENGINE_COMPLEX_FFT = 0,  /*!< Full-size complex FFT with a zero imaginary channel */
+    BEAT_DETECTION_ENGINE_REAL_FFT = 1,     /*!< Real-input FFT: N/2 complex FFT followed by a split */
+    BEAT_DETECTION_ENGINE_GOERTZEL = 2,     /*!< Goertzel filters over the bass band only, no FFT */
+    BEAT_DETECTION_ENGINE_FFT_Q15 = 3,      /*!< Fixed-point Q15 window and dsps_fft2r_sc16, compares power */
+} beat_detection_engine_t;
+
+typedef enum {
+    BEAT_DETECTION_CHANNEL_RIGHT = 0,       /*!< Right channel only (default, as before) */
+    BEAT_DETECTION_CHANNEL_LEFT = 1,        /*!< Left channel only */
+    BEAT_DETECTION_CHANNEL_MID = 2,         /*!< Mid downmix (L + R) / 2 */
+    BEAT_DETECTION_CHANNEL_MAX = 3,         /*!< Both channels analyzed, louder channel per bin */
+    BEAT_DETECTION_CHANNEL_DUAL = 4,        /*!< Independent detection on both channels in one task */
+} beat_detection_channel_mode_t;
+
+/**
+ * @brief Layout of one interleaved input sample
+ */
+typedef enum {
+    BEAT_DETECTION_FORMAT_S16 = 0,          /*!< 16-bit signed samples */
+    BEAT_DETECTION_FORMAT_S24_32 = 1,       /*!< 24-bit signed samples in the low bits of 32-bit words, upper byte ignored */
+    BEAT_DETECTION_FORMAT_S32 = 2,          /*!< 32-bit signed samples, also 24-bit data left-justified in 32-bit slots */
+} beat_detection_sample_format_t;
+
+/**
+ * @brief Spacing of the exported feature bands, see beat_detection_get_features()
+ */
+typedef enum {
+    BEAT_DETECTION_FEATURE_SCALE_LOG = 0,   /*!< Equal width in log frequency */
+    BEAT_DETECTION_FEATURE_SCALE_MEL = 1,   /*!< Equal width on the mel scale, closer to linear below 700 Hz */
+} beat_detection_feature_scale_t;
+
+/**
+ * @brief Processing stages of one analysis frame, used for profiling
+ */
+typedef enum {
+    BEAT_DETECTION_STAGE_CONVERT = 0,       /*!< PCM to float (or Q15) conversion and windowing */
+    BEAT_DETECTION_STAGE_FFT,               /*!< FFT and bit reversal, or Goertzel filtering */
+    BEAT_DETECTION_STAGE_MAGNITUDE,         /*!< Magnitude or power of the bins */
+    BEAT_DETECTION_STAGE_DECISION,          /*!< Smoothing, band reduction and beat decision */
+    BEAT_DETECTION_STAGE_CALLBACK,          /*!< Release, result, event and tempo callbacks */
+    BEAT_DETECTION_STAGE_MAX,
+} beat_detection_stage_t;
+
+/**
+ * @brief Reasons for audio to be rejected before analysis
+ */
+typedef enum {
+    BEAT_DETECTION_DROP_RING_FULL = 0,      /*!< No free ring frame within the write timeout */
+    BEAT_DETECTION_DROP_LEND_FULL,          /*!< Too many lent buffers outstanding */
+    BEAT_DETECTION_DROP_INVALID,            /*!< Wrong buffer size or API misuse */
+    BEAT_DETECTION_DROP_MAX,
+} beat_detection_drop_reason_t;
+
+/**
+ * @brief Runtime statistics, see beat_detection_get_stats()
+ */
+typedef struct {
+    uint32_t frames_in;                     /*!< Analysis frames queued to the task */
+    uint32_t frames_processed;              /*!< Analysis frames completed, callbacks included */
+    uint32_t frames_failed;                 /*!< Frames whose analysis returned BEAT_DETECTION_FAILED */
+    uint32_t frames_gated;                  /*!< Frames that skipped the FFT and magnitude behind the silence gate */
+    uint32_t dropped[BEAT_DETECTION_DROP_MAX];  /*!< Rejected writes by reason */
+    uint32_t dropped_samples;               /*!< Samples per channel lost in rejected writes */
+    uint32_t queue_high_water;              /*!< Most queue items waiting at once */
+    uint32_t events_dropped;                /*!< Beat events lost because the event ring was full */
+    uint32_t stack_high_water;              /*!< Least free stack of the task, as reported by uxTaskGetStackHighWaterMark() */
+    struct {
+        uint32_t min;
+        uint32_t avg;
+        uint32_t max;
+    } cycles[BEAT_DETECTION_STAGE_MAX];     /*!< CPU cycles per frame, 0 without CONFIG_BEAT_DETECTION_PROFILE */
+} beat_detection_stats_t;
+
+/**
+ * @brief Counters behind beat_detection_stats_t (internal)
+ */
+typedef struct {
+    uint32_t frames_in;
+    uint32_t frames_processed;
+    uint32_t frames_failed;
+    uint32_t frames_gated;
+    uint32_t dropped[BEAT_DETECTION_DROP_MAX];
+    uint32_t dropped_samples;
+    uint32_t queue_high_water;
+    uint32_t events_dropped;
+    uint32_t cycles_min[BEAT_DETECTION_STAGE_MAX];
+    uint32_t cycles_max[BEAT_DETECTION_STAGE_MAX];
+    uint64_t cycles_total[BEAT_DETECTION_STAGE_MAX];
+} beat_detection_counters_t;
+
+/**
+ * @brief Result of comparing the selected engine against the complex FFT reference path
+ */
+typedef struct {
+    uint32_t frame_count;           /*!< Number of compared frames */
+    uint32_t exact_frame_count;     /*!< Frames whose magnitude spectrum matched bit for bit */
+    float    max_abs_error;         /*!< Largest absolute magnitude difference seen */
+    float    max_rel_error;         /*!< Largest difference relative to the frame's peak magnitude */
+} beat_detection_verify_result_t;
+
 typedef struct {
     uint8_t *audio_buffer;
     size_t bytes_size;
 } beat_detection_audio_buffer_t;
 
+/**
+ * @brief PCM stream located inside a WAV file image, see beat_detection_wav_parse()
+ */
+typedef struct {
+    const void*     samples;        /*!< Interleaved samples, points into the WAV image */
+    size_t          sample_count;   /*!< Samples per channel */
+    uint32_t        sample_rate;    /*!< Sample rate in Hz */
+    uint8_t         channel;        /*!< Number of channels */
+    beat_detection_sample_format_t format;  /*!< BEAT_DETECTION_FORMAT_S16 or BEAT_DETECTION_FORMAT_S32 */
+} beat_detection_wav_info_t;
+
+/**
+ * @brief Analysis result of one frame, positioned on the sample clock
+ */
+typedef struct {
+    beat_detection_result_t result;         /*!< BEAT_DETECTED or BEAT_NOT_DETECTED */
+    uint64_t                sample_index;   /*!< Samples per channel written before the end of the analysis frame */
+    float                   energy;         /*!< Peak smoothed bass magnitude of the frame */
+    float                   surge_ratio;    /*!< energy divided by the previous frame's peak, 0 if that was 0 */
+    uint32_t                band_mask;      /*!< Bit n is set when band n triggered in this frame */
+    uint8_t                 channel;        /*!< Detecting channel in BEAT_DETECTION_CHANNEL_DUAL: 0 left, 1 right; 0 otherwise */
+} beat_detection_event_t;
+
+/**
+ * @brief Spectral features of one analysis frame, see beat_detection_get_features()
+ */
+typedef struct {
+    uint64_t    sample_index;       /*!< Samples per channel written before the end of the analysis frame */
+    uint32_t    sequence;           /*!< Frames published so far, this one included; a reader compares it to spot new frames */
+    float       bass_energy;        /*!< Peak smoothed magnitude of band 0, as in beat_detection_event_t.energy */
+    float       onset;              /*!< Onset strength, the summed log rise of the band energies fed to the tempo tracker */
+    uint8_t     band_num;           /*!< Valid entries of bands */
+    float       bands[BEAT_DETECTION_MAX_FEATURE_BANDS];  /*!< RMS smoothed magnitude of each feature band, lowest band first */
+} beat_detection_features_t;
+
+/**
+ * @brief Detection settings of one frequency band
+ */
+typedef struct {
+    uint16_t    freq_start;     /*!< Lower edge in Hz */
+    uint16_t    freq_end;       /*!< Upper edge in Hz */
+    float       threshold;      /*!< Peak magnitude surge ratio that triggers the band, unused with flags.adaptive_threshold */
+    float       average_ratio;  /*!< Summed magnitude ratio that triggers the band, unused with flags.adaptive_threshold */
+    float       min_energy;     /*!< Minimum peak magnitude */
+    uint32_t    time_interval;  /*!< Refractory period of the band in ms, measured on the sample clock */
+} beat_detection_band_cfg_t;
+
+/**
+ * @brief Flags of a trace record
+ */
+typedef enum {
+    BEAT_DETECTION_TRACE_TRIGGERED = 1 << 0,    /*!< The band triggered in this frame */
+    BEAT_DETECTION_TRACE_GATED = 1 << 1,        /*!< The frame skipped the FFT behind the silence gate */
+} beat_detection_trace_flag_t;
+
+/**
+ * @brief Decision inputs of one band in one analysis frame, see beat_detection_trace_read()
+ *
+ * The values are powers with BEAT_DETECTION_ENGINE_FFT_Q15 and magnitudes otherwise, compared
+ * as they are against the band settings squared or not.
+ */
+typedef struct {
+    uint64_t    sample_index;   /*!< Samples per channel written before the end of the analysis frame */
+    uint32_t    sequence;       /*!< Records produced before this one; a gap means records were dropped */
+    float       current_peak;   /*!< Largest smoothed bin of the band */
+    float       prev_peak;      /*!< Largest bin of the previous frame */
+    float       current_sum;    /*!< Sum of the smoothed bins of the band */
+    float       prev_sum;       /*!< Sum of the bins of the previous frame */
+    uint8_t     band;           /*!< Band index */
+    uint8_t     channel;        /*!< Detecting channel, as in beat_detection_event_t */
+    uint8_t     flags;          /*!< beat_detection_trace_flag_t bits */
+    uint8_t     reserved;
+} beat_detection_trace_record_t;
+
+#define BEAT_DETECTION_TRACE_MAGIC      (0x52544442)    /*!< "BDTR" in little-endian byte order */
+#define BEAT_DETECTION_TRACE_VERSION    (1)
+
+/**
+ * @brief Header written by beat_detection_trace_dump() in front of every block of records
+ *
+ * Headers and records are written in the byte order of the chip, little-endian on every ESP chip.
+ */
+typedef struct {
+    uint32_t    magic;          /*!< BEAT_DETECTION_TRACE_MAGIC */
+    uint16_t    version;        /*!< BEAT_DETECTION_TRACE_VERSION */
+    uint16_t    record_size;    /*!< sizeof(beat_detection_trace_record_t) */
+    uint32_t    record_count;   /*!< Records following this header */
+    uint32_t    dropped;        /*!< Records lost to a full trace ring since init */
+    uint32_t    sample_rate;    /*!< Input sample rate in Hz, the clock of sample_index and time_interval */
+    uint32_t    frame_step;     /*!< Input samples per channel between analysis frames */
+    uint8_t     band_num;       /*!< Valid entries of bands */
+    uint8_t     power_domain;   /*!< 1 when the records hold powers */
+    uint8_t     adaptive;       /*!< 1 when the detector ran with flags.adaptive_threshold */
+    uint8_t     reserved;
+    beat_detection_band_cfg_t bands[BEAT_DETECTION_MAX_BANDS];  /*!< Band settings the detector ran with */
+} beat_detection_trace_header_t;
+
+/**
+ * @brief Runtime state of one frequency band (internal)
+ */
+typedef struct {
+    uint16_t    bin_start;
+    uint16_t    bin_end;
+    float       threshold;          // Squared in the power domain
+    float       average_ratio;      // Squared in the power domain
+    float       min_energy;         // Squared in the power domain
+    uint64_t    interval_samples;   // time_interval in samples
+    uint64_t    next_beat_sample;   // First sample position at which the band may trigger again
+    float       flux_sum;           // Running sum of the flux history, adaptive thresholding only
+    float       flux_sq_sum;        // Running sum of squares of the flux history
+} beat_detection_band_t;
+
+/**
+ * @brief Tempo and beat phase estimate of the tempo tracker
+ */
+typedef struct {
+    float       bpm;                /*!< Current tempo estimate */
+    float       confidence;         /*!< 0..1, normalized autocorrelation at the tempo lag */
+    float       beat_period;        /*!< Beat period in samples */
+    uint64_t    next_beat_sample;   /*!< Predicted sample position of the next beat, 0 before the first beat */
+    uint64_t    sample_index;       /*!< Sample position of the frame that produced this estimate */
+} beat_detection_tempo_t;
+
+/**
+ * @brief Bins of one exported feature band (internal)
+ */
+typedef struct {
+    uint16_t    bin_start;
+    uint16_t    bin_count;
+    float       scale;              // 1 / bin_count
+} beat_detection_feature_band_t;
+
+/**
+ * @brief One buffer of the feature triple buffer (internal)
+ */
+typedef struct {
+    uint32_t                    sequence;   // Sequence of the frame held, 0 while it is being written
+    beat_detection_features_t   frame;
+} beat_detection_feature_slot_t;
+
 typedef void (*beat_detection_result_callback_t)(beat_detection_result_t result, void *ctx);
+typedef void (*beat_detection_event_callback_t)(const beat_detection_event_t *event, void *ctx);
+typedef void (*beat_detection_tempo_callback_t)(const beat_detection_tempo_t *tempo, void *ctx);
+typedef void (*beat_detection_release_callback_t)(const uint8_t *audio_buffer, void *ctx);
+typedef esp_err_t (*beat_detection_trace_write_t)(const void *data, size_t bytes, void *ctx);
 
 /**
  * @brief Beat detection configuration structure
  */
 typedef struct {
     struct {
-        int16_t                         sample_rate;        // 采样率（Hz），默认 16000
+        uint32_t                        sample_rate;        // 采样率（Hz），默认 16000，支持 44100/48000/96000 等
         uint8_t                         channel;            // 声道数：1=单声道，2=双声道
+        beat_detection_sample_format_t  format;             // 样本格式：16 位、32 位字中的 24 位或 32 位，默认 BEAT_DETECTION_FORMAT_S16
         int16_t                         fft_size;           // FFT 大小（2的幂次），默认 512
+        int16_t                         hop_size;           // 流式分析帧移（样本数），0 表示每次写入只分析前 fft_size 个样本，默认 0
+        uint8_t                         decimation;         // 降采样倍数，大于 1 时先低通滤波并降采样，fft_size 与 hop_size 按降采样后的样本计，默认 1
+        beat_detection_engine_t         engine;             // 频谱分析引擎，默认 BEAT_DETECTION_ENGINE_COMPLEX_FFT
+        beat_detection_channel_mode_t   channel_mode;       // 双声道时的分析方式，默认 BEAT_DETECTION_CHANNEL_RIGHT
         int16_t                         bass_freq_start;    // 低音频率起始（Hz），默认 200
         int16_t                         bass_freq_end;      // 低音频率结束（Hz），默认 300
         float                           threshold;          // 低音能量突变阈值，默认 6.0f
         float                           average_ratio;      // 平均能量比值阈值，默认 5.0f
         float                           min_energy;         // 最小能量阈值，默认 0.01f
-        uint32_t                        time_interval;      // 两次检测之间的最小时间间隔，默认 100ms
+        uint32_t                        time_interval;      // 两次检测之间的最小间隔（ms，按样本计数），默认 100ms
+        uint8_t                         band_num;           // 频段数量（最多 BEAT_DETECTION_MAX_BANDS），0 表示只使用上面的低音频段配置，默认 0
+        const beat_detection_band_cfg_t *bands;             // 频段配置数组，band_num > 0 时有效，初始化时复制
     }audio_cfg;
     struct {
         UBaseType_t                     priority;           // 任务优先级，默认 3
         uint32_t                        stack_size;         // 任务栈大小（字节），默认 8192
         BaseType_t                      core_id;            // 任务绑定的 CPU 核心，默认 0
+        BaseType_t                      pipeline_core_id;   // 流水线模式下判决任务绑定的 CPU 核心，默认 1
     }task_cfg;
+    struct {
+        uint8_t                         frame_num;          // 环形缓冲区深度（帧数），默认 4
+        uint32_t                        write_timeout_ms;   // 阻塞写入时等待空闲帧的最长时间（ms），默认 100
+    }buffer_cfg;
+    struct {
+        uint16_t                        bpm_min;            // 跟踪的最低 BPM，默认 60
+        uint16_t                        bpm_max;            // 跟踪的最高 BPM，默认 200
+        uint32_t                        lead_ms;            // 预测回调比预测节拍提前的时间（ms），默认 0
+        float                           min_confidence;     // 置信度低于该值时不触发预测回调，默认 0.3
+    }tempo_cfg;
+    struct {
+        uint32_t                        window_ms;          // 频谱通量统计窗口（ms），默认 1000
+        float                           k;                  // 触发阈值 = 均值 + k·标准差（对数压缩后的通量），默认 3.0
+    }adaptive_cfg;
+    struct {
+        float                           open_level;         // 静音门打开的帧 RMS（相对满幅），默认 0.001（约 -60 dBFS）
+        float                           close_level;        // 静音门关闭的帧 RMS，不大于 open_level，两者之间为回差，默认 0.0005（约 -66 dBFS）
+    }gate_cfg;
+    struct {
+        uint16_t                        depth;              // 鼓点事件环形队列深度（2 的幂），0 表示不启用，默认 0
+        uint16_t                        notify_count;       // 累计多少个事件后通知 notify_task，默认 1
+        uint32_t                        notify_timeout_ms;  // 有事件未通知且已等待该时间后也通知，0 表示只按数量通知，默认 0
+        TaskHandle_t                    notify_task;        // 接收 xTaskNotifyGive() 的消费任务，NULL 表示只轮询，默认 NULL
+    }event_queue_cfg;
+    struct {
+        uint8_t                         band_num;           // 导出的频谱特征频段数（最多 BEAT_DETECTION_MAX_FEATURE_BANDS），0 表示不启用，默认 0
+        beat_detection_feature_scale_t  scale;              // 频段划分方式：对数或梅尔刻度，默认 BEAT_DETECTION_FEATURE_SCALE_LOG
+        uint16_t                        freq_min;           // 最低频段的下边界（Hz），默认 40
+        uint16_t                        freq_max;           // 最高频段的上边界（Hz），超过奈奎斯特频率时取奈奎斯特频率，默认 8000
+    }feature_cfg;
+    struct {
+        uint16_t                        depth;              // 判决跟踪记录环形队列深度（2 的幂，每帧每个频段一条记录），0 表示不启用，默认 0
+    }trace_cfg;
     beat_detection_result_callback_t    result_callback;
-    void*                               result_callback_ctx;
+    void*                               result_callback_ctx;    // result_callback 与 event_callback 共用
+    beat_detection_event_callback_t     event_callback;         // 每帧的事件回调（采样位置、能量、突变比），可为 NULL
+    beat_detection_tempo_callback_t     tempo_callback;         // 预测节拍回调，在预测节拍前 lead_ms 触发，可为 NULL
     struct {
         bool enable_psram : 1;
+        bool write_blocking : 1;                            // 缓冲区满时写入是否阻塞等待，默认 false
+        bool verify_engine : 1;                             // 每帧同时运行复数 FFT 参考路径并比对频谱，默认 false
+        bool tempo_tracking : 1;                            // 启用 BPM 与节拍相位跟踪，默认 false
+        bool adaptive_threshold : 1;                        // 用频谱通量的滑动均值与标准差代替固定阈值，默认 false
+        bool synchronous : 1;                               // 不创建检测任务，由调用者通过 beat_detection_process() 同步处理，默认 false
+        bool pipeline : 1;                                  // 双核流水线：转换与 FFT 和幅度、判决、回调分别在两个任务中并行，默认 false
+        bool silence_gate : 1;                              // 静音门：帧 RMS 低于门限时跳过 FFT 与幅度计算，默认 false
     }flags;
 } beat_detection_cfg_t;
 
@@ -63,20 +361,46 @@ typedef struct beat_detection {
     struct {
         float*                              fft_buffer;
         int16_t                             fft_size;
-        float*                              window;
-        int16_t                             sample_rate;
+        int16_t                             hop_size;
+        uint8_t*                            history;            // Last fft_size input samples of every channel, in the input format
+        beat_detection_engine_t             engine;
+        float*                              fft_twiddle;        // Shared with other handles of the same fft_size
+        int16_t*                            twiddle_sc16;       // Shared
+        float*                              rfft_twiddle;       // Shared
+        float*                              goertzel_coeff;
+        float*                              goertzel_state;
+        float                               goertzel_window_rot[4];     // Window phasor step, then the phasor at sample fft_size / 2
+        int16_t*                            fft_buffer_sc16;
+        int16_t*                            window_q15;         // Shared
+        float                               q15_power_scale;
+        uint16_t                            mag_bin_start;
+        uint16_t                            mag_bin_count;
+        float*                              window;             // Shared
+        uint32_t                            sample_rate;
         uint8_t                             channel;
-        uint8_t                             bass_bin_start;
-        uint8_t                             bass_bin_end;
-        float                               threshold;
-        float                               average_ratio;
-        float                               min_energy;
-        uint32_t                            time_interval;
+        beat_detection_sample_format_t      format;
+        uint8_t                             sample_bytes;       // Bytes of one sample of one channel
+        uint8_t                             sample_shift;       // Left shift that puts a 32-bit word's sample at the top
+        beat_detection_channel_mode_t       channel_mode;
+        uint8_t                             channel_offset;     // Interleaved channel read by this detector
+        uint8_t                             detector;           // Reported channel: 1 for the DUAL peer, 0 otherwise
+        bool                                channel_mix;        // Mid downmix of both channels
+        struct beat_detection*              peer;               // Right channel detector of the MAX and DUAL modes
+        beat_detection_band_t               bands[BEAT_DETECTION_MAX_BANDS];
+        uint8_t                             band_num;
         float*                              magnitude;
         float*                              magnitude_prev;
-        uint64_t                            last_bass_detected_time;
+        uint64_t                            sample_index;       // Sample position just past the frame being analyzed
+        uint32_t                            frame_step;         // Input samples per channel between frames, or of one frame with hop_size 0
         beat_detection_result_callback_t    result_callback;
         void*                               result_callback_ctx;
+        beat_detection_event_callback_t     event_callback;
+#if CONFIG_BEAT_DETECTION_FIXED_LAYOUT
+        // Analysis buffers of the fixed layout, so a pooled handle needs no heap for them
+        float                               fft_storage[2 * CONFIG_BEAT_DETECTION_FIXED_FFT_SIZE];
+        float                               magnitude_storage[2][CONFIG_BEAT_DETECTION_FIXED_FFT_SIZE / 2];
+        int32_t                             history_storage[CONFIG_BEAT_DETECTION_FIXED_CHANNEL * CONFIG_BEAT_DETECTION_FIXED_FFT_SIZE];
+#endif
     }audio;
     struct {
         StackType_t*                        task_stack_buffer;
@@ -85,9 +409,134 @@ typedef struct beat_detection {
         void*                               task_ctx;
         QueueHandle_t                       audio_queue;
     }task;
+    struct {
+        uint8_t*                            buffer;
+        size_t                              frame_bytes;
+        uint8_t                             frame_num;
+        uint8_t                             write_index;
+        size_t                              fill_bytes;
+        bool                                frame_held;
+        bool                                frame_acquired;     // A frame is lent out by beat_detection_frame_acquire()
+        SemaphoreHandle_t                   free_frames;
+        SemaphoreHandle_t                   free_lends;         // Caller buffers that may still be queued by beat_detection_data_lend()
+        TickType_t                          write_timeout;
+        uint64_t                            write_sample;       // Samples per channel passed to data_write, dropped ones included
+    }ring;
+    struct {
+        float*                              fft_buffer;
+        float*                              magnitude;
+        beat_detection_verify_result_t      result;
+    }verify;
+    struct {
+        float*                              history;            // Mean-removed onset strength, lag_max + 1 frames
+        float*                              acf;                // Leaky autocorrelation for lag_min..lag_max, same allocation
+        float*                              prior;              // Tempo prior per lag, same allocation
+        uint16_t                            lag_min;
+        uint16_t                            lag_max;
+        uint16_t                            history_pos;
+        uint32_t                            frame_step;         // Samples between frames
+        float                               decay;
+        float                               mean;
+        float                               mean_rate;
+        float                               energy;
+        double                              next_beat;          // Predicted next beat in samples
+        bool                                locked;
+        uint32_t                            beat_number;        // Incremented for every predicted beat
+        uint32_t                            fired_number;       // beat_number of the last predictive callback
+        uint64_t                            lead_samples;
+        float                               min_confidence;
+        beat_detection_tempo_callback_t     callback;
+        beat_detection_tempo_t              state;              // Published estimate, guarded by lock
+        beat_detection_tempo_t              fired;              // Payload of the pending predictive callback
+        bool                                fire;               // A predictive callback is pending; its own byte, as only the decision task touches it
+        portMUX_TYPE                        lock;
+    }tempo;
+    struct {
+        float*                              history;            // Flux of the last window frames, window entries per band
+        uint16_t                            window;
+        uint16_t                            pos;
+        uint16_t                            count;              // Valid entries, saturates at window
+        uint16_t                            warmup;             // Frames needed before a band may trigger
+        float                               k;
+    }adaptive;
+    struct {
+        beat_detection_event_t*             buffer;             // Single-producer single-consumer ring of beat events
+        uint32_t                            mask;               // depth - 1
+        uint32_t                            head;               // Written by the detection task only
+        uint32_t                            tail;               // Written by the consumer only
+        uint16_t                            notify_count;
+        TickType_t                          notify_timeout;
+        TaskHandle_t                        notify_task;
+        uint32_t                            unnotified;         // Events pushed since the last notification
+        TickType_t                          unnotified_since;
+    }events;
+    struct {
+        uint32_t                            mark;
+        uint32_t                            frame_cycles[BEAT_DETECTION_STAGE_MAX];     // Current frame, only with CONFIG_BEAT_DETECTION_PROFILE
+        beat_detection_counters_t           total;              // Since init
+        beat_detection_counters_t           window;             // Since the last beat_detection_get_stats() with a window
+        portMUX_TYPE                        lock;
+    }profile;
+    struct {
+        const float*                        taps;               // Shared low-pass, taps_len symmetric coefficients
+        float*                              delay;              // Last taps_len input samples, stored twice so the dot product never wraps
+        float*                              history;            // Decimated analysis frame, fft_size samples scaled to +-1
+        uint16_t                            taps_len;
+        uint16_t                            pos;                // Oldest sample of the delay line
+        uint8_t                             factor;             // 1 when the input rate is analyzed directly
+    }decimator;
+    struct {
+        float                               open_power;         // Squared open_level, compared with the mean square of a frame
+        float                               close_power;        // Squared close_level
+        float                               power;              // Mean square of the last converted frame
+        bool                                open;               // Hysteresis state, owned by the task running the convert stage
+        uint8_t                             quiet;              // Quiet frames analyzed since the gate last opened, for the hold
+        bool                                skipped;            // The frame being decided skipped the transform
+    }gate;
+    struct {
+        void*                               spectrum[2];        // Engine output of two frames in flight, [0] is audio's own buffer
+        uint64_t                            sample_index[2];    // End of the frame held by each slot
+        uint32_t                            cycles[2][2];       // Convert and FFT cycles of each slot
+        bool                                gated[2];           // The slot skipped the FFT behind the silence gate
+        uint32_t                            mark;               // Profiling mark of the transform task
+        uint32_t                            produced;           // Written by the transform task only
+        uint32_t                            consumed;           // Written by the decision task only
+        TaskHandle_t                        transform_task;     // Set by the detection task before its first frame
+        TaskHandle_t                        decision_task;
+        StackType_t*                        stack_buffer;
+        StaticTask_t*                       tcb;
+    }pipeline;
+    struct {
+        beat_detection_feature_slot_t*      slots;              // Triple buffer, frame n is written to slot n % 3
+        beat_detection_feature_band_t*      bands;              // Band table, same allocation
+        uint32_t                            published;          // Sequence of the latest complete frame, written by the decision only
+        uint8_t                             band_num;
+    }features;
+    struct {
+        beat_detection_trace_header_t*      header;             // Settings of the detector, the records follow in the same allocation
+        beat_detection_trace_record_t*      records;            // Single-producer single-consumer ring of decision records
+        uint32_t                            mask;               // depth - 1
+        uint32_t                            head;               // Written by the decision only
+        uint32_t                            tail;               // Written by the consumer only
+        uint32_t                            dropped;            // Written by the decision only
+        struct beat_detection*              sink;               // Detector owning the ring, the left one in DUAL mode; NULL when not tracing
+    }trace;
+    struct {
+        uint8_t*                            base;               // Caller workspace holding the detector, NULL when heap allocated
+        size_t                              size;
+    }workspace;
+    // Set at init only: the bits share one word, so a task writing one of them would race with the others
     struct {
         bool enable_psram : 1;
-        bool is_calculating : 1;
+        bool write_blocking : 1;
+        bool verify_engine : 1;
+        bool power_domain : 1;
+        bool pooled : 1;
+        bool tempo_tracking : 1;
+        bool adaptive_threshold : 1;
+        bool synchronous : 1;
+        bool pipeline : 1;
+        bool silence_gate : 1;
     }status;
 } beat_detection_t;
 
@@ -107,6 +556,44 @@ typedef beat_detection_t* beat_detection_handle_t;
 */
 esp_err_t beat_detection_init(beat_detection_cfg_t *cfg, beat_detection_handle_t *handle);
 
+/**
+* @brief  Get the workspace size beat_detection_init_static() needs for a configuration
+*
+*         The size covers the handle, every analysis and ring buffer, the FFT tables, the
+*         queue and semaphores and the task stack and TCB, with each block aligned to
+*         BEAT_DETECTION_WORKSPACE_ALIGN. It is computed without allocating anything.
+*
+* @param  cfg   Configuration that will be passed to beat_detection_init_static()
+* @param  size  Receives the size in bytes
+*
+* @return
+*       - ESP_OK               Success
+*       - ESP_ERR_INVALID_ARG  Invalid arguments or a configuration init would reject
+*/
+esp_err_t beat_detection_get_workspace_size(const beat_detection_cfg_t *cfg, size_t *size);
+
+/**
+* @brief  Initialize a detector entirely inside a caller-provided workspace
+*
+*         Same as beat_detection_init(), but nothing is taken from the heap, the instance
+*         pool or the shared table registry: the handle, all buffers, private copies of the
+*         FFT tables, the queue, the semaphores and the task stack and TCB are carved from
+*         the workspace. flags.enable_psram is ignored; the memory type is the one of the
+*         workspace, which must be usable as a task stack. beat_detection_deinit() stops the
+*         task and leaves the workspace to the caller, who may reuse it afterwards.
+*
+* @param  cfg             Configuration
+* @param  workspace       Memory aligned to BEAT_DETECTION_WORKSPACE_ALIGN
+* @param  workspace_size  Size in bytes, at least beat_detection_get_workspace_size()
+* @param  handle          Receives the handle, which points into the workspace
+*
+* @return
+*       - ESP_OK               Success
+*       - ESP_ERR_INVALID_ARG  Invalid arguments, misaligned workspace or invalid configuration
+*       - ESP_ERR_NO_MEM       Workspace too small
+*/
+esp_err_t beat_detection_init_static(beat_detection_cfg_t *cfg, void *workspace, size_t workspace_size, beat_detection_handle_t *handle);
+
 /**
 * @brief  Deinitialize Beat Detection module
 *
@@ -123,16 +610,361 @@ esp_err_t beat_detection_deinit(beat_detection_handle_t *handle);
 * @brief  Write audio data to Beat Detection module
 *
 *         Write audio data to the Beat Detection module.
+*         With `hop_size` == 0 only the first `fft_size` samples of the buffer are analyzed.
+*         With `hop_size` > 0 (streaming mode) the buffer may have any length (whole sample
+*         frames); samples are appended to the stream and one analysis frame covering the
+*         latest `fft_size` samples is run every `hop_size` samples. With
+*         `audio_cfg.decimation` > 1 both sizes count decimated samples, so every size
+*         above is multiplied by the decimation factor in input samples.
+*         The frame is copied into a ring buffer preallocated at init, no memory is
+*         allocated here. When the ring is full the call waits up to `write_timeout_ms`
+*         if `flags.write_blocking` is set, otherwise it returns immediately; in both
+*         cases a rejected frame is counted as an overrun.
+*         Every written sample, dropped ones included, advances the handle's sample clock,
+*         which timestamps the events passed to `event_callback`; consecutive calls are
+*         taken as consecutive audio.
+*         Only one task may write to a handle at a time.
 *
 * @param  handle  Pointer to the Beat Detection handle
 * @param  buffer  Audio buffer
 *
 * @return
-*       - ESP_OK  Audio data written successfully
-*       - Other   Error code if audio data writing failed
+*       - ESP_OK               Audio data written successfully
+*       - ESP_ERR_INVALID_ARG  Invalid handle or buffer too small
+*       - ESP_ERR_INVALID_STATE  A frame is acquired, or the detector is synchronous
+*       - ESP_ERR_TIMEOUT      Ring buffer full, frame dropped and counted as overrun
 */
 esp_err_t beat_detection_data_write(beat_detection_handle_t handle, beat_detection_audio_buffer_t buffer);
 
+/**
+* @brief  Borrow the next free ring frame to be filled in place
+*
+*         Returns a frame of the ring buffer that the producer fills directly, for example as
+*         the destination of `i2s_channel_read()`, and then hands over with
+*         beat_detection_frame_commit(). The frame holds one hop with `hop_size` > 0, otherwise
+*         `fft_size` samples per channel. Waits like beat_detection_data_write() when the ring is
+*         full; a failed acquire counts as an overrun and the frame's samples as dropped.
+*         Cannot be mixed with a beat_detection_data_write() that left a hop incomplete.
+*
+* @param  handle      Beat Detection handle
+* @param  frame       Output, frame to fill
+* @param  bytes_size  Output, size of the frame in bytes
+*
+* @return
+*       - ESP_OK                 Frame acquired
+*       - ESP_ERR_INVALID_ARG    Invalid arguments
+*       - ESP_ERR_INVALID_STATE  A frame is already acquired, a written hop is incomplete or the detector is synchronous
+*       - ESP_ERR_TIMEOUT        Ring buffer full, counted as overrun
+*/
+esp_err_t beat_detection_frame_acquire(beat_detection_handle_t handle, uint8_t **frame, size_t *bytes_size);
+
+/**
+* @brief  Hand a frame filled after beat_detection_frame_acquire() to the detection task
+*
+* @param  handle  Beat Detection handle
+* @param  frame   Frame returned by beat_detection_frame_acquire(), completely filled
+*
+* @return
+*       - ESP_OK                 Frame queued
+*       - ESP_ERR_INVALID_ARG    Invalid arguments
+*       - ESP_ERR_INVALID_STATE  The frame was not acquired from this handle
+*/
+esp_err_t beat_detection_frame_commit(beat_detection_handle_t handle, uint8_t *frame);
+
+/**
+* @brief  Lend a caller buffer to the detection task without copying it
+*
+*         The buffer is queued as is and analyzed in place; `release_cb` is called from the
+*         detection task once the buffer is no longer used, before the result callbacks of its
+*         last frame. With `hop_size` > 0 the buffer must hold a whole number of hops and the
+*         stream must be at a hop boundary; otherwise at least `fft_size` samples per channel,
+*         of which the first `fft_size` are analyzed. Up to `buffer_cfg.frame_num` buffers can be
+*         lent at a time; when they are all outstanding the call waits like
+*         beat_detection_data_write(). If the call fails the buffer stays with the caller and
+*         `release_cb` is not called. Buffers still queued at beat_detection_deinit() are
+*         released there.
+*
+* @param  handle       Beat Detection handle
+* @param  buffer       Audio buffer, aligned to the sample size, valid until released
+* @param  release_cb   Called with `buffer.audio_buffer` when the task is done with it
+* @param  release_ctx  Context passed to `release_cb`
+*
+* @return
+*       - ESP_OK                 Buffer queued
+*       - ESP_ERR_INVALID_ARG    Invalid arguments or buffer size
+*       - ESP_ERR_INVALID_STATE  A frame is acquired, a written hop is incomplete or the detector is synchronous
+*       - ESP_ERR_TIMEOUT        Too many buffers lent, counted as overrun
+*/
+esp_err_t beat_detection_data_lend(beat_detection_handle_t handle, beat_detection_audio_buffer_t buffer,
+                                   beat_detection_release_callback_t release_cb, void *release_ctx);
+
+/**
+* @brief  Analyze a caller buffer inline on the calling task
+*
+*         Only for detectors initialized with `flags.synchronous`, which create no ring buffer,
+*         queue or task; `task_cfg` and `buffer_cfg` are ignored. The buffer follows the framing
+*         of beat_detection_data_lend(): a whole number of hops with `hop_size` > 0, otherwise at
+*         least `fft_size` samples per channel of which the first `fft_size` are analyzed. Every
+*         frame is analyzed before the call returns, and the result, event and tempo callbacks
+*         and the event ring run from inside it, so the latency is that of the analysis alone.
+*         Samples advance the sample clock as with beat_detection_data_write().
+*         Only one task may process on a handle at a time.
+*
+* @param  handle  Beat Detection handle
+* @param  buffer  Audio buffer, aligned to the sample size
+* @param  event   Output, the first beat event in the buffer, or the event of its last frame
+*                 when none triggered; may be NULL
+*
+* @return
+*       - ESP_OK                 All frames analyzed
+*       - ESP_ERR_INVALID_ARG    Invalid arguments or buffer size
+*       - ESP_ERR_INVALID_STATE  The detector was not initialized with `flags.synchronous`
+*       - ESP_FAIL               The analysis of a frame failed
+*/
+esp_err_t beat_detection_process(beat_detection_handle_t handle, beat_detection_audio_buffer_t buffer, beat_detection_event_t *event);
+
+/**
+* @brief  Get the number of frames dropped because the ring buffer was full
+*
+* @param  handle  Beat Detection handle
+* @param  count   Output, number of overruns since init
+*
+* @return
+*       - ESP_OK               Success
+*       - ESP_ERR_INVALID_ARG  Invalid arguments
+*/
+esp_err_t beat_detection_get_overrun_count(beat_detection_handle_t handle, uint32_t *count);
+
+/**
+* @brief  Get runtime statistics
+*
+*         Frame, drop and queue counters are always kept; per-stage cycle counts need
+*         CONFIG_BEAT_DETECTION_PROFILE. Each is kept since init and over a window that runs
+*         from the previous call that asked for the window, so periodic calls yield
+*         per-period figures. Updating them costs a few cycle counter reads and one short
+*         critical section per frame and per write.
+*
+* @param  handle  Beat Detection handle
+* @param  total   Output, statistics since init, may be NULL
+* @param  window  Output, statistics since the previous window read, which restarts the window, may be NULL
+*
+* @return
+*       - ESP_OK               Success
+*       - ESP_ERR_INVALID_ARG  Invalid arguments
+*/
+esp_err_t beat_detection_get_stats(beat_detection_handle_t handle, beat_detection_stats_t *total, beat_detection_stats_t *window);
+
+/**
+* @brief  Take the oldest beat event from the event ring
+*
+*         Available with `event_queue_cfg.depth` > 0. The detection task pushes every
+*         BEAT_DETECTED event (one per channel in BEAT_DETECTION_CHANNEL_DUAL) into a lock-free
+*         single-producer single-consumer ring and never waits for the consumer; events that do
+*         not fit are counted in `events_dropped` of beat_detection_get_stats(). Only one task
+*         may consume from a handle.
+*
+* @param  handle  Beat Detection handle
+* @param  event   Output, oldest pending event
+*
+* @return
+*       - ESP_OK                 Event returned
+*       - ESP_ERR_NOT_FOUND      No event pending
+*       - ESP_ERR_INVALID_ARG    Invalid arguments
+*       - ESP_ERR_INVALID_STATE  Event queue is not enabled
+*/
+esp_err_t beat_detection_event_poll(beat_detection_handle_t handle, beat_detection_event_t *event);
+
+/**
+* @brief  Take up to `max_events` pending beat events from the event ring at once
+*
+*         Typically called by `event_queue_cfg.notify_task` after ulTaskNotifyTake() returns;
+*         see beat_detection_event_poll().
+*
+* @param  handle      Beat Detection handle
+* @param  events      Output array, oldest first
+* @param  max_events  Capacity of `events`
+* @param  count       Output, number of events returned, 0 when none are pending
+*
+* @return
+*       - ESP_OK                 Success
+*       - ESP_ERR_INVALID_ARG    Invalid arguments
+*       - ESP_ERR_INVALID_STATE  Event queue is not enabled
+*/
+esp_err_t beat_detection_event_drain(beat_detection_handle_t handle, beat_detection_event_t *events, size_t max_events, size_t *count);
+
+/**
+* @brief  Take a snapshot of the latest spectral feature frame
+*
+*         Available when `feature_cfg.band_num` is above 0. Every analysis frame publishes the
+*         energies of the log- or mel-spaced feature bands, computed from the magnitude spectrum
+*         the detector already has, together with the bass energy and the onset strength. The
+*         detector writes the frames into a triple buffer and never waits for readers, so any
+*         number of tasks on any core may call this concurrently; a reader only copies again in
+*         the rare case that the detector overwrote the frame during the copy. In
+*         BEAT_DETECTION_CHANNEL_DUAL mode the features describe the left channel.
+*
+* @param  handle    Beat Detection handle
+* @param  features  Output, the most recent complete feature frame
+*
+* @return
+*       - ESP_OK                 Success
+*       - ESP_ERR_NOT_FOUND      No frame has been analyzed yet
+*       - ESP_ERR_INVALID_ARG    Invalid arguments
+*       - ESP_ERR_INVALID_STATE  Feature export is not enabled
+*/
+esp_err_t beat_detection_get_features(beat_detection_handle_t handle, beat_detection_features_t *features);
+
+/**
+* @brief  Take up to `max_records` pending decision records from the trace ring
+*
+*         Available with `trace_cfg.depth` > 0. Every analysis frame records, for every band,
+*         the peak and the sum of the smoothed band bins of this frame and the previous one,
+*         which are all the decision compares, together with its outcome. The detector never
+*         waits for the consumer; records that do not fit are dropped and counted. Only one
+*         task may consume from a handle, with this function or beat_detection_trace_dump().
+*
+* @param  handle       Beat Detection handle
+* @param  records      Output array, oldest first
+* @param  max_records  Capacity of `records`
+* @param  count        Output, number of records returned, 0 when none are pending
+*
+* @return
+*       - ESP_OK                 Success
+*       - ESP_ERR_INVALID_ARG    Invalid arguments
+*       - ESP_ERR_INVALID_STATE  Tracing is not enabled
+*/
+esp_err_t beat_detection_trace_read(beat_detection_handle_t handle, beat_detection_trace_record_t *records, size_t max_records, size_t *count);
+
+/**
+* @brief  Write the pending decision records as one block of a trace stream
+*
+*         Writes a beat_detection_trace_header_t followed by the pending records straight from
+*         the trace ring, in at most three calls of `write`; nothing is written when no record
+*         is pending. `write` may send to a UART or append to a file, and blocks of successive
+*         calls concatenate into a stream for beat_detection_trace_replay(). When `write` fails
+*         the records already handed to it are consumed and the stream should be discarded.
+*
+* @param  handle  Beat Detection handle
+* @param  write   Called with each run of bytes, returns ESP_OK when all of them were written
+* @param  ctx     Passed to `write`
+* @param  count   Output, number of records written, may be NULL
+*
+* @return
+*       - ESP_OK                 Success
+*       - ESP_ERR_INVALID_ARG    Invalid arguments
+*       - ESP_ERR_INVALID_STATE  Tracing is not enabled
+*       - Others                 Error returned by `write`
+*/
+esp_err_t beat_detection_trace_dump(beat_detection_handle_t handle, beat_detection_trace_write_t write, void *ctx, size_t *count);
+
+/**
+* @brief  Get the engine verification result
+*
+*         Available when `flags.verify_engine` is set. Every frame is then also analyzed
+*         with the complex FFT reference path and the raw magnitude spectra are compared.
+*
+* @param  handle  Beat Detection handle
+* @param  result  Output, accumulated comparison result
+*
+* @return
+*       - ESP_OK                 Success
+*       - ESP_ERR_INVALID_ARG    Invalid arguments
+*       - ESP_ERR_INVALID_STATE  Verification is not enabled
+*/
+esp_err_t beat_detection_get_verify_result(beat_detection_handle_t handle, beat_detection_verify_result_t *result);
+
+/**
+* @brief  Get the current tempo and beat phase estimate
+*
+*         Available when `flags.tempo_tracking` is set. The estimate is updated once per
+*         analysis frame from the onset strength of the configured bands; the beat phase
+*         locks to the detected beats and keeps predicting on the tempo period between them.
+*
+* @param  handle  Beat Detection handle
+* @param  tempo   Output, latest estimate
+*
+* @return
+*       - ESP_OK                 Success
+*       - ESP_ERR_INVALID_ARG    Invalid arguments
+*       - ESP_ERR_INVALID_STATE  Tempo tracking is not enabled
+*/
+esp_err_t beat_detection_get_tempo(beat_detection_handle_t handle, beat_detection_tempo_t *tempo);
+
+/**
+* @brief  Locate the PCM data of a WAV file held in memory
+*
+*         Walks the RIFF chunks of a WAV image (e.g. a memory-mapped file) and returns
+*         a pointer to its samples without copying them. 16-bit and 32-bit PCM are supported.
+*
+* @param  data  WAV file image
+* @param  size  Size of the image in bytes
+* @param  info  Output, format and location of the samples
+*
+* @return
+*       - ESP_OK                 Success
+*       - ESP_ERR_INVALID_ARG    Invalid arguments or not a WAV file
+*       - ESP_ERR_NOT_SUPPORTED  Sample format other than 16-bit or 32-bit PCM
+*       - ESP_ERR_INVALID_SIZE   A chunk before the samples runs past the end of the image
+*/
+esp_err_t beat_detection_wav_parse(const void *data, size_t size, beat_detection_wav_info_t *info);
+
+/**
+* @brief  Detect all beats in a PCM buffer synchronously
+*
+*         Runs the same detector as the task-driven path over a whole interleaved PCM
+*         buffer in the calling task. No task or queue is created and nothing is
+*         allocated per frame; the analysis state is allocated once and freed on return.
+*         Frames are analyzed in place every `hop_size` samples (`fft_size` when
+*         `hop_size` is 0), and `time_interval` is measured on the sample clock, so the
+*         result does not depend on how fast the buffer is processed.
+*         A beat timestamp is the sample position just past the analysis frame that
+*         reported it, i.e. the number of samples per channel the detector had seen.
+*         The task, buffer and callback settings of `cfg` are ignored.
+*
+* @param  cfg           Detector configuration
+* @param  samples       Interleaved PCM in `cfg->audio_cfg.format` with `cfg->audio_cfg.channel` channels
+* @param  sample_count  Samples per channel
+* @param  beats         Output, beat timestamps in samples, may be NULL if `max_beats` is 0
+* @param  max_beats     Capacity of `beats`
+* @param  beat_count    Output, number of beats detected; may exceed `max_beats`, in which
+*                       case only the first `max_beats` timestamps were stored
+*
+* @return
+*       - ESP_OK               Success
+*       - ESP_ERR_INVALID_ARG  Invalid arguments or configuration
+*       - ESP_ERR_NO_MEM       Out of memory
+*/
+esp_err_t beat_detection_batch_detect(beat_detection_cfg_t *cfg, const void *samples, size_t sample_count,
+                                      uint64_t *beats, size_t max_beats, size_t *beat_count);
+
+/**
+* @brief  Re-run the beat decision over captured trace records with other band settings
+*
+*         Applies the fixed-threshold decision of the detector, refractory period included,
+*         to the records of beat_detection_trace_dump() without any spectral analysis, so a
+*         host can try thousands of settings per second on one capture. With the settings the
+*         trace was captured with the beats match the detector's exactly, as long as no record
+*         was dropped. Only `threshold`, `average_ratio`, `min_energy` and `time_interval` of
+*         `bands` are used; the band edges stay those of the capture.
+*
+* @param  header        Header of the trace, any block's
+* @param  records       Records of all blocks of the trace, in stream order
+* @param  record_count  Number of records
+* @param  bands         Settings of `header->band_num` bands, NULL to use those of the header
+* @param  beats         Output, beat timestamps in samples, one per frame and channel with a
+*                       triggered band; may be NULL if `max_beats` is 0
+* @param  max_beats     Capacity of `beats`
+* @param  beat_count    Output, number of beats; may exceed `max_beats`, in which case only the
+*                       first `max_beats` timestamps were stored
+*
+* @return
+*       - ESP_OK                 Success
+*       - ESP_ERR_INVALID_ARG    Invalid arguments, or not a trace of this version
+*       - ESP_ERR_NOT_SUPPORTED  The trace was captured with flags.adaptive_threshold
+*/
+esp_err_t beat_detection_trace_replay(const beat_detection_trace_header_t *header, const beat_detection_trace_record_t *records, size_t record_count,
+                                      const beat_detection_band_cfg_t *bands, uint64_t *beats, size_t max_beats, size_t *beat_count);
+
 #ifdef __cplusplus
 }
 #endif  /* __cplusplus */
@@ -3,38 +3,117 @@
 /* default config */
 #define BEAT_DETECTION_DEFAULT_SAMPLE_RATE                              (16000)
 #define BEAT_DETECTION_DEFAULT_CHANNEL                                  (2)
+#define BEAT_DETECTION_DEFAULT_FORMAT                                   (BEAT_DETECTION_FORMAT_S16)
 #define BEAT_DETECTION_DEFAULT_FFT_SIZE                                 (512)
+#define BEAT_DETECTION_DEFAULT_HOP_SIZE                                 (0)
+#define BEAT_DETECTION_DEFAULT_DECIMATION                               (1)
+#define BEAT_DETECTION_DEFAULT_ENGINE                                   (BEAT_DETECTION_ENGINE_COMPLEX_FFT)
+#define BEAT_DETECTION_DEFAULT_CHANNEL_MODE                             (BEAT_DETECTION_CHANNEL_RIGHT)
 #define BEAT_DETECTION_DEFAULT_BASS_FREQ_MIN                            (200)
 #define BEAT_DETECTION_DEFAULT_BASS_FREQ_MAX                            (300)
 #define BEAT_DETECTION_DEFAULT_TASK_PRIORITY                            (3)
 #define BEAT_DETECTION_DEFAULT_TASK_STACK_SIZE                          (1024 * 5)
 #define BEAT_DETECTION_DEFAULT_TASK_CORE_ID                             (0)
+#define BEAT_DETECTION_DEFAULT_PIPELINE_CORE_ID                         (1)
 #define BEAT_DETECTION_DEFAULT_ENABLE_PSRAM                             (false)
 #define BEAT_DETECTION_DEFAULT_THRESHOLD                                (6.0f)
 #define BEAT_DETECTION_DEFAULT_AVERAGE_RATIO                            (5.0f)
 #define BEAT_DETECTION_DEFAULT_MIN_ENERGY                               (0.01f)
 #define BEAT_DETECTION_DEFAULT_TIME_INTERVAL                            (100)
+#define BEAT_DETECTION_DEFAULT_FRAME_NUM                                (4)
+#define BEAT_DETECTION_DEFAULT_WRITE_TIMEOUT_MS                         (100)
+#define BEAT_DETECTION_DEFAULT_WRITE_BLOCKING                           (false)
+#define BEAT_DETECTION_DEFAULT_TEMPO_BPM_MIN                            (60)
+#define BEAT_DETECTION_DEFAULT_TEMPO_BPM_MAX                            (200)
+#define BEAT_DETECTION_DEFAULT_TEMPO_LEAD_MS                            (0)
+#define BEAT_DETECTION_DEFAULT_TEMPO_MIN_CONFIDENCE                     (0.3f)
+#define BEAT_DETECTION_DEFAULT_ADAPTIVE_WINDOW_MS                       (1000)
+#define BEAT_DETECTION_DEFAULT_ADAPTIVE_K                               (3.0f)
+#define BEAT_DETECTION_DEFAULT_GATE_OPEN_LEVEL                          (0.001f)
+#define BEAT_DETECTION_DEFAULT_GATE_CLOSE_LEVEL                         (0.0005f)
+#define BEAT_DETECTION_DEFAULT_EVENT_QUEUE_DEPTH                        (0)
+#define BEAT_DETECTION_DEFAULT_EVENT_NOTIFY_COUNT                       (1)
+#define BEAT_DETECTION_DEFAULT_EVENT_NOTIFY_TIMEOUT_MS                  (0)
+#define BEAT_DETECTION_DEFAULT_FEATURE_BAND_NUM                         (0)
+#define BEAT_DETECTION_DEFAULT_FEATURE_SCALE                            (BEAT_DETECTION_FEATURE_SCALE_LOG)
+#define BEAT_DETECTION_DEFAULT_FEATURE_FREQ_MIN                         (40)
+#define BEAT_DETECTION_DEFAULT_FEATURE_FREQ_MAX                         (8000)
+#define BEAT_DETECTION_DEFAULT_TRACE_DEPTH                              (0)
+
+#define BEAT_DETECTION_MAX_BANDS                                        (8)
+#define BEAT_DETECTION_MAX_FEATURE_BANDS                                (32)
+#define BEAT_DETECTION_WORKSPACE_ALIGN                                  (16)
 
 #define BEAT_DETECTION_DEFAULT_CFG() {                                          \
     .audio_cfg = {                                                              \
         .sample_rate = BEAT_DETECTION_DEFAULT_SAMPLE_RATE,                      \
         .channel = BEAT_DETECTION_DEFAULT_CHANNEL,                              \
+        .format = BEAT_DETECTION_DEFAULT_FORMAT,                                \
         .fft_size = BEAT_DETECTION_DEFAULT_FFT_SIZE,                            \
+        .hop_size = BEAT_DETECTION_DEFAULT_HOP_SIZE,                            \
+        .decimation = BEAT_DETECTION_DEFAULT_DECIMATION,                        \
+        .engine = BEAT_DETECTION_DEFAULT_ENGINE,                                \
+        .channel_mode = BEAT_DETECTION_DEFAULT_CHANNEL_MODE,                    \
         .bass_freq_start = BEAT_DETECTION_DEFAULT_BASS_FREQ_MIN,                \
         .bass_freq_end = BEAT_DETECTION_DEFAULT_BASS_FREQ_MAX,                  \
         .threshold = BEAT_DETECTION_DEFAULT_THRESHOLD,                          \
         .average_ratio = BEAT_DETECTION_DEFAULT_AVERAGE_RATIO,                  \
         .min_energy = BEAT_DETECTION_DEFAULT_MIN_ENERGY,                        \
         .time_interval = BEAT_DETECTION_DEFAULT_TIME_INTERVAL,                  \
+        .band_num = 0,                                                          \
+        .bands = NULL,                                                          \
     },                                                                          \
     .task_cfg = {                                                               \
         .priority = BEAT_DETECTION_DEFAULT_TASK_PRIORITY,                       \
         .stack_size = BEAT_DETECTION_DEFAULT_TASK_STACK_SIZE,                   \
         .core_id = BEAT_DETECTION_DEFAULT_TASK_CORE_ID,                         \
+        .pipeline_core_id = BEAT_DETECTION_DEFAULT_PIPELINE_CORE_ID,            \
+    },                                                                          \
+    .buffer_cfg = {                                                             \
+        .frame_num = BEAT_DETECTION_DEFAULT_FRAME_NUM,                          \
+        .write_timeout_ms = BEAT_DETECTION_DEFAULT_WRITE_TIMEOUT_MS,            \
+    },                                                                          \
+    .tempo_cfg = {                                                              \
+        .bpm_min = BEAT_DETECTION_DEFAULT_TEMPO_BPM_MIN,                        \
+        .bpm_max = BEAT_DETECTION_DEFAULT_TEMPO_BPM_MAX,                        \
+        .lead_ms = BEAT_DETECTION_DEFAULT_TEMPO_LEAD_MS,                        \
+        .min_confidence = BEAT_DETECTION_DEFAULT_TEMPO_MIN_CONFIDENCE,          \
+    },                                                                          \
+    .adaptive_cfg = {                                                           \
+        .window_ms = BEAT_DETECTION_DEFAULT_ADAPTIVE_WINDOW_MS,                 \
+        .k = BEAT_DETECTION_DEFAULT_ADAPTIVE_K,                                 \
+    },                                                                          \
+    .gate_cfg = {                                                               \
+        .open_level = BEAT_DETECTION_DEFAULT_GATE_OPEN_LEVEL,                   \
+        .close_level = BEAT_DETECTION_DEFAULT_GATE_CLOSE_LEVEL,                 \
+    },                                                                          \
+    .event_queue_cfg = {                                                        \
+        .depth = BEAT_DETECTION_DEFAULT_EVENT_QUEUE_DEPTH,                      \
+        .notify_count = BEAT_DETECTION_DEFAULT_EVENT_NOTIFY_COUNT,              \
+        .notify_timeout_ms = BEAT_DETECTION_DEFAULT_EVENT_NOTIFY_TIMEOUT_MS,    \
+        .notify_task = NULL,                                                    \
+    },                                                                          \
+    .feature_cfg = {                                                            \
+        .band_num = BEAT_DETECTION_DEFAULT_FEATURE_BAND_NUM,                    \
+        .scale = BEAT_DETECTION_DEFAULT_FEATURE_SCALE,                          \
+        .freq_min = BEAT_DETECTION_DEFAULT_FEATURE_FREQ_MIN,                    \
+        .freq_max = BEAT_DETECTION_DEFAULT_FEATURE_FREQ_MAX,                    \
+    },                                                                          \
+    .trace_cfg = {                                                              \
+        .depth = BEAT_DETECTION_DEFAULT_TRACE_DEPTH,                            \
     },                                                                          \
     .result_callback = NULL,                                                    \
     .result_callback_ctx = NULL,                                                \
+    .event_callback = NULL,                                                     \
+    .tempo_callback = NULL,                                                     \
     .flags = {                                                                  \
         .enable_psram = false,                                                  \
+        .write_blocking = BEAT_DETECTION_DEFAULT_WRITE_BLOCKING,                \
+        .verify_engine = false,                                                 \
+        .tempo_tracking = false,                                                \
+        .adaptive_threshold = false,                                            \
+        .synchronous = false,                                                   \
+        .pipeline = false,                                                      \
+        .silence_gate = false,                                                  \
     }                                                                           \
 }